@@ -0,0 +1,73 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "tree.hpp"
+
+using SearchTrees::AVL_Tree;
+using Sum_Tree = AVL_Tree<int, std::less<int>, std::allocator<int>, false, SearchTrees::Sum_Aggregate<long long>>;
+
+// Range sums over a tree of `keys` random keys: for_each_in_range() adding up
+// every key of the interval against reduce() over the subtree aggregates,
+// growing the interval tenfold each round. Also prints the cost of keeping
+// the aggregates when the trees are filled.
+// Usage: bench_aggregate [keys] [queries]
+
+template <typename Func>
+static double measure_ms(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+  size_t queries = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 1'000;
+
+  std::mt19937 gen{42};
+  int max_key = static_cast<int>(4 * n);
+  std::uniform_int_distribution<int> dist{0, max_key};
+  std::vector<int> keys(n);
+  for (int &key : keys)
+    key = dist(gen);
+
+  AVL_Tree<int> plain;
+  Sum_Tree tree;
+  double plain_ms = measure_ms([&] {
+    for (int key : keys)
+      plain.insert(key);
+  });
+  double sum_ms = measure_ms([&] {
+    for (int key : keys)
+      tree.insert(key);
+  });
+  std::cerr << "insert " << n << " keys: plain " << plain_ms << " ms, with sums " << sum_ms << " ms\n";
+
+  std::cout << "range_width,queries,for_each_ms,reduce_ms\n";
+  for (int width = 100; width <= max_key / 10; width *= 10) {
+    std::vector<int> lows(queries);
+    std::uniform_int_distribution<int> low_dist{0, max_key - width};
+    for (int &lo : lows)
+      lo = low_dist(gen);
+
+    long long loop_total = 0, reduce_total = 0;
+    double for_each_ms = measure_ms([&] {
+      for (int lo : lows)
+        tree.for_each_in_range(lo, lo + width, [&loop_total](int key) { loop_total += key; });
+    });
+    double reduce_ms = measure_ms([&] {
+      for (int lo : lows)
+        reduce_total += tree.reduce(lo, lo + width);
+    });
+
+    if (loop_total != reduce_total) {
+      std::cerr << "sum mismatch for width " << width << "\n";
+      return 1;
+    }
+    std::cout << width << "," << queries << "," << for_each_ms << "," << reduce_ms << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,58 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "tree.hpp"
+
+using SearchTrees::AVL_Tree;
+
+// Compares throughput of a loop over lower_bound(key, root) with lower_bound_batch()
+// for random keys in trees that don't fit in cache.
+// Usage: bench_batch_lookup [max_keys] [queries]
+
+template <typename Func>
+static double measure_ms(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_keys = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+  size_t queries = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 2'000'000;
+
+  std::cout << "keys,loop_mops,batch_mops,speedup\n";
+  for (size_t n = 10'000; n <= max_keys; n *= 10) {
+    std::mt19937 gen{static_cast<unsigned>(n)};
+    std::uniform_int_distribution<int> dist{0, static_cast<int>(4 * n)};
+
+    // random insertion order scatters nodes over the pool
+    AVL_Tree<int> tree{};
+    while (tree.size() < n)
+      tree.insert(dist(gen));
+    const AVL_Tree<int> &const_tree = tree;
+
+    std::vector<int> keys(queries);
+    for (auto &key : keys)
+      key = dist(gen);
+    std::vector<AVL_Tree<int>::const_iterator> loop_results(queries), batch_results(queries);
+
+    double loop_ms = measure_ms([&] {
+      for (size_t i = 0; i < queries; ++i)
+        loop_results[i] = const_tree.lower_bound(keys[i], const_tree.root());
+    });
+    double batch_ms = measure_ms([&] {
+      const_tree.lower_bound_batch(keys.data(), keys.size(), batch_results.data());
+    });
+
+    if (loop_results != batch_results) {
+      std::cerr << "results mismatch for " << n << " keys\n";
+      return 1;
+    }
+    std::cout << n << "," << queries / loop_ms / 1000 << "," << queries / batch_ms / 1000 << "," << loop_ms / batch_ms << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,60 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "tree.hpp"
+
+using SearchTrees::AVL_Tree;
+
+// Compares applying batches of random keys to a tree of `keys` random keys
+// by insert()/erase() loops with insert_batch()/erase_batch().
+// Usage: bench_batch_update [keys] [max_batch]
+
+template <typename Func>
+static double measure_ms(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+  size_t max_batch = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 1'000'000;
+
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<int> dist{0, static_cast<int>(4 * n)};
+  std::vector<int> initial(n);
+  for (auto &key : initial)
+    key = dist(gen);
+  const AVL_Tree<int> source{initial.begin(), initial.end()};
+
+  std::cout << "batch,insert_loop_ms,insert_batch_ms,erase_loop_ms,erase_batch_ms\n";
+  for (size_t m = 10'000; m <= max_batch; m *= 10) {
+    std::vector<int> batch(m);
+    for (auto &key : batch)
+      key = dist(gen);
+
+    AVL_Tree<int> loop_tree{source}, batch_tree{source};
+    double insert_loop_ms = measure_ms([&] {
+      for (int key : batch)
+        loop_tree.insert(key);
+    });
+    double insert_batch_ms = measure_ms([&] { batch_tree.insert_batch(batch.begin(), batch.end()); });
+    double erase_loop_ms = measure_ms([&] {
+      for (int key : batch)
+        loop_tree.erase(key);
+    });
+    double erase_batch_ms = measure_ms([&] { batch_tree.erase_batch(batch.begin(), batch.end()); });
+
+    if (loop_tree.size() != batch_tree.size()) {
+      std::cerr << "size mismatch for batch of " << m << " keys\n";
+      return 1;
+    }
+    std::cout << m << "," << insert_loop_ms << "," << insert_batch_ms << ","
+              << erase_loop_ms << "," << erase_batch_ms << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+#include "tree.hpp"
+
+using SearchTrees::AVL_Tree;
+using SearchTrees::BST_Tree;
+
+// Benchmark suite: drives BST_Tree, AVL_Tree and std::set as a baseline through
+// insert, churn, lookup and copy workloads for 1K..max_keys keys.
+// Prints one CSV row per container, workload and size:
+//   container,workload,keys,ops,ns_per_op,allocs,peak_rss_kb
+// allocs counts calls of global operator new during the timed part,
+// peak_rss_kb is the peak resident set size of the case if the OS allows
+// resetting it (Linux), otherwise the peak of the process so far.
+// Usage: bench [max_keys] [workload]
+
+static std::size_t g_allocs = 0;
+
+void *operator new(std::size_t size) {
+  ++g_allocs;
+  if (void *ptr = std::malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc{};
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+static void reset_peak_rss() {
+#if defined(__linux__)
+  std::ofstream clear_refs{"/proc/self/clear_refs"};
+  if (clear_refs)
+    clear_refs << "5";
+#endif
+}
+
+static long peak_rss_kb() {
+#if defined(__linux__)
+  std::ifstream status{"/proc/self/status"};
+  std::string line;
+  while (std::getline(status, line))
+    if (line.compare(0, 6, "VmHWM:") == 0)
+      return std::strtol(line.c_str() + 6, nullptr, 10);
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+#else
+  return 0;
+#endif
+}
+
+// Zipfian ranks in [0, n) with skew theta, as in Gray et al. "Quickly generating
+// billion-record synthetic databases".
+class Zipf_Generator {
+  std::size_t n_;
+  double theta_, alpha_, zeta_n_, eta_;
+  std::uniform_real_distribution<double> uniform_{0.0, 1.0};
+
+  static double zeta(std::size_t n, double theta) {
+    double sum = 0;
+    for (std::size_t i = 1; i <= n; ++i)
+      sum += 1.0 / std::pow(static_cast<double>(i), theta);
+    return sum;
+  }
+
+public:
+  Zipf_Generator(std::size_t n, double theta = 0.99)
+    : n_(n), theta_(theta), alpha_(1.0 / (1.0 - theta)), zeta_n_(zeta(n, theta))
+  {
+    double zeta_2 = zeta(2, theta);
+    eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta_2 / zeta_n_);
+  }
+
+  template <typename Gen>
+  std::size_t operator() (Gen &gen) {
+    double u = uniform_(gen);
+    double uz = u * zeta_n_;
+    if (uz < 1.0)
+      return 0;
+    if (uz < 1.0 + std::pow(0.5, theta_))
+      return 1;
+    auto rank = static_cast<std::size_t>(n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+    return std::min(rank, n_ - 1);
+  }
+};
+
+// Bijective scramble of ranks, so hot Zipfian keys are spread over the key space
+static int scramble(std::size_t rank) {
+  return static_cast<int>(static_cast<std::uint32_t>(rank) * 2654435761u);
+}
+
+struct Result {
+  std::size_t ops = 0;
+  double ns = 0;
+  std::size_t allocs = 0;
+};
+
+template <typename Func>
+static Result measure(std::size_t ops, Func func) {
+  std::size_t allocs = g_allocs;
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  Result result;
+  result.ops = ops;
+  result.ns = std::chrono::duration<double, std::nano>(finish - start).count();
+  result.allocs = g_allocs - allocs;
+  return result;
+}
+
+// Keeps results observable so lookups aren't optimized away
+static volatile std::size_t g_sink = 0;
+
+template <typename Set>
+struct Workloads {
+  std::size_t n_;
+  std::mt19937_64 gen_;
+  std::vector<int> random_keys_; // n unique keys in random order, even numbers only
+  std::vector<int> queries_;     // half of them hit
+
+  explicit Workloads(std::size_t n) : n_(n), gen_(n) {
+    random_keys_.resize(n);
+    for (std::size_t i = 0; i < n; ++i)
+      random_keys_[i] = static_cast<int>(2 * i);
+    std::shuffle(random_keys_.begin(), random_keys_.end(), gen_);
+
+    queries_.resize(std::min<std::size_t>(n, 1'000'000));
+    std::uniform_int_distribution<int> dist{0, static_cast<int>(2 * n - 1)};
+    for (auto &key : queries_)
+      key = dist(gen_);
+  }
+
+  Set random_set() const {
+    Set set;
+    for (int key : random_keys_)
+      set.insert(key);
+    return set;
+  }
+
+  Result insert_seq() {
+    return measure(n_, [&] {
+      Set set;
+      for (std::size_t i = 0; i < n_; ++i)
+        set.insert(static_cast<int>(i));
+      g_sink += set.size();
+    });
+  }
+
+  Result insert_random() {
+    return measure(n_, [&] {
+      Set set;
+      for (int key : random_keys_)
+        set.insert(key);
+      g_sink += set.size();
+    });
+  }
+
+  Result insert_zipf() {
+    Zipf_Generator zipf{n_};
+    std::vector<int> keys(n_);
+    for (auto &key : keys)
+      key = scramble(zipf(gen_));
+    return measure(n_, [&] {
+      Set set;
+      for (int key : keys)
+        set.insert(key);
+      g_sink += set.size();
+    });
+  }
+
+  // Erases a present key or inserts an absent one, so the size stays around n
+  Result churn() {
+    Set set = random_set();
+    std::vector<int> keys(n_);
+    std::uniform_int_distribution<int> dist{0, static_cast<int>(2 * n_ - 1)};
+    for (auto &key : keys)
+      key = dist(gen_);
+    return measure(n_, [&] {
+      for (int key : keys) {
+        if (set.find(key) != set.end())
+          set.erase(key);
+        else
+          set.insert(key);
+      }
+      g_sink += set.size();
+    });
+  }
+
+  Result find() {
+    const Set set = random_set();
+    return measure(queries_.size(), [&] {
+      std::size_t found = 0;
+      for (int key : queries_)
+        found += (set.find(key) != set.end());
+      g_sink += found;
+    });
+  }
+
+  // Alternates lower_bound() and upper_bound()
+  Result bounds() {
+    const Set set = random_set();
+    return measure(queries_.size(), [&] {
+      std::size_t found = 0;
+      for (std::size_t i = 0; i < queries_.size(); ++i) {
+        auto it = (i & 1) ? set.upper_bound(queries_[i]) : set.lower_bound(queries_[i]);
+        found += (it != set.end());
+      }
+      g_sink += found;
+    });
+  }
+
+  Result copy() {
+    const Set set = random_set();
+    return measure(n_, [&] {
+      Set copy{set};
+      g_sink += copy.size();
+    });
+  }
+};
+
+template <typename Set>
+static void run_container(const char *container, std::size_t max_keys, const std::string &only) {
+  struct Workload {
+    const char *name_;
+    Result (Workloads<Set>::*run_)();
+  };
+  static const Workload workloads[] = {
+    {"insert_seq", &Workloads<Set>::insert_seq},
+    {"insert_random", &Workloads<Set>::insert_random},
+    {"insert_zipf", &Workloads<Set>::insert_zipf},
+    {"churn", &Workloads<Set>::churn},
+    {"find", &Workloads<Set>::find},
+    {"bounds", &Workloads<Set>::bounds},
+    {"copy", &Workloads<Set>::copy},
+  };
+
+  for (std::size_t n = 1000; n <= max_keys; n *= 10) {
+    Workloads<Set> data{n};
+    for (const auto &workload : workloads) {
+      if (!only.empty() && only != workload.name_)
+        continue;
+      // unbalanced tree degenerates into a list on sorted input
+      if (std::is_same<Set, BST_Tree<int>>::value && n > 10'000 && std::strcmp(workload.name_, "insert_seq") == 0)
+        continue;
+
+      reset_peak_rss();
+      Result result = (data.*workload.run_)();
+      std::cout << container << "," << workload.name_ << "," << n << "," << result.ops << ","
+                << result.ns / result.ops << "," << result.allocs << "," << peak_rss_kb() << std::endl;
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  std::size_t max_keys = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+  std::string only = (argc > 2) ? argv[2] : "";
+
+  std::cout << "container,workload,keys,ops,ns_per_op,allocs,peak_rss_kb\n";
+  run_container<std::set<int>>("std_set", max_keys, only);
+  run_container<BST_Tree<int>>("bst_tree", max_keys, only);
+  run_container<AVL_Tree<int>>("avl_tree", max_keys, only);
+
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "bplus_tree.hpp"
+
+using SearchTrees::AVL_Node;
+using SearchTrees::AVL_Tree;
+using SearchTrees::BPlus_Tree;
+
+// Compares AVL_Tree with BPlus_Tree of cache-line, 4-line and page-sized nodes:
+// depth, bytes of nodes per key, time of random inserts and erases and of
+// random lower_bound() lookups.
+// Usage: bench_bplus [max_keys] [queries], pass 10000000 to reach 10M keys.
+
+template <typename Func>
+static double measure_ms(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+template <typename Tree>
+static size_t height(const Tree &tree) { return tree.height(); }
+static size_t height(const AVL_Tree<int> &tree) { return tree.empty() ? 0 : tree.root().node()->height_; }
+
+template <typename Tree>
+static size_t memory_used(const Tree &tree) { return tree.memory_used(); }
+static size_t memory_used(const AVL_Tree<int> &tree) { return tree.size() * sizeof(AVL_Node<int>); }
+
+template <typename Tree>
+static void run(const char *name, const std::vector<int> &keys, const std::vector<int> &queries) {
+  Tree tree;
+  double insert_ms = measure_ms([&] {
+    for (int key : keys)
+      tree.insert(key);
+  });
+
+  long long sum = 0;
+  double lookup_ms = measure_ms([&] {
+    for (int key : queries) {
+      auto it = tree.lower_bound(key);
+      sum += (it != tree.end()) ? *it : -1;
+    }
+  });
+  size_t tree_height = height(tree);
+  double bytes_per_key = static_cast<double>(memory_used(tree)) / tree.size();
+
+  double erase_ms = measure_ms([&] {
+    for (size_t i = 0; i < keys.size(); i += 2)
+      tree.erase(keys[i]);
+  });
+
+  std::cout << name << "," << keys.size() << "," << tree_height << "," << bytes_per_key << ","
+            << insert_ms * 1e6 / keys.size() << "," << erase_ms * 2e6 / keys.size() << ","
+            << lookup_ms * 1e6 / queries.size() << "," << sum << "\n";
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_keys = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+  size_t query_count = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 2'000'000;
+
+  std::cout << "container,keys,height,bytes_per_key,ns_per_insert,ns_per_erase,ns_per_lookup,checksum\n";
+  for (size_t n = 10'000; n <= max_keys; n *= 10) {
+    std::mt19937 gen{static_cast<unsigned>(n)};
+    std::uniform_int_distribution<int> dist{0, static_cast<int>(4 * n)};
+    std::vector<int> keys(n), queries(query_count);
+    for (auto &key : keys)
+      key = dist(gen);
+    for (auto &key : queries)
+      key = dist(gen);
+
+    run<AVL_Tree<int>>("avl", keys, queries);
+    run<BPlus_Tree<int, std::less<int>, std::allocator<int>, 64>>("bplus_64", keys, queries);
+    run<BPlus_Tree<int, std::less<int>, std::allocator<int>, 256>>("bplus_256", keys, queries);
+    run<BPlus_Tree<int, std::less<int>, std::allocator<int>, 4096>>("bplus_4096", keys, queries);
+  }
+
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "tree.hpp"
+
+using SearchTrees::AVL_Tree;
+
+// Compares building AVL_Tree from sorted keys by an insert() loop
+// with the linear-time balanced build done by the range constructor.
+// Usage: bench_bulk_load [max_keys]
+
+template <typename Func>
+static double measure_ms(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_keys = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+
+  std::cout << "keys,insert_loop_ms,bulk_build_ms,speedup\n";
+  for (size_t n = 1000; n <= max_keys; n *= 10) {
+    std::vector<int> keys(n);
+    for (size_t i = 0; i < n; ++i)
+      keys[i] = static_cast<int>(i);
+
+    size_t check_insert = 0, check_bulk = 0;
+    double insert_ms = measure_ms([&] {
+      AVL_Tree<int> tree{};
+      for (int key : keys)
+        tree.insert(key);
+      check_insert = tree.size();
+    });
+    double bulk_ms = measure_ms([&] {
+      AVL_Tree<int> tree{keys.begin(), keys.end()};
+      check_bulk = tree.size();
+    });
+
+    if (check_insert != n || check_bulk != n) {
+      std::cerr << "size mismatch for " << n << " keys\n";
+      return 1;
+    }
+    std::cout << n << "," << insert_ms << "," << bulk_ms << "," << insert_ms / bulk_ms << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "compact_tree.hpp"
+#include "tree.hpp"
+
+using SearchTrees::AVL_Node;
+using SearchTrees::AVL_Tree;
+using SearchTrees::Compact_AVL_Tree;
+
+// Compares AVL_Tree with Compact_AVL_Tree, whose nodes are linked by 32-bit
+// indices: bytes of nodes per key (spare capacity of the compact storage is
+// given back first), time of random inserts, lookups and erases, and of
+// copying the whole tree.
+// Usage: bench_compact [max_keys] [queries], pass 10000000 to reach 10M keys.
+
+template <typename Func>
+static double measure_ms(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+template <typename Tree>
+static size_t memory_used(const Tree &tree) { return tree.memory_used(); }
+static size_t memory_used(const AVL_Tree<int> &tree) { return tree.size() * sizeof(AVL_Node<int>); }
+
+template <typename Tree>
+static void shrink_to_fit(Tree &tree) { tree.shrink_to_fit(); }
+static void shrink_to_fit(AVL_Tree<int> &) {}
+
+template <typename Tree>
+static void run(const char *name, const std::vector<int> &keys, const std::vector<int> &queries) {
+  Tree tree;
+  double insert_ms = measure_ms([&] {
+    for (int key : keys)
+      tree.insert(key);
+  });
+
+  long long sum = 0;
+  double lookup_ms = measure_ms([&] {
+    for (int key : queries) {
+      auto it = tree.lower_bound(key);
+      sum += (it != tree.end()) ? *it : -1;
+    }
+  });
+  shrink_to_fit(tree);
+  double bytes_per_key = static_cast<double>(memory_used(tree)) / tree.size();
+
+  size_t copied = 0;
+  double copy_ms = measure_ms([&] {
+    Tree copy{tree};
+    copied = copy.size();
+  });
+  sum += static_cast<long long>(copied);
+
+  double erase_ms = measure_ms([&] {
+    for (size_t i = 0; i < keys.size(); i += 2)
+      tree.erase(keys[i]);
+  });
+
+  std::cout << name << "," << keys.size() << "," << bytes_per_key << ","
+            << insert_ms * 1e6 / keys.size() << "," << erase_ms * 2e6 / keys.size() << ","
+            << lookup_ms * 1e6 / queries.size() << "," << copy_ms << "," << sum << "\n";
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_keys = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+  size_t query_count = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 2'000'000;
+
+  std::cout << "container,keys,bytes_per_key,ns_per_insert,ns_per_erase,ns_per_lookup,copy_ms,checksum\n";
+  for (size_t n = 10'000; n <= max_keys; n *= 10) {
+    std::mt19937 gen{static_cast<unsigned>(n)};
+    std::uniform_int_distribution<int> dist{0, static_cast<int>(4 * n)};
+    std::vector<int> keys(n), queries(query_count);
+    for (auto &key : keys)
+      key = dist(gen);
+    for (auto &key : queries)
+      key = dist(gen);
+
+    run<AVL_Tree<int>>("avl", keys, queries);
+    run<Compact_AVL_Tree<int>>("compact", keys, queries);
+  }
+
+  return 0;
+}
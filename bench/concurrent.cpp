@@ -0,0 +1,123 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "concurrent_tree.hpp"
+
+using SearchTrees::AVL_Tree;
+using SearchTrees::Concurrent_Tree;
+
+// Read scaling with one concurrent writer: readers run random find() while
+// a writer erases and inserts keys, the size stays around the initial one.
+// AVL_Tree behind std::mutex and std::shared_mutex is the baseline for the
+// lock-free readers of Concurrent_Tree.
+// Usage: bench_concurrent [keys] [max_readers] [ms_per_case]
+
+// AVL_Tree behind a lock, Mutex is std::mutex or std::shared_mutex
+template <typename Mutex>
+class Locked_Tree {
+  AVL_Tree<int> tree_;
+  mutable Mutex mutex_;
+
+public:
+  bool contains(int key) const {
+    if constexpr (std::is_same<Mutex, std::shared_mutex>::value) {
+      std::shared_lock<Mutex> lock{mutex_};
+      return tree_.find(key) != tree_.end();
+    } else {
+      std::lock_guard<Mutex> lock{mutex_};
+      return tree_.find(key) != tree_.end();
+    }
+  }
+  void insert(int key) {
+    std::lock_guard<Mutex> lock{mutex_};
+    tree_.insert(key);
+  }
+  bool erase(int key) {
+    std::lock_guard<Mutex> lock{mutex_};
+    return tree_.erase(key);
+  }
+};
+
+struct Result {
+  double reads_per_sec = 0;
+  double writes_per_sec = 0;
+};
+
+template <typename Tree>
+static Result run_case(size_t n, unsigned readers, unsigned ms) {
+  Tree tree;
+  for (size_t i = 0; i < n; ++i)
+    tree.insert(static_cast<int>(2 * i));
+
+  std::atomic<bool> start{false}, stop{false};
+  std::atomic<size_t> reads{0}, found{0};
+  size_t writes = 0;
+
+  std::vector<std::thread> threads;
+  for (unsigned r = 0; r < readers; ++r) {
+    threads.emplace_back([&, r] {
+      std::mt19937 gen{r};
+      std::uniform_int_distribution<int> dist{0, static_cast<int>(2 * n - 1)};
+      size_t local_reads = 0, local_found = 0;
+      while (!start.load(std::memory_order_acquire))
+        std::this_thread::yield();
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 64; ++i)
+          local_found += tree.contains(dist(gen));
+        local_reads += 64;
+      }
+      reads += local_reads;
+      found += local_found;
+    });
+  }
+  threads.emplace_back([&] {
+    std::mt19937 gen{12345};
+    std::uniform_int_distribution<int> dist{0, static_cast<int>(2 * n - 1)};
+    while (!start.load(std::memory_order_acquire))
+      std::this_thread::yield();
+    while (!stop.load(std::memory_order_relaxed)) {
+      int key = dist(gen);
+      if (!tree.erase(key))
+        tree.insert(key);
+      ++writes;
+    }
+  });
+
+  auto begin = std::chrono::steady_clock::now();
+  start.store(true, std::memory_order_release);
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  stop.store(true);
+  for (auto &thread : threads)
+    thread.join();
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+  if (found.load() > reads.load())
+    std::cerr << "inconsistent lookups\n";
+  return {reads.load() / sec, writes / sec};
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+  unsigned max_readers = (argc > 2) ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10)) : 64;
+  unsigned ms = (argc > 3) ? static_cast<unsigned>(std::strtoul(argv[3], nullptr, 10)) : 500;
+
+  std::cout << "container,readers,reads_per_sec,writes_per_sec\n";
+  for (unsigned readers = 1; readers <= max_readers; readers *= 2) {
+    auto print = [readers](const char *container, Result result) {
+      std::cout << container << "," << readers << "," << result.reads_per_sec << ","
+                << result.writes_per_sec << std::endl;
+    };
+    print("mutex", run_case<Locked_Tree<std::mutex>>(n, readers, ms));
+    print("shared_mutex", run_case<Locked_Tree<std::shared_mutex>>(n, readers, ms));
+    print("concurrent", run_case<Concurrent_Tree<int>>(n, readers, ms));
+  }
+
+  return 0;
+}
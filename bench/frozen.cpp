@@ -0,0 +1,67 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "frozen_tree.hpp"
+
+using SearchTrees::AVL_Tree;
+using SearchTrees::Frozen_Tree;
+
+// Compares random lower_bound() lookups in pointer-based AVL_Tree with the
+// Eytzinger-ordered Frozen_Tree snapshot of it.
+// Usage: bench_frozen [max_keys] [queries], pass 100000000 to reach 100M keys.
+
+template <typename Func>
+static double measure_ms(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_keys = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+  size_t queries = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 2'000'000;
+
+  std::cout << "keys,tree_ns_per_lookup,frozen_ns_per_lookup,freeze_ms,speedup\n";
+  for (size_t n = 1'000'000; n <= max_keys; n *= 10) {
+    std::mt19937 gen{static_cast<unsigned>(n)};
+    std::uniform_int_distribution<int> dist{0, static_cast<int>(4 * n)};
+
+    AVL_Tree<int> tree{};
+    while (tree.size() < n)
+      tree.insert(dist(gen));
+
+    Frozen_Tree<int> frozen;
+    double freeze_ms = measure_ms([&] { frozen = freeze(tree); });
+
+    std::vector<int> keys(queries);
+    for (auto &key : keys)
+      key = dist(gen);
+
+    const AVL_Tree<int> &const_tree = tree;
+    long long tree_sum = 0, frozen_sum = 0;
+    double tree_ms = measure_ms([&] {
+      for (int key : keys) {
+        auto it = const_tree.lower_bound(key, const_tree.root());
+        tree_sum += (it != const_tree.end()) ? *it : -1;
+      }
+    });
+    double frozen_ms = measure_ms([&] {
+      for (int key : keys) {
+        auto it = frozen.lower_bound(key);
+        frozen_sum += (it != frozen.end()) ? *it : -1;
+      }
+    });
+
+    if (tree_sum != frozen_sum) {
+      std::cerr << "results mismatch for " << n << " keys\n";
+      return 1;
+    }
+    std::cout << n << "," << tree_ms * 1e6 / queries << "," << frozen_ms * 1e6 / queries << ","
+              << freeze_ms << "," << tree_ms / frozen_ms << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,89 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "tree.hpp"
+
+using SearchTrees::AVL_Tree;
+
+// Hinted insert and finger search on increasing and nearly sorted streams.
+// "append" inserts 0, 1, 2, ..., "jitter" inserts timestamps that arrive up to
+// 64 positions out of order. Hinted inserts pass end() or the iterator of the
+// previous key, finger lookups search the stream in order from the previous hit.
+// Every tree is filled and emptied before its timed run, so nodes come from
+// the free list in address order and page faults on fresh memory don't hide
+// the search cost.
+// Usage: bench_hint_insert [keys]
+
+template <typename Func>
+static double measure_ms(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+static void warm_up(AVL_Tree<int> &tree, const std::vector<int> &keys) {
+  for (int key : keys)
+    tree.insert(key);
+  while (!tree.empty())
+    tree.erase(tree.begin());
+}
+
+static void run(const char *stream, const std::vector<int> &keys) {
+  AVL_Tree<int> plain, at_end, at_previous;
+  warm_up(plain, keys);
+  warm_up(at_end, keys);
+  warm_up(at_previous, keys);
+  double plain_ms = measure_ms([&] {
+    for (int key : keys)
+      plain.insert(key);
+  });
+  double end_ms = measure_ms([&] {
+    for (int key : keys)
+      at_end.insert(at_end.end(), key);
+  });
+  double previous_ms = measure_ms([&] {
+    auto hint = at_previous.end();
+    for (int key : keys)
+      hint = at_previous.insert(hint, key);
+  });
+
+  size_t found = 0, finger_found = 0;
+  double find_ms = measure_ms([&] {
+    for (int key : keys)
+      found += plain.find(key) != plain.end();
+  });
+  double find_from_ms = measure_ms([&] {
+    auto finger = plain.end();
+    for (int key : keys) {
+      finger = plain.find_from(finger, key);
+      finger_found += finger != plain.end();
+    }
+  });
+
+  if (plain.size() != at_end.size() || plain.size() != at_previous.size() || found != finger_found) {
+    std::cerr << "results mismatch for " << stream << "\n";
+    std::exit(1);
+  }
+  std::cout << stream << "," << keys.size() << "," << plain_ms << "," << end_ms << "," << previous_ms << ","
+            << find_ms << "," << find_from_ms << "\n";
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+
+  std::vector<int> append(n), jitter(n);
+  std::mt19937 gen{42};
+  for (size_t i = 0; i < n; ++i) {
+    append[i] = static_cast<int>(i);
+    jitter[i] = static_cast<int>(i) * 4 + static_cast<int>(gen() % 256);
+  }
+
+  std::cout << "stream,keys,insert_ms,insert_end_hint_ms,insert_previous_hint_ms,find_ms,find_from_ms\n";
+  run("append", append);
+  run("jitter", jitter);
+
+  return 0;
+}
@@ -0,0 +1,62 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "tree_image.hpp"
+
+using SearchTrees::AVL_Tree;
+using SearchTrees::Mapped_Tree;
+
+// Cold start of a tree: rebuilding by an insert() loop, load() of a saved
+// image and opening it as Mapped_Tree, which also runs `queries` lookups.
+// Usage: bench_image [max_keys] [image_path]
+
+template <typename Func>
+static double measure_ms(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  size_t max_keys = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+  std::string path = (argc > 2) ? argv[2] : "bench_image.bin";
+  const size_t queries = 1000;
+
+  std::cout << "keys,insert_loop_ms,save_ms,load_ms,map_and_query_ms\n";
+  for (size_t n = 1'000'000; n <= max_keys; n *= 10) {
+    std::mt19937 gen{static_cast<unsigned>(n)};
+    std::uniform_int_distribution<int> dist{0, static_cast<int>(4 * n)};
+    std::vector<int> keys(n);
+    for (auto &key : keys)
+      key = dist(gen);
+
+    AVL_Tree<int> tree;
+    double insert_ms = measure_ms([&] {
+      for (int key : keys)
+        tree.insert(key);
+    });
+    double save_ms = measure_ms([&] { save(tree, path); });
+
+    size_t loaded = 0, found = 0;
+    double load_ms = measure_ms([&] { loaded = SearchTrees::load<AVL_Tree<int>>(path).size(); });
+    double map_ms = measure_ms([&] {
+      Mapped_Tree<int> mapped{path};
+      for (size_t i = 0; i < queries; ++i)
+        found += mapped.contains(keys[i]);
+    });
+
+    if (loaded != tree.size() || found != queries) {
+      std::cerr << "image mismatch for " << n << " keys\n";
+      return 1;
+    }
+    std::cout << n << "," << insert_ms << "," << save_ms << "," << load_ms << "," << map_ms << "\n";
+  }
+  std::remove(path.c_str());
+
+  return 0;
+}
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "concurrent_tree.hpp"
+#include "optimistic_tree.hpp"
+
+using SearchTrees::AVL_Tree;
+using SearchTrees::Concurrent_Tree;
+using SearchTrees::Optimistic_Tree;
+
+// Write throughput of Optimistic_Tree: writers on disjoint keys compared with
+// Concurrent_Tree, whose writers are serialized, and AVL_Tree behind std::mutex.
+// The stress test with invariant checks is test/optimistic_tree.cpp.
+// Usage: bench_optimistic [keys] [max_threads] [ms_per_case]
+
+// AVL_Tree behind std::mutex
+class Locked_Tree {
+  AVL_Tree<int> tree_;
+  std::mutex mutex_;
+
+public:
+  bool contains(int key) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return tree_.find(key) != tree_.end();
+  }
+  void insert(int key) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    tree_.insert(key);
+  }
+  void erase(int key) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    tree_.erase(key);
+  }
+};
+
+// Every thread inserts, erases and looks up its own keys, 40/40/20
+template <typename Tree>
+static double ops_per_sec(size_t n, unsigned threads, unsigned ms) {
+  Tree tree;
+  for (size_t i = 0; i < n; i += 2)
+    tree.insert(static_cast<int>(i));
+
+  std::atomic<bool> start{false}, stop{false};
+  std::atomic<size_t> ops{0};
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      std::mt19937 gen{t};
+      size_t stripes = std::max<size_t>(1, n / threads);
+      size_t local_ops = 0;
+      while (!start.load(std::memory_order_acquire))
+        std::this_thread::yield();
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 16; ++i) {
+          int key = static_cast<int>((gen() % stripes) * threads + t);
+          unsigned op = gen() % 5;
+          if (op < 2)
+            tree.insert(key);
+          else if (op < 4)
+            tree.erase(key);
+          else
+            tree.contains(key);
+        }
+        local_ops += 16;
+      }
+      ops += local_ops;
+    });
+  }
+
+  auto begin = std::chrono::steady_clock::now();
+  start.store(true, std::memory_order_release);
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  stop.store(true);
+  for (auto &worker : workers)
+    worker.join();
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  return ops.load() / sec;
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+  unsigned max_threads = (argc > 2) ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10))
+                                    : std::max(1u, std::thread::hardware_concurrency());
+  unsigned ms = (argc > 3) ? static_cast<unsigned>(std::strtoul(argv[3], nullptr, 10)) : 500;
+
+  std::cout << "container,threads,ops_per_sec\n";
+  for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+    std::cout << "optimistic," << threads << "," << ops_per_sec<Optimistic_Tree<int>>(n, threads, ms) << std::endl;
+    std::cout << "concurrent," << threads << "," << ops_per_sec<Concurrent_Tree<int>>(n, threads, ms) << std::endl;
+    std::cout << "mutex," << threads << "," << ops_per_sec<Locked_Tree>(n, threads, ms) << std::endl;
+  }
+
+  return 0;
+}
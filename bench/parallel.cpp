@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+#include "tree.hpp"
+
+using SearchTrees::AVL_Tree;
+using SearchTrees::Fork_Join_Pool;
+
+// Measures scaling of the parallel tree copy, balanced build from sorted keys
+// and union with the number of workers in Fork_Join_Pool.
+// Usage: bench_parallel [keys] [max_threads]
+
+template <typename Func>
+static double measure_ms(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 4'000'000;
+  unsigned max_threads = (argc > 2) ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10))
+                                    : std::max(1u, std::thread::hardware_concurrency());
+
+  std::vector<int> keys(n), other_keys(n);
+  for (size_t i = 0; i < n; ++i)
+    keys[i] = static_cast<int>(2 * i);
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<int> dist{0, static_cast<int>(4 * n)};
+  for (auto &key : other_keys)
+    key = dist(gen);
+  std::sort(other_keys.begin(), other_keys.end());
+  other_keys.erase(std::unique(other_keys.begin(), other_keys.end()), other_keys.end());
+
+  AVL_Tree<int> source{keys.begin(), keys.end()};
+  AVL_Tree<int> other{other_keys.begin(), other_keys.end()};
+
+  std::cout << "threads,copy_ms,build_ms,union_ms\n";
+  for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+    Fork_Join_Pool workers{threads};
+    size_t check = 0;
+
+    double copy_ms = measure_ms([&] {
+      AVL_Tree<int> copy{source, workers};
+      check += copy.size();
+    });
+    double build_ms = measure_ms([&] {
+      AVL_Tree<int> built{};
+      built.assign(keys.begin(), keys.end(), workers);
+      check += built.size();
+    });
+    AVL_Tree<int> lhs{source}, rhs{other};
+    double union_ms = measure_ms([&] {
+      lhs.union_with(std::move(rhs), workers);
+      check += lhs.size();
+    });
+
+    if (check < 2 * n) {
+      std::cerr << "unexpected tree sizes\n";
+      return 1;
+    }
+    std::cout << threads << "," << copy_ms << "," << build_ms << "," << union_ms << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,59 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "tree.hpp"
+
+using SearchTrees::AVL_Tree;
+
+// Expiry sweep: erases the oldest keys of a tree of `keys` random timestamps,
+// growing the swept interval tenfold each round. Compares erase(key) for every
+// key of the interval with one erase_range().
+// Usage: bench_range_erase [keys] [max_range]
+
+template <typename Func>
+static double measure_ms(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+  size_t max_range = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 1'000'000;
+
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<int> dist{0, static_cast<int>(4 * n)};
+  AVL_Tree<int> source;
+  for (size_t i = 0; i < n; ++i)
+    source.insert(dist(gen));
+
+  std::cout << "range,erase_loop_ms,erase_range_ms\n";
+  for (size_t k = 1'000; k <= max_range && k <= source.size(); k *= 10) {
+    // the interval [first key, k-th key) has exactly k keys
+    auto last = source.begin();
+    for (size_t i = 0; i < k && last != source.end(); ++i)
+      ++last;
+    int lo = *source.begin(), hi = (last != source.end()) ? *last : static_cast<int>(4 * n) + 1;
+
+    AVL_Tree<int> loop_tree{source}, range_tree{source};
+    std::vector<int> expired;
+    loop_tree.for_each_in_range(lo, hi, [&expired](int key) { expired.push_back(key); });
+    double erase_loop_ms = measure_ms([&] {
+      for (int key : expired)
+        loop_tree.erase(key);
+    });
+    size_t erased = 0;
+    double erase_range_ms = measure_ms([&] { erased = range_tree.erase_range(lo, hi); });
+
+    if (erased != expired.size() || loop_tree.size() != range_tree.size()) {
+      std::cerr << "size mismatch for range of " << k << " keys\n";
+      return 1;
+    }
+    std::cout << k << "," << erase_loop_ms << "," << erase_range_ms << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+#include "wavl_tree.hpp"
+
+using SearchTrees::AVL_Balance;
+using SearchTrees::Balanced_Tree;
+using SearchTrees::Tree_Stats;
+using SearchTrees::WAVL_Balance;
+
+// Compares AVL and weak AVL balancing in three phases: random inserts up to
+// `keys`, delete-heavy churn that erases a random present key and inserts a new
+// one, and erasing everything in random order. Built with SEARCHTREES_STATS,
+// so both trees pay for the counters. Double rotations count as 2 rotations,
+// retrace is the number of ancestors the rebalancing visited per operation.
+// Usage: bench_wavl [keys] [churn_ops]
+
+template <typename Func>
+static double measure_ms(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+static std::uint64_t rotations(const Tree_Stats &stats) {
+  return stats.rotate_left_ + stats.rotate_right_ + 2 * (stats.rotate_left_right_ + stats.rotate_right_left_);
+}
+
+static std::uint64_t retrace_steps(const Tree_Stats &stats) {
+  std::uint64_t steps = 0;
+  for (std::size_t i = 0; i < stats.retrace_length_.size(); ++i)
+    steps += i * stats.retrace_length_[i];
+  return steps;
+}
+
+template <typename Balance>
+static void run(const char *name, const std::vector<int> &keys, const std::vector<int> &churn) {
+  Balanced_Tree<int, Balance> tree;
+  Tree_Stats last;
+  auto print = [&](const char *phase, size_t ops, double ms) {
+    Tree_Stats stats = tree.stats();
+    std::cout << name << "," << phase << "," << ops << "," << ms * 1e6 / ops << ","
+              << static_cast<double>(rotations(stats) - rotations(last)) / ops << ","
+              << static_cast<double>(retrace_steps(stats) - retrace_steps(last)) / ops << "\n";
+    last = stats;
+  };
+
+  print("insert", keys.size(), measure_ms([&] {
+    for (int key : keys)
+      tree.insert(key);
+  }));
+
+  // every step erases a key inserted before and inserts a new one
+  std::vector<int> present(tree.begin(), tree.end());
+  std::mt19937 gen{7};
+  print("churn", 2 * churn.size(), measure_ms([&] {
+    for (int key : churn) {
+      size_t victim = gen() % present.size();
+      tree.erase(present[victim]);
+      present[victim] = key;
+      tree.insert(key);
+    }
+  }));
+
+  std::vector<int> remaining(tree.begin(), tree.end());
+  std::shuffle(remaining.begin(), remaining.end(), gen);
+  print("erase_all", remaining.size(), measure_ms([&] {
+    for (int key : remaining)
+      tree.erase(key);
+  }));
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+  size_t churn_ops = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 2'000'000;
+
+  std::mt19937 gen{42};
+  std::uniform_int_distribution<int> dist{0, std::numeric_limits<int>::max()};
+  std::vector<int> keys(n), churn(churn_ops);
+  for (auto &key : keys)
+    key = dist(gen);
+  for (auto &key : churn)
+    key = dist(gen);
+
+  std::cout << "balance,phase,ops,ns_per_op,rotations_per_op,retrace_per_op\n";
+  run<AVL_Balance>("avl", keys, churn);
+  run<WAVL_Balance>("wavl", keys, churn);
+
+  return 0;
+}
@@ -0,0 +1,417 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <cassert>
+
+#include "tree.hpp"
+
+namespace SearchTrees {
+
+// Keeps the entry as std::pair<const KeyT, MappedT> like std::map, so iterators
+// refer to a real value_type. Lookups read only the key, the mapped value is
+// constructed in place without a pair temporary.
+template <typename KeyT, typename MappedT, bool OrderStatistics = false>
+struct AVL_Map_Node final
+  : public Node_Links<AVL_Map_Node<KeyT, MappedT, OrderStatistics>>, public Subtree_Size<OrderStatistics>
+  , public Subtree_Aggregate<No_Aggregate> {
+  std::pair<const KeyT, MappedT> value_;
+  avl_height_t height_ = 1;
+
+  template <typename K, typename... Args>
+  AVL_Map_Node(std::piecewise_construct_t, K &&key, Args&&... args)
+    : value_(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+             std::forward_as_tuple(std::forward<Args>(args)...)) {}
+  AVL_Map_Node(const AVL_Map_Node &other) = delete;
+  AVL_Map_Node(AVL_Map_Node &&other) = delete;
+  AVL_Map_Node& operator= (const AVL_Map_Node &rhs) = delete;
+  AVL_Map_Node& operator= (AVL_Map_Node &&rhs) = delete;
+  ~AVL_Map_Node() = default;
+  template <typename Pool>
+  AVL_Map_Node *clone(Pool &pool) const {
+    AVL_Map_Node *copy = pool.create(std::piecewise_construct, value_.first, value_.second);
+    copy->height_ = height_;
+    if constexpr (OrderStatistics)
+      copy->size_ = this->size_;
+    return copy;
+  }
+};
+
+
+template <typename KeyT, typename MappedT, bool OrderStatistics>
+struct Node_Key<AVL_Map_Node<KeyT, MappedT, OrderStatistics>> {
+  static const KeyT &get(const AVL_Map_Node<KeyT, MappedT, OrderStatistics> *node) noexcept { return node->value_.first; }
+};
+
+
+// Iterator of AVL_Map. Steps like BST_Iterator, dereferencing gives the pair
+// stored in the node. The key is read-only, the value is writable through iterator.
+template <typename NodeT, bool IsConst>
+class Map_Iterator : public BST_Iterator<NodeT, IsConst> {
+  using base_iterator_t = BST_Iterator<NodeT, IsConst>;
+  using entry_t = decltype(NodeT::value_);
+
+public:
+  using value_type = typename std::remove_const<entry_t>::type;
+  using reference = typename std::conditional<IsConst, const entry_t &, entry_t &>::type;
+  using pointer = typename std::conditional<IsConst, const entry_t *, entry_t *>::type;
+
+private:
+  using key_t = typename value_type::first_type;
+  using mapped_t = typename std::conditional<IsConst, const typename value_type::second_type,
+                                             typename value_type::second_type>::type;
+
+public:
+  Map_Iterator() noexcept {}
+  using base_iterator_t::base_iterator_t;
+
+  const key_t &key() const noexcept { return this->node()->value_.first; }
+  mapped_t &value() const noexcept { return this->node()->value_.second; }
+
+  reference operator*() const noexcept { return this->node()->value_; }
+  pointer operator->() const noexcept { return &this->node()->value_; }
+
+  Map_Iterator& operator++ () noexcept {
+    base_iterator_t::operator++();
+    return *this;
+  }
+  Map_Iterator& operator-- () noexcept {
+    base_iterator_t::operator--();
+    return *this;
+  }
+  Map_Iterator operator++ (int) noexcept {
+    Map_Iterator tmp = *this;
+    ++*this;
+    return tmp;
+  }
+  Map_Iterator operator-- (int) noexcept {
+    Map_Iterator tmp = *this;
+    --*this;
+    return tmp;
+  }
+};
+
+template <typename KeyT, typename MappedT, bool OrderStatistics, bool IsConst>
+struct Node_Iterator<AVL_Map_Node<KeyT, MappedT, OrderStatistics>, IsConst> {
+  using type = Map_Iterator<AVL_Map_Node<KeyT, MappedT, OrderStatistics>, IsConst>;
+};
+
+
+// Node taken out of a map by extract(). The handle owns the node itself and
+// shares the slabs of the source pool, so the node stays valid after the source
+// map is cleared or destroyed. A map with an equal allocator links the node as it
+// is, other maps move its key and mapped value into a node of their own.
+// Memory of a node destroyed with the handle is freed together with the slabs.
+template <typename NodeT, typename Alloc>
+class Map_Node_Handle {
+  using entry_t = decltype(NodeT::value_);
+
+  NodeT *node_ = nullptr;
+  std::shared_ptr<void> slabs_; // keeps the memory of node_
+  std::optional<Alloc> alloc_;
+
+  template <typename, typename, typename, typename, bool> friend class AVL_Map;
+
+  Map_Node_Handle(NodeT *node, std::shared_ptr<void> slabs, const Alloc &alloc) noexcept
+    : node_(node), slabs_(std::move(slabs)), alloc_(alloc) {}
+
+  // Gives the node up, the memory stays alive only as long as the slabs
+  NodeT *release() noexcept {
+    NodeT *node = node_;
+    node_ = nullptr;
+    alloc_.reset();
+    return node;
+  }
+
+  void reset() noexcept {
+    if (node_)
+      node_->~NodeT();
+    node_ = nullptr;
+    slabs_.reset();
+    alloc_.reset();
+  }
+
+public:
+  using key_type = typename std::remove_const<typename entry_t::first_type>::type;
+  using mapped_type = typename entry_t::second_type;
+  using allocator_type = Alloc;
+
+  Map_Node_Handle() noexcept {}
+  Map_Node_Handle(Map_Node_Handle &&other) noexcept
+    : node_(other.node_), slabs_(std::move(other.slabs_)), alloc_(std::move(other.alloc_))
+  {
+    other.node_ = nullptr;
+    other.alloc_.reset();
+  }
+  Map_Node_Handle& operator= (Map_Node_Handle &&rhs) noexcept {
+    if (this == &rhs)
+      return *this;
+
+    reset();
+    node_ = rhs.node_;
+    slabs_ = std::move(rhs.slabs_);
+    alloc_ = std::move(rhs.alloc_);
+    rhs.node_ = nullptr;
+    rhs.alloc_.reset();
+    return *this;
+  }
+  Map_Node_Handle(const Map_Node_Handle &other) = delete;
+  Map_Node_Handle& operator= (const Map_Node_Handle &rhs) = delete;
+  ~Map_Node_Handle() {
+    reset();
+  }
+
+  bool empty() const noexcept { return !node_; }
+  explicit operator bool() const noexcept { return node_ != nullptr; }
+  allocator_type get_allocator() const {
+    assert(alloc_);
+    return *alloc_;
+  }
+
+  // The key may be changed before the handle is inserted, as with std::map node handles
+  key_type &key() const noexcept {
+    assert(node_);
+    return const_cast<key_type&>(node_->value_.first);
+  }
+  mapped_type &mapped() const noexcept {
+    assert(node_);
+    return node_->value_.second;
+  }
+};
+
+
+// Ordered map on the AVL core. Keeps the guarantees of AVL_Tree: no recursion,
+// and insertions and erases invalidate only iterators to erased elements.
+template <typename KeyT, typename MappedT, typename Compare = std::less<KeyT>,
+          typename Alloc = std::allocator<std::pair<const KeyT, MappedT>>, bool OrderStatistics = false>
+class AVL_Map final
+  : private AVL_Tree_Base<KeyT, AVL_Map_Node<KeyT, MappedT, OrderStatistics>, Compare, Alloc, OrderStatistics,
+                          AVL_Map<KeyT, MappedT, Compare, Alloc, OrderStatistics>> {
+  using node_t = AVL_Map_Node<KeyT, MappedT, OrderStatistics>;
+  using base_tree_t = AVL_Tree_Base<KeyT, node_t, Compare, Alloc, OrderStatistics, AVL_Map>;
+  using bst_base_t = BST_Tree_Base<KeyT, node_t, Compare, Alloc, AVL_Map>;
+  friend base_tree_t;
+  friend bst_base_t;
+
+  using map_iterator = node_t *;
+
+public:
+  using key_type = KeyT;
+  using mapped_type = MappedT;
+  using value_type = std::pair<const KeyT, MappedT>;
+  using typename base_tree_t::size_type;
+  using typename base_tree_t::difference_type;
+  using key_compare = Compare;
+  using allocator_type = Alloc;
+  using typename base_tree_t::iterator;
+  using typename base_tree_t::const_iterator;
+  using typename base_tree_t::reverse_iterator;
+  using typename base_tree_t::const_reverse_iterator;
+  using reference = typename iterator::reference;
+  using const_reference = typename const_iterator::reference;
+  using node_type = Map_Node_Handle<node_t, Alloc>;
+
+  struct insert_return_type {
+    iterator position;
+    bool inserted;
+    node_type node;
+  };
+
+public: // ctors & dtors
+  AVL_Map() : base_tree_t{} {}
+  explicit AVL_Map(const Compare &comp, const Alloc &alloc = Alloc{}) : base_tree_t{comp, alloc} {}
+  explicit AVL_Map(const Alloc &alloc) : base_tree_t{Compare{}, alloc} {}
+  // Takes pairs of key and mapped value, the first one of equivalent keys wins
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  AVL_Map(InputIt first, InputIt last, const Compare &comp = Compare{}, const Alloc &alloc = Alloc{})
+    : base_tree_t{comp, alloc}
+  {
+    for (; first != last; ++first) {
+      auto &&entry = *first;
+      try_emplace(entry.first, entry.second);
+    }
+  }
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  AVL_Map(InputIt first, InputIt last, const Alloc &alloc) : AVL_Map(first, last, Compare{}, alloc) {}
+  AVL_Map(const AVL_Map &other) : base_tree_t{other} {}
+  AVL_Map(const AVL_Map &other, Fork_Join_Pool &workers) : base_tree_t{other, workers} {}
+  AVL_Map(AVL_Map &&other) noexcept : base_tree_t{std::move(other)} {}
+  AVL_Map& operator= (const AVL_Map &rhs) {
+    if (this == &rhs)
+      return *this;
+
+    AVL_Map tmp(rhs);
+    swap(tmp);
+    return *this;
+  }
+  AVL_Map& operator= (AVL_Map &&rhs) noexcept {
+    if (this == &rhs)
+      return *this;
+
+    swap(rhs);
+    return *this;
+  }
+
+  void swap(AVL_Map &other) noexcept { base_tree_t::swap(other); }
+
+public: // iterators
+  using base_tree_t::begin;
+  using base_tree_t::end;
+  using base_tree_t::cbegin;
+  using base_tree_t::cend;
+  using base_tree_t::rbegin;
+  using base_tree_t::rend;
+
+public: // selectors
+  using base_tree_t::get_allocator;
+  using base_tree_t::key_comp;
+  using base_tree_t::empty;
+  using base_tree_t::size;
+  using base_tree_t::stats;
+  using base_tree_t::contains;
+  using base_tree_t::find;
+  using base_tree_t::lower_bound;
+  using base_tree_t::upper_bound;
+  using base_tree_t::lower_bound_batch;
+  using base_tree_t::find_batch;
+  using base_tree_t::contains_batch;
+  using base_tree_t::dump;
+
+  MappedT &at(const KeyT &key) & {
+    map_iterator node = this->find_node(key);
+    if (!node)
+      throw std::out_of_range("AVL_Map::at: no such key");
+    return node->value_.second;
+  }
+  const MappedT &at(const KeyT &key) const & {
+    const node_t *node = this->find_node(key);
+    if (!node)
+      throw std::out_of_range("AVL_Map::at: no such key");
+    return node->value_.second;
+  }
+
+public: // order statistics
+  using base_tree_t::rank;
+  using base_tree_t::select;
+  using base_tree_t::count_range;
+
+public: // modifiers
+  using base_tree_t::clear;
+  using base_tree_t::erase;
+
+  // Constructs the mapped value from `args` only if `key` is absent,
+  // otherwise neither the key nor the arguments are touched.
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const KeyT &key, Args&&... args) & {
+    return emplace_unique(key, std::forward<Args>(args)...);
+  }
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(KeyT &&key, Args&&... args) & {
+    return emplace_unique(std::move(key), std::forward<Args>(args)...);
+  }
+
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const KeyT &key, M &&obj) & {
+    return assign_unique(key, std::forward<M>(obj));
+  }
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(KeyT &&key, M &&obj) & {
+    return assign_unique(std::move(key), std::forward<M>(obj));
+  }
+
+  std::pair<iterator, bool> insert(const value_type &value) & {
+    return emplace_unique(value.first, value.second);
+  }
+  std::pair<iterator, bool> insert(value_type &&value) & {
+    return emplace_unique(value.first, std::move(value.second));
+  }
+
+  // Value-initializes the mapped value of an absent key
+  MappedT &operator[] (const KeyT &key) & {
+    return try_emplace(key).first.value();
+  }
+  MappedT &operator[] (KeyT &&key) & {
+    return try_emplace(std::move(key)).first.value();
+  }
+
+  // Unlinks the element, the handle takes over its node
+  node_type extract(const_iterator pos) & {
+    assert(pos != end());
+    map_iterator node = const_cast<map_iterator>(pos.node());
+    Alloc alloc = get_allocator();
+    std::shared_ptr<void> slabs = this->pool_.share_slabs();
+    this->extract_node(node);
+    return node_type{node, std::move(slabs), alloc};
+  }
+  node_type extract(const KeyT &key) & {
+    map_iterator node = this->find_node(key);
+    if (!node)
+      return node_type{};
+    return extract(this->make_iterator(node));
+  }
+
+  // Inserts the node of `handle` if its key is absent, otherwise the handle
+  // is returned back in `node`. The node is linked without reallocation if
+  // the allocators compare equal.
+  insert_return_type insert(node_type &&handle) & {
+    if (handle.empty())
+      return insert_return_type{end(), false, node_type{}};
+
+    map_iterator parent = nullptr;
+    map_iterator *link = this->find_link(handle.key(), parent);
+    if (*link)
+      return insert_return_type{this->make_iterator(*link), false, std::move(handle)};
+
+    map_iterator node = nullptr;
+    if (*handle.alloc_ == get_allocator()) {
+      this->pool_.adopt_slabs(handle.slabs_);
+      node = handle.release();
+      node->parent_ = node->left_ = node->right_ = nullptr;
+      node->height_ = 1;
+      if constexpr (OrderStatistics)
+        node->size_ = 1;
+    } else {
+      node = this->pool_.create(std::piecewise_construct, std::move(handle.key()), std::move(handle.mapped()));
+      handle.reset();
+    }
+    return insert_return_type{this->make_iterator(this->attach_node(parent, link, node)), true, node_type{}};
+  }
+
+public: // set operations by keys, mapped values of *this win
+  using base_tree_t::union_with;
+  using base_tree_t::intersect_with;
+  using base_tree_t::difference_with;
+  using base_tree_t::merge;
+
+private:
+  template <typename K, typename... Args>
+  std::pair<iterator, bool> emplace_unique(K &&key, Args&&... args) {
+    map_iterator parent = nullptr;
+    map_iterator *link = this->find_link(key, parent);
+    if (*link)
+      return {this->make_iterator(*link), false};
+
+    map_iterator node = this->pool_.create(std::piecewise_construct, std::forward<K>(key), std::forward<Args>(args)...);
+    return {this->make_iterator(this->attach_node(parent, link, node)), true};
+  }
+
+  template <typename K, typename M>
+  std::pair<iterator, bool> assign_unique(K &&key, M &&obj) {
+    map_iterator parent = nullptr;
+    map_iterator *link = this->find_link(key, parent);
+    if (*link) {
+      (*link)->value_.second = std::forward<M>(obj);
+      return {this->make_iterator(*link), false};
+    }
+
+    map_iterator node = this->pool_.create(std::piecewise_construct, std::forward<K>(key), std::forward<M>(obj));
+    return {this->make_iterator(this->attach_node(parent, link, node)), true};
+  }
+};
+
+} // SearchTrees
@@ -0,0 +1,811 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SEARCHTREES_SIMD_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SEARCHTREES_SIMD_SSE2 1
+#endif
+
+#include "node_pool.hpp"
+#include "tree.hpp"
+
+namespace SearchTrees {
+
+// Search inside one node of sorted keys. rank() returns the number of keys
+// less than `key`, or not greater than `key` if Inclusive. A binary search
+// narrows the keys down to LINEAR_KEYS, which are then counted without branches:
+// integers ordered by std::less are compared by whole SIMD registers (32-bit
+// keys with SSE2, 32 and 64-bit keys with AVX2), other keys one by one.
+template <typename KeyT, typename Compare>
+class Node_Search {
+  static constexpr bool BY_LESS =
+    std::is_same<Compare, std::less<KeyT>>::value || std::is_same<Compare, std::less<>>::value;
+  static constexpr bool SIMD_INTEGER = std::is_integral<KeyT>::value && !std::is_same<KeyT, bool>::value;
+
+public:
+#if defined(SEARCHTREES_SIMD_AVX2)
+  static constexpr bool SIMD = BY_LESS && SIMD_INTEGER && (sizeof(KeyT) == 4 || sizeof(KeyT) == 8);
+#elif defined(SEARCHTREES_SIMD_SSE2)
+  static constexpr bool SIMD = BY_LESS && SIMD_INTEGER && sizeof(KeyT) == 4;
+#else
+  static constexpr bool SIMD = false;
+#endif
+  static constexpr std::size_t LINEAR_KEYS = SIMD ? 256 / sizeof(KeyT) : 8;
+
+  template <bool Inclusive, typename K>
+  static std::size_t rank(const KeyT *keys, std::size_t n, const K &key, const Compare &comp) {
+    std::size_t first = 0;
+    while (n > LINEAR_KEYS) {
+      std::size_t half = n / 2;
+      bool counted = Inclusive ? !comp(key, keys[first + half]) : comp(keys[first + half], key);
+      first = counted ? first + half + 1 : first;
+      n = counted ? n - half - 1 : half;
+    }
+
+    if constexpr (SIMD && std::is_same<K, KeyT>::value)
+      return first + simd_rank<Inclusive>(keys + first, n, key);
+    std::size_t rank = 0;
+    for (std::size_t i = 0; i < n; ++i)
+      rank += static_cast<std::size_t>(Inclusive ? !comp(key, keys[first + i]) : comp(keys[first + i], key));
+    return first + rank;
+  }
+
+private:
+  // Unsigned keys are compared as signed ones with the sign bit flipped
+  template <bool Inclusive>
+  static std::size_t simd_rank(const KeyT *keys, std::size_t n, KeyT key) noexcept {
+    std::size_t rank = 0, i = 0;
+#if defined(SEARCHTREES_SIMD_AVX2)
+    if constexpr (sizeof(KeyT) == 4) {
+      const __m256i bias = _mm256_set1_epi32(std::is_signed<KeyT>::value ? 0 : INT32_MIN);
+      const __m256i needle = _mm256_xor_si256(_mm256_set1_epi32(static_cast<std::int32_t>(key)), bias);
+      for (; i + 8 <= n; i += 8) {
+        __m256i block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bias);
+        __m256i mask = Inclusive ? _mm256_cmpgt_epi32(block, needle) : _mm256_cmpgt_epi32(needle, block);
+        std::size_t bits = static_cast<std::size_t>(__builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(mask))));
+        rank += Inclusive ? 8 - bits : bits;
+      }
+    } else {
+      const __m256i bias = _mm256_set1_epi64x(std::is_signed<KeyT>::value ? 0 : INT64_MIN);
+      const __m256i needle = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<std::int64_t>(key)), bias);
+      for (; i + 4 <= n; i += 4) {
+        __m256i block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bias);
+        __m256i mask = Inclusive ? _mm256_cmpgt_epi64(block, needle) : _mm256_cmpgt_epi64(needle, block);
+        std::size_t bits = static_cast<std::size_t>(__builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(mask))));
+        rank += Inclusive ? 4 - bits : bits;
+      }
+    }
+#elif defined(SEARCHTREES_SIMD_SSE2)
+    const __m128i bias = _mm_set1_epi32(std::is_signed<KeyT>::value ? 0 : INT32_MIN);
+    const __m128i needle = _mm_xor_si128(_mm_set1_epi32(static_cast<std::int32_t>(key)), bias);
+    for (; i + 4 <= n; i += 4) {
+      __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), bias);
+      __m128i mask = Inclusive ? _mm_cmpgt_epi32(block, needle) : _mm_cmpgt_epi32(needle, block);
+      std::size_t bits = static_cast<std::size_t>(__builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(mask))));
+      rank += Inclusive ? 4 - bits : bits;
+    }
+#endif
+    for (; i < n; ++i)
+      rank += static_cast<std::size_t>(Inclusive ? !(key < keys[i]) : keys[i] < key);
+    return rank;
+  }
+};
+
+
+// Nodes of B+-trees, whether a node is a leaf is known from its level
+struct BPlus_Node_Base {
+  std::uint32_t count_ = 0; // number of keys
+};
+
+template <typename KeyT, std::size_t Capacity>
+struct alignas(64) BPlus_Leaf final : public BPlus_Node_Base {
+  BPlus_Leaf *prev_ = nullptr;
+  BPlus_Leaf *next_ = nullptr;
+  KeyT keys_[Capacity];
+};
+
+// Keys under children_[i] are less than keys_[i], keys under children_[i + 1] are not
+template <typename KeyT, std::size_t Capacity>
+struct alignas(64) BPlus_Inner final : public BPlus_Node_Base {
+  KeyT keys_[Capacity];
+  BPlus_Node_Base *children_[Capacity + 1];
+};
+
+
+// B+-tree of unique keys with the lookup and modifier interface of AVL_Tree.
+// Nodes take about NodeBytes and start at a cache line, so one node holds tens
+// of keys and the tree is several times shallower than a binary one: a descent
+// costs a few cache misses and a SIMD search inside each node. Keys are stored
+// in the leaves only, the leaves are linked for iteration.
+// Keys must be default constructible, they are moved inside nodes by insert()
+// and erase(), which invalidates all iterators.
+template <typename KeyT, typename Compare = std::less<KeyT>, typename Alloc = std::allocator<KeyT>,
+          std::size_t NodeBytes = 256>
+class BPlus_Tree {
+  static_assert(NodeBytes >= 64 && NodeBytes % 64 == 0, "nodes are made of whole cache lines");
+
+public:
+  using key_type = KeyT;
+  using value_type = KeyT;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = const KeyT &;
+  using const_reference = const KeyT &;
+
+  // Header of a leaf is the key count and two links, of an inner node the key count
+  static constexpr size_type LEAF_CAPACITY =
+    std::max<size_type>(3, (NodeBytes - 3 * sizeof(void*)) / sizeof(KeyT));
+  static constexpr size_type INNER_CAPACITY =
+    std::max<size_type>(3, (NodeBytes - 2 * sizeof(void*)) / (sizeof(KeyT) + sizeof(void*)));
+  static constexpr size_type MIN_LEAF_KEYS = LEAF_CAPACITY / 2;
+  static constexpr size_type MIN_INNER_KEYS = INNER_CAPACITY / 2;
+  // Inner nodes have at least 2 children, so a tree of size_type keys is never deeper
+  static constexpr size_type MAX_HEIGHT = 8 * sizeof(size_type);
+
+private:
+  using node_base_t = BPlus_Node_Base;
+  using leaf_t = BPlus_Leaf<KeyT, LEAF_CAPACITY>;
+  using inner_t = BPlus_Inner<KeyT, INNER_CAPACITY>;
+  using search_t = Node_Search<KeyT, Compare>;
+
+  node_base_t *root_ = nullptr;
+  leaf_t *head_ = nullptr;
+  leaf_t *tail_ = nullptr;
+  size_type size_ = 0;
+  size_type height_ = 0; // levels, leaves included
+  size_type leaves_ = 0;
+  size_type inners_ = 0;
+  Node_Pool<leaf_t, Alloc> leaf_pool_;
+  Node_Pool<inner_t, Alloc> inner_pool_;
+  Compare comp_;
+
+  // Inner nodes passed by a descent and the indices of the children taken
+  struct path_t {
+    inner_t *nodes_[MAX_HEIGHT];
+    size_type slots_[MAX_HEIGHT];
+    size_type depth_ = 0;
+  };
+
+public:
+  // Position of a key in a leaf, end() has no leaf.
+  // Refers to the tail link of the tree, so it doesn't survive moves of the tree.
+  class const_iterator {
+    const leaf_t *leaf_ = nullptr;
+    size_type index_ = 0;
+    leaf_t *const *tail_link_ = nullptr;
+
+    friend class BPlus_Tree;
+    const_iterator(const leaf_t *leaf, size_type index, leaf_t *const *tail_link) noexcept
+      : leaf_(leaf), index_(index), tail_link_(tail_link) {}
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = KeyT;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const KeyT *;
+    using reference = const KeyT &;
+
+    const_iterator() noexcept {}
+
+    reference operator*() const noexcept { return leaf_->keys_[index_]; }
+    pointer operator->() const noexcept { return leaf_->keys_ + index_; }
+
+    const_iterator& operator++ () noexcept {
+      assert(leaf_);
+      if (++index_ == leaf_->count_) {
+        leaf_ = leaf_->next_;
+        index_ = 0;
+      }
+      return *this;
+    }
+    const_iterator& operator-- () noexcept {
+      if (!leaf_) { // end()
+        assert(tail_link_ && *tail_link_);
+        leaf_ = *tail_link_;
+        index_ = leaf_->count_;
+      } else if (index_ == 0) {
+        leaf_ = leaf_->prev_;
+        assert(leaf_); // decrement of begin()
+        index_ = leaf_->count_;
+      }
+      --index_;
+      return *this;
+    }
+    const_iterator operator++ (int) noexcept {
+      const_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+    const_iterator operator-- (int) noexcept {
+      const_iterator tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    bool operator== (const const_iterator &rhs) const noexcept { return leaf_ == rhs.leaf_ && index_ == rhs.index_; }
+    bool operator!= (const const_iterator &rhs) const noexcept { return !(*this == rhs); }
+  };
+  using iterator = const_iterator;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using reverse_iterator = const_reverse_iterator;
+
+private: // lookup
+  const_iterator make_iterator(const leaf_t *leaf, size_type index) const noexcept {
+    return const_iterator{leaf, index, &tail_};
+  }
+
+  // Position `index` of `leaf` may be one past its last key
+  const_iterator normalized(const leaf_t *leaf, size_type index) const noexcept {
+    if (index == leaf->count_)
+      return make_iterator(leaf->next_, 0);
+    return make_iterator(leaf, index);
+  }
+
+  static void prefetch_node(const void *node) noexcept {
+    // the first line is being loaded already, neighbouring lines are likely to be searched
+    for (size_type offset = 64; offset < std::min<size_type>(NodeBytes, 256); offset += 64)
+      prefetch(static_cast<const char*>(node) + offset);
+  }
+
+  // Descends to the leaf that holds `key` if it's present, records the path if it's given.
+  template <typename K>
+  leaf_t *descend(const K &key, path_t *path) const {
+    assert(root_);
+    node_base_t *node = root_;
+    for (size_type level = 1; level < height_; ++level) {
+      auto inner = static_cast<inner_t*>(node);
+      prefetch_node(inner);
+      size_type slot = search_t::template rank<true>(inner->keys_, inner->count_, key, comp_);
+      if (path) {
+        path->nodes_[path->depth_] = inner;
+        path->slots_[path->depth_++] = slot;
+      }
+      node = inner->children_[slot];
+    }
+    prefetch_node(node);
+    return static_cast<leaf_t*>(node);
+  }
+
+  template <typename K>
+  const_iterator lower_bound_impl(const K &key) const {
+    if (!root_)
+      return end();
+    const leaf_t *leaf = descend(key, nullptr);
+    return normalized(leaf, search_t::template rank<false>(leaf->keys_, leaf->count_, key, comp_));
+  }
+
+  template <typename K>
+  const_iterator upper_bound_impl(const K &key) const {
+    if (!root_)
+      return end();
+    const leaf_t *leaf = descend(key, nullptr);
+    return normalized(leaf, search_t::template rank<true>(leaf->keys_, leaf->count_, key, comp_));
+  }
+
+  template <typename K>
+  const_iterator find_impl(const K &key) const {
+    if (!root_)
+      return end();
+    const leaf_t *leaf = descend(key, nullptr);
+    size_type index = search_t::template rank<false>(leaf->keys_, leaf->count_, key, comp_);
+    if (index == leaf->count_ || comp_(key, leaf->keys_[index]))
+      return end();
+    return make_iterator(leaf, index);
+  }
+
+private: // node helpers
+  leaf_t *create_leaf() {
+    leaf_t *leaf = leaf_pool_.create();
+    ++leaves_;
+    return leaf;
+  }
+
+  inner_t *create_inner() {
+    inner_t *inner = inner_pool_.create();
+    ++inners_;
+    return inner;
+  }
+
+  void destroy_leaf(leaf_t *leaf) noexcept {
+    leaf_pool_.destroy(leaf);
+    --leaves_;
+  }
+
+  void destroy_inner(inner_t *inner) noexcept {
+    inner_pool_.destroy(inner);
+    --inners_;
+  }
+
+  // Links `right` after `left` in the list of leaves
+  void link_leaf(leaf_t *left, leaf_t *right) noexcept {
+    right->prev_ = left;
+    right->next_ = left->next_;
+    if (left->next_)
+      left->next_->prev_ = right;
+    else
+      tail_ = right;
+    left->next_ = right;
+  }
+
+  void unlink_leaf(leaf_t *leaf) noexcept {
+    (leaf->prev_ ? leaf->prev_->next_ : head_) = leaf->next_;
+    (leaf->next_ ? leaf->next_->prev_ : tail_) = leaf->prev_;
+  }
+
+  // Opens a gap at `pos` in array[0, count)
+  template <typename T>
+  static void shift_right(T *array, size_type count, size_type pos) {
+    std::move_backward(array + pos, array + count, array + count + 1);
+  }
+
+  // Closes the gap at `pos` in array[0, count)
+  template <typename T>
+  static void shift_left(T *array, size_type count, size_type pos) {
+    std::move(array + pos + 1, array + count, array + pos);
+  }
+
+private: // insertion
+  // Nodes needed to split the path are reserved before anything is changed,
+  // so a failed allocation leaves the tree intact
+  void reserve_splits(const leaf_t *leaf, const path_t &path) {
+    if (leaf->count_ < LEAF_CAPACITY)
+      return;
+    size_type splits = 0;
+    while (splits < path.depth_ && path.nodes_[path.depth_ - 1 - splits]->count_ == INNER_CAPACITY)
+      ++splits;
+    leaf_pool_.reserve(1);
+    inner_pool_.reserve(splits + (splits == path.depth_ ? 1 : 0));
+  }
+
+  template <typename K>
+  const_iterator insert_key(K &&key) {
+    if (!root_) {
+      leaf_t *leaf = create_leaf();
+      leaf->keys_[0] = std::forward<K>(key);
+      leaf->count_ = 1;
+      root_ = head_ = tail_ = leaf;
+      height_ = 1;
+      size_ = 1;
+      return make_iterator(leaf, 0);
+    }
+
+    path_t path;
+    leaf_t *leaf = descend(key, &path);
+    size_type pos = search_t::template rank<false>(leaf->keys_, leaf->count_, key, comp_);
+    if (pos < leaf->count_ && !comp_(key, leaf->keys_[pos]))
+      return make_iterator(leaf, pos);
+
+    reserve_splits(leaf, path);
+    ++size_;
+    if (leaf->count_ < LEAF_CAPACITY) {
+      shift_right(leaf->keys_, leaf->count_, pos);
+      leaf->keys_[pos] = std::forward<K>(key);
+      ++leaf->count_;
+      return make_iterator(leaf, pos);
+    }
+
+    // LEAF_CAPACITY + 1 keys are divided between the leaf and its new right sibling
+    leaf_t *right = create_leaf();
+    link_leaf(leaf, right);
+    size_type left_count = LEAF_CAPACITY + 1 - (LEAF_CAPACITY + 1) / 2;
+    const_iterator result;
+    if (pos < left_count) {
+      std::move(leaf->keys_ + (left_count - 1), leaf->keys_ + LEAF_CAPACITY, right->keys_);
+      right->count_ = static_cast<std::uint32_t>(LEAF_CAPACITY - left_count + 1);
+      shift_right(leaf->keys_, left_count - 1, pos);
+      leaf->keys_[pos] = std::forward<K>(key);
+      result = make_iterator(leaf, pos);
+    } else {
+      std::move(leaf->keys_ + left_count, leaf->keys_ + LEAF_CAPACITY, right->keys_);
+      size_type right_pos = pos - left_count;
+      shift_right(right->keys_, LEAF_CAPACITY - left_count, right_pos);
+      right->keys_[right_pos] = std::forward<K>(key);
+      right->count_ = static_cast<std::uint32_t>(LEAF_CAPACITY - left_count + 1);
+      result = make_iterator(right, right_pos);
+    }
+    leaf->count_ = static_cast<std::uint32_t>(left_count);
+
+    insert_child(path, KeyT(right->keys_[0]), right);
+    return result;
+  }
+
+  // Hangs `child` with the smallest key `separator` right after the child the
+  // path went to at its last node, splitting full nodes on the way up
+  void insert_child(path_t &path, KeyT separator, node_base_t *child) {
+    while (path.depth_ > 0) {
+      --path.depth_;
+      inner_t *node = path.nodes_[path.depth_];
+      size_type slot = path.slots_[path.depth_];
+      if (node->count_ < INNER_CAPACITY) {
+        shift_right(node->keys_, node->count_, slot);
+        shift_right(node->children_, node->count_ + 1, slot + 1);
+        node->keys_[slot] = std::move(separator);
+        node->children_[slot + 1] = child;
+        ++node->count_;
+        return;
+      }
+
+      // the middle of INNER_CAPACITY + 1 keys goes up, the keys after it move to a new sibling
+      KeyT keys[INNER_CAPACITY + 1];
+      node_base_t *children[INNER_CAPACITY + 2];
+      std::move(node->keys_, node->keys_ + slot, keys);
+      keys[slot] = std::move(separator);
+      std::move(node->keys_ + slot, node->keys_ + INNER_CAPACITY, keys + slot + 1);
+      std::copy(node->children_, node->children_ + slot + 1, children);
+      children[slot + 1] = child;
+      std::copy(node->children_ + slot + 1, node->children_ + INNER_CAPACITY + 1, children + slot + 2);
+
+      size_type middle = (INNER_CAPACITY + 1) / 2;
+      inner_t *right = create_inner();
+      std::move(keys, keys + middle, node->keys_);
+      std::copy(children, children + middle + 1, node->children_);
+      node->count_ = static_cast<std::uint32_t>(middle);
+      std::move(keys + middle + 1, keys + INNER_CAPACITY + 1, right->keys_);
+      std::copy(children + middle + 1, children + INNER_CAPACITY + 2, right->children_);
+      right->count_ = static_cast<std::uint32_t>(INNER_CAPACITY - middle);
+
+      separator = std::move(keys[middle]);
+      child = right;
+    }
+
+    inner_t *root = create_inner();
+    root->keys_[0] = std::move(separator);
+    root->children_[0] = root_;
+    root->children_[1] = child;
+    root->count_ = 1;
+    root_ = root;
+    ++height_;
+  }
+
+private: // erasure
+  // Refills the leaf that fell below MIN_LEAF_KEYS from a sibling under the same
+  // parent or merges it with one, then fixes the inner nodes on the way up
+  void rebalance_leaf(leaf_t *leaf, path_t &path) noexcept {
+    if (path.depth_ == 0) { // the root
+      if (leaf->count_ == 0) {
+        destroy_leaf(leaf);
+        root_ = head_ = tail_ = nullptr;
+        height_ = 0;
+      }
+      return;
+    }
+    if (leaf->count_ >= MIN_LEAF_KEYS)
+      return;
+
+    inner_t *parent = path.nodes_[path.depth_ - 1];
+    size_type slot = path.slots_[path.depth_ - 1];
+    leaf_t *left = (slot > 0) ? static_cast<leaf_t*>(parent->children_[slot - 1]) : nullptr;
+    leaf_t *right = (slot < parent->count_) ? static_cast<leaf_t*>(parent->children_[slot + 1]) : nullptr;
+
+    if (left && left->count_ > MIN_LEAF_KEYS) {
+      shift_right(leaf->keys_, leaf->count_, 0);
+      leaf->keys_[0] = std::move(left->keys_[--left->count_]);
+      ++leaf->count_;
+      parent->keys_[slot - 1] = leaf->keys_[0];
+      return;
+    }
+    if (right && right->count_ > MIN_LEAF_KEYS) {
+      leaf->keys_[leaf->count_++] = std::move(right->keys_[0]);
+      shift_left(right->keys_, right->count_--, 0);
+      parent->keys_[slot] = right->keys_[0];
+      return;
+    }
+
+    // the right one of the pair is merged into the left one
+    if (left) {
+      --slot;
+      right = leaf;
+    } else {
+      left = leaf;
+    }
+    std::move(right->keys_, right->keys_ + right->count_, left->keys_ + left->count_);
+    left->count_ += right->count_;
+    unlink_leaf(right);
+    destroy_leaf(right);
+    erase_child(path, slot);
+  }
+
+  // Removes keys_[slot] and children_[slot + 1] from the last node of the path
+  void erase_child(path_t &path, size_type slot) noexcept {
+    while (true) {
+      inner_t *node = path.nodes_[--path.depth_];
+      shift_left(node->keys_, node->count_, slot);
+      shift_left(node->children_, node->count_ + 1, slot + 1);
+      --node->count_;
+
+      if (path.depth_ == 0) { // the root
+        if (node->count_ == 0) {
+          root_ = node->children_[0];
+          destroy_inner(node);
+          --height_;
+        }
+        return;
+      }
+      if (node->count_ >= MIN_INNER_KEYS)
+        return;
+
+      inner_t *parent = path.nodes_[path.depth_ - 1];
+      slot = path.slots_[path.depth_ - 1];
+      inner_t *left = (slot > 0) ? static_cast<inner_t*>(parent->children_[slot - 1]) : nullptr;
+      inner_t *right = (slot < parent->count_) ? static_cast<inner_t*>(parent->children_[slot + 1]) : nullptr;
+
+      // borrowing rotates a key through the parent
+      if (left && left->count_ > MIN_INNER_KEYS) {
+        shift_right(node->keys_, node->count_, 0);
+        shift_right(node->children_, node->count_ + 1, 0);
+        node->keys_[0] = std::move(parent->keys_[slot - 1]);
+        node->children_[0] = left->children_[left->count_];
+        parent->keys_[slot - 1] = std::move(left->keys_[left->count_ - 1]);
+        --left->count_;
+        ++node->count_;
+        return;
+      }
+      if (right && right->count_ > MIN_INNER_KEYS) {
+        node->keys_[node->count_] = std::move(parent->keys_[slot]);
+        node->children_[node->count_ + 1] = right->children_[0];
+        ++node->count_;
+        parent->keys_[slot] = std::move(right->keys_[0]);
+        shift_left(right->keys_, right->count_, 0);
+        shift_left(right->children_, right->count_ + 1, 0);
+        --right->count_;
+        return;
+      }
+
+      // merging pulls the separator down between the keys of the pair
+      if (left) {
+        --slot;
+        right = node;
+      } else {
+        left = node;
+      }
+      left->keys_[left->count_] = std::move(parent->keys_[slot]);
+      std::move(right->keys_, right->keys_ + right->count_, left->keys_ + left->count_ + 1);
+      std::copy(right->children_, right->children_ + right->count_ + 1, left->children_ + left->count_ + 1);
+      left->count_ += right->count_ + 1;
+      destroy_inner(right);
+    }
+  }
+
+private: // construction
+  // Fills the tree from n strictly increasing keys level by level in linear time,
+  // keys are spread evenly over the fewest nodes that can hold them
+  template <typename InputIt>
+  void build_sorted(InputIt first, size_type n) {
+    if (n == 0)
+      return;
+
+    std::vector<node_base_t*> level;
+    std::vector<KeyT> lows; // smallest key under each node of the level
+    size_type leaves = (n + LEAF_CAPACITY - 1) / LEAF_CAPACITY;
+    level.reserve(leaves);
+    lows.reserve(leaves);
+    for (size_type i = 0; i < leaves; ++i) {
+      leaf_t *leaf = create_leaf();
+      if (tail_)
+        link_leaf(tail_, leaf);
+      else
+        head_ = tail_ = leaf;
+      size_type count = n / leaves + (i < n % leaves ? 1 : 0);
+      for (size_type k = 0; k < count; ++k, ++first)
+        leaf->keys_[k] = *first;
+      leaf->count_ = static_cast<std::uint32_t>(count);
+      level.push_back(leaf);
+      lows.push_back(leaf->keys_[0]);
+    }
+    root_ = level.front();
+    height_ = 1;
+    size_ = n;
+
+    while (level.size() > 1) {
+      size_type children = level.size();
+      size_type nodes = (children + INNER_CAPACITY) / (INNER_CAPACITY + 1);
+      size_type next = 0;
+      for (size_type i = 0; i < nodes; ++i) {
+        inner_t *inner = create_inner();
+        size_type count = children / nodes + (i < children % nodes ? 1 : 0);
+        size_type base = next;
+        for (size_type c = 0; c < count; ++c) {
+          inner->children_[c] = level[base + c];
+          if (c > 0)
+            inner->keys_[c - 1] = std::move(lows[base + c]);
+        }
+        inner->count_ = static_cast<std::uint32_t>(count - 1);
+        level[i] = inner;
+        lows[i] = std::move(lows[base]);
+        next += count;
+      }
+      level.resize(nodes);
+      lows.resize(nodes);
+      root_ = level.front();
+      ++height_;
+    }
+  }
+
+  // Destroys every inner node in one iterative pass and the leaves along their list
+  void destroy_nodes() noexcept {
+    if (height_ > 1) {
+      inner_t *stack[MAX_HEIGHT];
+      size_type next[MAX_HEIGHT];
+      int top = 0;
+      stack[0] = static_cast<inner_t*>(root_);
+      next[0] = 0;
+      while (top >= 0) {
+        inner_t *node = stack[top];
+        if (static_cast<size_type>(top) + 2 < height_ && next[top] <= node->count_) {
+          stack[top + 1] = static_cast<inner_t*>(node->children_[next[top]++]);
+          next[++top] = 0;
+        } else {
+          destroy_inner(node);
+          --top;
+        }
+      }
+    }
+    for (leaf_t *leaf = head_; leaf != nullptr;) {
+      leaf_t *next_leaf = leaf->next_;
+      destroy_leaf(leaf);
+      leaf = next_leaf;
+    }
+  }
+
+public: // ctors & dtors
+  BPlus_Tree() {}
+  explicit BPlus_Tree(const Compare &comp, const Alloc &alloc = Alloc{})
+    : leaf_pool_(alloc), inner_pool_(alloc), comp_(comp) {}
+  explicit BPlus_Tree(const Alloc &alloc) : BPlus_Tree(Compare{}, alloc) {}
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  BPlus_Tree(InputIt first, InputIt last, const Compare &comp = Compare{}, const Alloc &alloc = Alloc{})
+    : BPlus_Tree(comp, alloc)
+  {
+    assign(first, last);
+  }
+  BPlus_Tree(const BPlus_Tree &other)
+    : leaf_pool_(std::allocator_traits<Alloc>::select_on_container_copy_construction(other.get_allocator()))
+    , inner_pool_(std::allocator_traits<Alloc>::select_on_container_copy_construction(other.get_allocator()))
+    , comp_(other.comp_)
+  {
+    build_sorted(other.begin(), other.size());
+  }
+  BPlus_Tree(BPlus_Tree &&other) noexcept
+    : root_(other.root_), head_(other.head_), tail_(other.tail_), size_(other.size_), height_(other.height_)
+    , leaves_(other.leaves_), inners_(other.inners_)
+    , leaf_pool_(std::move(other.leaf_pool_)), inner_pool_(std::move(other.inner_pool_)), comp_(other.comp_)
+  {
+    other.root_ = other.head_ = other.tail_ = nullptr;
+    other.size_ = other.height_ = other.leaves_ = other.inners_ = 0;
+  }
+  ~BPlus_Tree() {
+    clear();
+  }
+  BPlus_Tree& operator= (const BPlus_Tree &rhs) {
+    if (this == &rhs)
+      return *this;
+
+    BPlus_Tree tmp(rhs);
+    swap(tmp);
+    return *this;
+  }
+  BPlus_Tree& operator= (BPlus_Tree &&rhs) noexcept {
+    if (this == &rhs)
+      return *this;
+
+    swap(rhs);
+    return *this;
+  }
+
+  void swap(BPlus_Tree &other) noexcept {
+    std::swap(root_, other.root_);
+    std::swap(head_, other.head_);
+    std::swap(tail_, other.tail_);
+    std::swap(size_, other.size_);
+    std::swap(height_, other.height_);
+    std::swap(leaves_, other.leaves_);
+    std::swap(inners_, other.inners_);
+    leaf_pool_.swap(other.leaf_pool_);
+    inner_pool_.swap(other.inner_pool_);
+    std::swap(comp_, other.comp_);
+  }
+
+public: // iterators
+  const_iterator begin() const noexcept { return make_iterator(head_, 0); }
+  const_iterator end() const noexcept { return make_iterator(nullptr, 0); }
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+  const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator{end()}; }
+  const_reverse_iterator rend() const noexcept { return const_reverse_iterator{begin()}; }
+
+public: // selectors
+  Alloc get_allocator() const { return leaf_pool_.get_allocator(); }
+  Compare key_comp() const { return comp_; }
+  Compare value_comp() const { return comp_; }
+  bool empty() const noexcept { return size_ == 0; }
+  size_type size() const noexcept { return size_; }
+  // Nodes on the way from the root to any key
+  size_type height() const noexcept { return height_; }
+  // Bytes taken by the nodes, free space in the pools is not counted
+  size_type memory_used() const noexcept { return leaves_ * sizeof(leaf_t) + inners_ * sizeof(inner_t); }
+
+  const_iterator find(const KeyT &key) const { return find_impl(key); }
+  const_iterator lower_bound(const KeyT &key) const { return lower_bound_impl(key); }
+  const_iterator upper_bound(const KeyT &key) const { return upper_bound_impl(key); }
+  bool contains(const KeyT &key) const { return find_impl(key) != end(); }
+
+  // Heterogeneous lookup, available only if Compare::is_transparent exists
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator find(const K &key) const { return find_impl(key); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator lower_bound(const K &key) const { return lower_bound_impl(key); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator upper_bound(const K &key) const { return upper_bound_impl(key); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  bool contains(const K &key) const { return find_impl(key) != end(); }
+
+public: // modifiers
+  void clear() noexcept {
+    if (!std::is_trivially_destructible<KeyT>::value)
+      destroy_nodes();
+    root_ = head_ = tail_ = nullptr;
+    size_ = height_ = leaves_ = inners_ = 0;
+    leaf_pool_.release();
+    inner_pool_.release();
+  }
+
+  // Returns iterator to the inserted key or to the equivalent key already present
+  iterator insert(const KeyT &key) { return insert_key(key); }
+  iterator insert(KeyT &&key) { return insert_key(std::move(key)); }
+
+  bool erase(const KeyT &key) {
+    if (!root_)
+      return false;
+
+    path_t path;
+    leaf_t *leaf = descend(key, &path);
+    size_type pos = search_t::template rank<false>(leaf->keys_, leaf->count_, key, comp_);
+    if (pos == leaf->count_ || comp_(key, leaf->keys_[pos]))
+      return false;
+
+    shift_left(leaf->keys_, leaf->count_, pos);
+    --leaf->count_;
+    --size_;
+    rebalance_leaf(leaf, path);
+    return true;
+  }
+
+  // Replaces the contents with keys from [first, last) in linear time if they
+  // are strictly increasing, otherwise the keys are sorted and deduplicated first.
+  template <typename InputIt>
+  void assign(InputIt first, InputIt last) {
+    using category_t = typename std::iterator_traits<InputIt>::iterator_category;
+    BPlus_Tree tmp{comp_, get_allocator()};
+
+    if constexpr (std::is_base_of<std::forward_iterator_tag, category_t>::value) {
+      InputIt unordered = std::adjacent_find(first, last, [this](const KeyT &lhs, const KeyT &rhs) { return !comp_(lhs, rhs); });
+      if (unordered == last) {
+        tmp.build_sorted(first, static_cast<size_type>(std::distance(first, last)));
+        swap(tmp);
+        return;
+      }
+    }
+
+    std::vector<KeyT> keys(first, last);
+    std::sort(keys.begin(), keys.end(), comp_);
+    auto keys_end = std::unique(keys.begin(), keys.end(), [this](const KeyT &lhs, const KeyT &rhs) { return !comp_(lhs, rhs); });
+    tmp.build_sorted(std::make_move_iterator(keys.begin()), static_cast<size_type>(keys_end - keys.begin()));
+    swap(tmp);
+  }
+};
+
+} // SearchTrees
@@ -0,0 +1,612 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace SearchTrees {
+
+// Node of Compact_AVL_Tree. Links are 32-bit indices into the node storage,
+// index 0 is the null link. An index takes the low 30 bits of a link, the top
+// 2 bits of the three links together hold the 6-bit AVL height: a tree of
+// fewer than 2^30 nodes is less than 44 levels high.
+template <typename KeyT>
+struct Compact_Node {
+  using index_t = std::uint32_t;
+  static constexpr unsigned INDEX_BITS = 30;
+  static constexpr index_t INDEX_MASK = (index_t{1} << INDEX_BITS) - 1;
+
+  KeyT key_{};
+  index_t parent_ = 0, left_ = 0, right_ = 0;
+
+  Compact_Node() = default;
+  explicit Compact_Node(const KeyT &key) : key_(key) {}
+  explicit Compact_Node(KeyT &&key) : key_(std::move(key)) {}
+
+  index_t parent() const noexcept { return parent_ & INDEX_MASK; }
+  index_t left() const noexcept { return left_ & INDEX_MASK; }
+  index_t right() const noexcept { return right_ & INDEX_MASK; }
+  void set_parent(index_t index) noexcept { parent_ = (parent_ & ~INDEX_MASK) | index; }
+  void set_left(index_t index) noexcept { left_ = (left_ & ~INDEX_MASK) | index; }
+  void set_right(index_t index) noexcept { right_ = (right_ & ~INDEX_MASK) | index; }
+
+  int height() const noexcept {
+    return static_cast<int>((parent_ >> INDEX_BITS) | (left_ >> INDEX_BITS) << 2 | (right_ >> INDEX_BITS) << 4);
+  }
+  void set_height(int height) noexcept {
+    auto bits = static_cast<index_t>(height);
+    parent_ = parent() | (bits & 3) << INDEX_BITS;
+    left_ = left() | (bits >> 2 & 3) << INDEX_BITS;
+    right_ = right() | (bits >> 4 & 3) << INDEX_BITS;
+  }
+};
+
+static_assert(sizeof(Compact_Node<int>) == 16, "a node of int keys is the key and three 32-bit links");
+
+
+// AVL tree with the nodes in one contiguous vector linked by 32-bit indices.
+// An int key takes a 16-byte node instead of 32 bytes of AVL_Node, and the
+// whole tree is a single allocation, so copies of trivially copyable keys are
+// one memcpy of the vector. Slot 0 is a sentinel of height 0, which lets
+// heights of missing children be read without a branch. Erased slots are
+// chained into a free list and reused by later insertions.
+// Keys must be default constructible and assignable.
+template <typename KeyT, typename Compare = std::less<KeyT>, typename Alloc = std::allocator<KeyT>>
+class Compact_AVL_Tree {
+  using node_t = Compact_Node<KeyT>;
+  using index_t = typename node_t::index_t;
+  using node_alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<node_t>;
+
+  static constexpr index_t NIL = 0;
+  // Tree built by assign() from at most MAX_SIZE keys is never deeper
+  static constexpr int MAX_HEIGHT = 32;
+
+public:
+  using key_type = KeyT;
+  using value_type = KeyT;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = const KeyT &;
+  using const_reference = const KeyT &;
+
+  // Slots 1..MAX_SIZE are addressable by 30-bit indices
+  static constexpr size_type MAX_SIZE = node_t::INDEX_MASK;
+
+private:
+  std::vector<node_t, node_alloc_t> nodes_; // empty or starts with the sentinel
+  index_t root_ = NIL;
+  index_t free_ = NIL; // erased slots chained through their left links
+  size_type size_ = 0;
+  Compare comp_;
+
+public:
+  // Index of a node in its tree. Indices don't change when the storage grows,
+  // so an iterator stays valid until its key is erased, but it refers to the
+  // tree object and doesn't survive moves of the tree.
+  class const_iterator {
+    const Compact_AVL_Tree *tree_ = nullptr;
+    index_t index_ = NIL;
+
+    friend class Compact_AVL_Tree;
+    const_iterator(const Compact_AVL_Tree *tree, index_t index) noexcept : tree_(tree), index_(index) {}
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = KeyT;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const KeyT *;
+    using reference = const KeyT &;
+
+    const_iterator() noexcept {}
+
+    reference operator*() const noexcept { return tree_->nodes_[index_].key_; }
+    pointer operator->() const noexcept { return &tree_->nodes_[index_].key_; }
+
+    const_iterator& operator++ () noexcept {
+      assert(index_ != NIL);
+      index_ = tree_->next(index_);
+      return *this;
+    }
+    const_iterator& operator-- () noexcept {
+      if (index_ == NIL) { // end()
+        assert(tree_->root_ != NIL);
+        index_ = tree_->rightmost(tree_->root_);
+      } else {
+        index_ = tree_->prev(index_);
+        assert(index_ != NIL); // decrement of begin()
+      }
+      return *this;
+    }
+    const_iterator operator++ (int) noexcept {
+      const_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+    const_iterator operator-- (int) noexcept {
+      const_iterator tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    bool operator== (const const_iterator &rhs) const noexcept { return index_ == rhs.index_; }
+    bool operator!= (const const_iterator &rhs) const noexcept { return index_ != rhs.index_; }
+  };
+  using iterator = const_iterator;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using reverse_iterator = const_reverse_iterator;
+
+private: // navigation
+  const_iterator make_iterator(index_t index) const noexcept { return const_iterator{this, index}; }
+
+  index_t leftmost(index_t index) const noexcept {
+    while (nodes_[index].left() != NIL)
+      index = nodes_[index].left();
+    return index;
+  }
+  index_t rightmost(index_t index) const noexcept {
+    while (nodes_[index].right() != NIL)
+      index = nodes_[index].right();
+    return index;
+  }
+
+  index_t next(index_t index) const noexcept {
+    if (nodes_[index].right() != NIL)
+      return leftmost(nodes_[index].right());
+    index_t parent = nodes_[index].parent();
+    while (parent != NIL && nodes_[parent].right() == index) {
+      index = parent;
+      parent = nodes_[parent].parent();
+    }
+    return parent;
+  }
+  index_t prev(index_t index) const noexcept {
+    if (nodes_[index].left() != NIL)
+      return rightmost(nodes_[index].left());
+    index_t parent = nodes_[index].parent();
+    while (parent != NIL && nodes_[parent].left() == index) {
+      index = parent;
+      parent = nodes_[parent].parent();
+    }
+    return parent;
+  }
+
+private: // lookup
+  template <typename K>
+  index_t lower_bound_index(const K &key) const {
+    index_t result = NIL;
+    for (index_t it = root_; it != NIL;) {
+      const node_t &node = nodes_[it];
+      if (comp_(node.key_, key)) {
+        it = node.right();
+      } else {
+        result = it;
+        it = node.left();
+      }
+    }
+    return result;
+  }
+
+  template <typename K>
+  index_t upper_bound_index(const K &key) const {
+    index_t result = NIL;
+    for (index_t it = root_; it != NIL;) {
+      const node_t &node = nodes_[it];
+      if (comp_(key, node.key_)) {
+        result = it;
+        it = node.left();
+      } else {
+        it = node.right();
+      }
+    }
+    return result;
+  }
+
+  template <typename K>
+  index_t find_index(const K &key) const {
+    index_t index = lower_bound_index(key);
+    return (index != NIL && !comp_(key, nodes_[index].key_)) ? index : NIL;
+  }
+
+private: // slots
+  // Slot for a new node with all links null, taken from the free list first
+  template <typename K>
+  index_t allocate(K &&key) {
+    index_t index = free_;
+    if (index != NIL) {
+      nodes_[index].key_ = std::forward<K>(key);
+      free_ = nodes_[index].left();
+    } else {
+      if (nodes_.size() > MAX_SIZE)
+        throw std::length_error("Compact_AVL_Tree: 30-bit node indices are exhausted");
+      if (nodes_.empty())
+        nodes_.emplace_back(); // sentinel
+      nodes_.emplace_back(std::forward<K>(key));
+      index = static_cast<index_t>(nodes_.size() - 1);
+    }
+    nodes_[index].parent_ = nodes_[index].left_ = nodes_[index].right_ = NIL;
+    return index;
+  }
+
+  void release(index_t index) noexcept {
+    if constexpr (!std::is_trivially_destructible<KeyT>::value)
+      nodes_[index].key_ = KeyT{}; // frees what the key owns
+    nodes_[index].left_ = free_;
+    free_ = index;
+  }
+
+private: // rotations
+  int height(index_t index) const noexcept { return nodes_[index].height(); }
+  int balance_factor(index_t index) const noexcept {
+    return height(nodes_[index].right()) - height(nodes_[index].left());
+  }
+  void update_height(index_t index) noexcept {
+    nodes_[index].set_height(std::max(height(nodes_[index].left()), height(nodes_[index].right())) + 1);
+  }
+
+  // Puts new_child in place of old_child under parent, or in the root if there's no parent
+  void replace_child(index_t parent, index_t old_child, index_t new_child) noexcept {
+    if (parent == NIL)
+      root_ = new_child;
+    else if (nodes_[parent].left() == old_child)
+      nodes_[parent].set_left(new_child);
+    else
+      nodes_[parent].set_right(new_child);
+    if (new_child != NIL)
+      nodes_[new_child].set_parent(parent);
+  }
+
+  // Both rotations return the new root of the subtree
+  index_t rotate_left(index_t sub_root) noexcept {
+    index_t child = nodes_[sub_root].right();
+    replace_child(nodes_[sub_root].parent(), sub_root, child);
+    index_t inner = nodes_[child].left();
+    nodes_[sub_root].set_right(inner);
+    if (inner != NIL)
+      nodes_[inner].set_parent(sub_root);
+    nodes_[child].set_left(sub_root);
+    nodes_[sub_root].set_parent(child);
+    update_height(sub_root);
+    update_height(child);
+    return child;
+  }
+
+  index_t rotate_right(index_t sub_root) noexcept {
+    index_t child = nodes_[sub_root].left();
+    replace_child(nodes_[sub_root].parent(), sub_root, child);
+    index_t inner = nodes_[child].right();
+    nodes_[sub_root].set_left(inner);
+    if (inner != NIL)
+      nodes_[inner].set_parent(sub_root);
+    nodes_[child].set_right(sub_root);
+    nodes_[sub_root].set_parent(child);
+    update_height(sub_root);
+    update_height(child);
+    return child;
+  }
+
+  // Walks up from `start` fixing heights and rotating, until a subtree keeps
+  // the height it had before the insertion or erase
+  void retrace(index_t start) noexcept {
+    for (index_t index = start; index != NIL; index = nodes_[index].parent()) {
+      int old_height = height(index);
+      update_height(index);
+      int bf = balance_factor(index);
+
+      if (bf == -2) { // left heavy
+        if (balance_factor(nodes_[index].left()) > 0)
+          rotate_left(nodes_[index].left());
+        index = rotate_right(index);
+      } else if (bf == 2) { // right heavy
+        if (balance_factor(nodes_[index].right()) < 0)
+          rotate_right(nodes_[index].right());
+        index = rotate_left(index);
+      }
+      if (height(index) == old_height)
+        break;
+    }
+  }
+
+private: // modification
+  template <typename K>
+  const_iterator insert_key(K &&key) {
+    index_t parent = NIL;
+    bool to_left = false;
+    for (index_t it = root_; it != NIL;) {
+      const node_t &node = nodes_[it];
+      if (comp_(key, node.key_)) {
+        to_left = true;
+      } else if (comp_(node.key_, key)) {
+        to_left = false;
+      } else {
+        return make_iterator(it);
+      }
+      parent = it;
+      it = to_left ? node.left() : node.right();
+    }
+
+    // may grow the storage, no references to nodes are held across it
+    index_t index = allocate(std::forward<K>(key));
+    nodes_[index].set_height(1);
+    nodes_[index].set_parent(parent);
+    if (parent == NIL)
+      root_ = index;
+    else if (to_left)
+      nodes_[parent].set_left(index);
+    else
+      nodes_[parent].set_right(index);
+    ++size_;
+    retrace(parent);
+    return make_iterator(index);
+  }
+
+  // The successor of a node with 2 children takes its place and its height,
+  // so the retrace can stop early, other nodes keep their slots.
+  void erase_index(index_t index) noexcept {
+    index_t parent = nodes_[index].parent(), left = nodes_[index].left(), right = nodes_[index].right();
+    index_t retrace_start = parent;
+    if (left == NIL || right == NIL) {
+      replace_child(parent, index, left != NIL ? left : right);
+    } else {
+      index_t successor = leftmost(right);
+      if (successor == right) {
+        retrace_start = successor;
+      } else {
+        retrace_start = nodes_[successor].parent();
+        index_t successor_right = nodes_[successor].right();
+        nodes_[retrace_start].set_left(successor_right);
+        if (successor_right != NIL)
+          nodes_[successor_right].set_parent(retrace_start);
+        nodes_[successor].set_right(right);
+        nodes_[right].set_parent(successor);
+      }
+      nodes_[successor].set_left(left);
+      nodes_[left].set_parent(successor);
+      nodes_[successor].set_height(height(index));
+      replace_child(parent, index, successor);
+    }
+
+    release(index);
+    --size_;
+    retrace(retrace_start);
+  }
+
+private: // construction
+  // Slot i + 1 takes the i-th of n strictly increasing keys, the subtree of
+  // slots [lo, hi) is rooted at its middle slot. Links and heights follow
+  // from the slot ranges, so the tree is built in one pass without rotations.
+  template <typename InputIt>
+  void build_sorted(InputIt first, size_type n) {
+    if (n == 0)
+      return;
+    if (n > MAX_SIZE)
+      throw std::length_error("Compact_AVL_Tree: 30-bit node indices are exhausted");
+
+    nodes_.reserve(n + 1);
+    nodes_.emplace_back(); // sentinel
+    for (size_type i = 0; i < n; ++i, ++first)
+      nodes_.emplace_back(*first);
+
+    struct range_t {
+      index_t lo_, hi_, parent_;
+    } stack[MAX_HEIGHT + 1];
+    int top = 0;
+    stack[0] = range_t{1, static_cast<index_t>(n + 1), NIL};
+    while (top >= 0) {
+      range_t range = stack[top--];
+      index_t mid = range.lo_ + (range.hi_ - range.lo_) / 2;
+      node_t &node = nodes_[mid];
+      int height = 0;
+      for (index_t size = range.hi_ - range.lo_; size >> height; ++height) {}
+      node.set_height(height);
+      node.set_parent(range.parent_);
+      node.set_left(range.lo_ < mid ? range.lo_ + (mid - range.lo_) / 2 : NIL);
+      node.set_right(mid + 1 < range.hi_ ? mid + 1 + (range.hi_ - mid - 1) / 2 : NIL);
+      if (range.lo_ < mid)
+        stack[++top] = range_t{range.lo_, mid, mid};
+      if (mid + 1 < range.hi_)
+        stack[++top] = range_t{mid + 1, range.hi_, mid};
+      assert(top <= MAX_HEIGHT);
+    }
+    root_ = static_cast<index_t>(1 + n / 2);
+    size_ = n;
+  }
+
+public: // ctors & dtors
+  Compact_AVL_Tree() {}
+  explicit Compact_AVL_Tree(const Compare &comp, const Alloc &alloc = Alloc{})
+    : nodes_(node_alloc_t(alloc)), comp_(comp) {}
+  explicit Compact_AVL_Tree(const Alloc &alloc) : Compact_AVL_Tree(Compare{}, alloc) {}
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  Compact_AVL_Tree(InputIt first, InputIt last, const Compare &comp = Compare{}, const Alloc &alloc = Alloc{})
+    : Compact_AVL_Tree(comp, alloc)
+  {
+    assign(first, last);
+  }
+  // Slots are copied as they are, one memcpy for trivially copyable keys
+  Compact_AVL_Tree(const Compact_AVL_Tree &other)
+    : nodes_(other.nodes_), root_(other.root_), free_(other.free_), size_(other.size_), comp_(other.comp_) {}
+  Compact_AVL_Tree(Compact_AVL_Tree &&other) noexcept
+    : nodes_(std::move(other.nodes_)), root_(other.root_), free_(other.free_), size_(other.size_), comp_(other.comp_)
+  {
+    other.nodes_.clear();
+    other.root_ = other.free_ = NIL;
+    other.size_ = 0;
+  }
+  ~Compact_AVL_Tree() = default;
+  Compact_AVL_Tree& operator= (const Compact_AVL_Tree &rhs) {
+    if (this == &rhs)
+      return *this;
+
+    Compact_AVL_Tree tmp(rhs);
+    swap(tmp);
+    return *this;
+  }
+  Compact_AVL_Tree& operator= (Compact_AVL_Tree &&rhs) noexcept {
+    if (this == &rhs)
+      return *this;
+
+    swap(rhs);
+    return *this;
+  }
+
+  void swap(Compact_AVL_Tree &other) noexcept {
+    nodes_.swap(other.nodes_);
+    std::swap(root_, other.root_);
+    std::swap(free_, other.free_);
+    std::swap(size_, other.size_);
+    std::swap(comp_, other.comp_);
+  }
+
+public: // iterators
+  const_iterator begin() const noexcept { return make_iterator(root_ != NIL ? leftmost(root_) : NIL); }
+  const_iterator end() const noexcept { return make_iterator(NIL); }
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+  const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator{end()}; }
+  const_reverse_iterator rend() const noexcept { return const_reverse_iterator{begin()}; }
+
+public: // selectors
+  Alloc get_allocator() const { return Alloc(nodes_.get_allocator()); }
+  Compare key_comp() const { return comp_; }
+  Compare value_comp() const { return comp_; }
+  bool empty() const noexcept { return size_ == 0; }
+  size_type size() const noexcept { return size_; }
+  // Nodes on the way from the root to the deepest key
+  size_type height() const noexcept { return root_ != NIL ? static_cast<size_type>(height(root_)) : 0; }
+  // Bytes taken by the node storage, free slots and spare capacity included
+  size_type memory_used() const noexcept { return nodes_.capacity() * sizeof(node_t); }
+
+  // Checks the sentinel, parent links, order, the packed heights and balance,
+  // and that every slot is either in the tree or in the free list
+  bool check_invariants() const {
+    if (nodes_.empty())
+      return root_ == NIL && free_ == NIL && size_ == 0;
+    const node_t &sentinel = nodes_[NIL];
+    bool ok = sentinel.height() == 0 && sentinel.left() == NIL && sentinel.right() == NIL;
+    ok = ok && (root_ == NIL || nodes_[root_].parent() == NIL);
+
+    // in-order walk, the packed height of every node is compared with its children
+    std::vector<index_t> stack;
+    index_t prev = NIL; // in-order predecessor
+    size_type count = 0;
+    index_t index = root_;
+    while (index != NIL || !stack.empty()) {
+      for (; index != NIL; index = nodes_[index].left()) {
+        if (index >= nodes_.size() || stack.size() == size_) // a cycle is deeper than the size
+          return false;
+        stack.push_back(index);
+      }
+      index = stack.back();
+      stack.pop_back();
+      const node_t &node = nodes_[index];
+      for (index_t child : {node.left(), node.right()})
+        ok = ok && (child == NIL || (child < nodes_.size() && nodes_[child].parent() == index));
+      if (!ok || count == size_)
+        return false;
+      ok = ok && (prev == NIL || comp_(nodes_[prev].key_, node.key_));
+      int left_height = height(node.left()), right_height = height(node.right());
+      ok = ok && node.height() == 1 + std::max(left_height, right_height);
+      ok = ok && left_height - right_height <= 1 && right_height - left_height <= 1;
+      ++count;
+      prev = index;
+      index = node.right();
+    }
+
+    size_type free_count = 0;
+    for (index_t slot = free_; ok && slot != NIL; slot = nodes_[slot].left())
+      ok = slot < nodes_.size() && ++free_count < nodes_.size();
+    return ok && count == size_ && count + free_count + 1 == nodes_.size();
+  }
+
+  const_iterator find(const KeyT &key) const { return make_iterator(find_index(key)); }
+  const_iterator lower_bound(const KeyT &key) const { return make_iterator(lower_bound_index(key)); }
+  const_iterator upper_bound(const KeyT &key) const { return make_iterator(upper_bound_index(key)); }
+  bool contains(const KeyT &key) const { return find_index(key) != NIL; }
+
+  // Heterogeneous lookup, available only if Compare::is_transparent exists
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator find(const K &key) const { return make_iterator(find_index(key)); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator lower_bound(const K &key) const { return make_iterator(lower_bound_index(key)); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator upper_bound(const K &key) const { return make_iterator(upper_bound_index(key)); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  bool contains(const K &key) const { return find_index(key) != NIL; }
+
+public: // modifiers
+  // Releases the storage
+  void clear() noexcept {
+    std::vector<node_t, node_alloc_t> empty{nodes_.get_allocator()};
+    nodes_.swap(empty);
+    root_ = free_ = NIL;
+    size_ = 0;
+  }
+
+  // Makes room for `count` keys, so the storage doesn't grow until there are more
+  void reserve(size_type count) {
+    if (count > MAX_SIZE)
+      throw std::length_error("Compact_AVL_Tree: 30-bit node indices are exhausted");
+    nodes_.reserve(count + 1);
+  }
+
+  // Gives back the spare capacity left by the growth of the storage, the
+  // free slots stay as they are, so no index changes
+  void shrink_to_fit() {
+    nodes_.shrink_to_fit();
+  }
+
+  // Returns iterator to the inserted key or to the equivalent key already present
+  iterator insert(const KeyT &key) { return insert_key(key); }
+  iterator insert(KeyT &&key) { return insert_key(std::move(key)); }
+
+  bool erase(const KeyT &key) {
+    index_t index = find_index(key);
+    if (index == NIL)
+      return false;
+    erase_index(index);
+    return true;
+  }
+
+  // Returns iterator following the removed key
+  iterator erase(const_iterator pos) {
+    assert(pos.tree_ == this && pos.index_ != NIL);
+    index_t following = next(pos.index_);
+    erase_index(pos.index_);
+    return make_iterator(following);
+  }
+
+  // Replaces the contents with keys from [first, last) in linear time if they
+  // are strictly increasing, otherwise the keys are sorted and deduplicated first.
+  template <typename InputIt>
+  void assign(InputIt first, InputIt last) {
+    using category_t = typename std::iterator_traits<InputIt>::iterator_category;
+    Compact_AVL_Tree tmp{comp_, get_allocator()};
+
+    if constexpr (std::is_base_of<std::forward_iterator_tag, category_t>::value) {
+      InputIt unordered = std::adjacent_find(first, last, [this](const KeyT &lhs, const KeyT &rhs) { return !comp_(lhs, rhs); });
+      if (unordered == last) {
+        tmp.build_sorted(first, static_cast<size_type>(std::distance(first, last)));
+        swap(tmp);
+        return;
+      }
+    }
+
+    std::vector<KeyT> keys(first, last);
+    std::sort(keys.begin(), keys.end(), comp_);
+    auto keys_end = std::unique(keys.begin(), keys.end(), [this](const KeyT &lhs, const KeyT &rhs) { return !comp_(lhs, rhs); });
+    tmp.build_sorted(std::make_move_iterator(keys.begin()), static_cast<size_type>(keys_end - keys.begin()));
+    swap(tmp);
+  }
+};
+
+} // SearchTrees
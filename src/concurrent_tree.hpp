@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "epoch.hpp"
+#include "persistent_tree.hpp"
+
+namespace SearchTrees {
+
+// AVL tree for many reader threads and concurrent writers.
+// Readers don't take locks: they pin an epoch and search the latest published
+// version of a Persistent_Tree. Writers are serialized by a mutex, each one
+// path-copies the published version and publishes the result with one atomic
+// store. Replaced versions are retired and destroyed when no reader can still
+// see them, which frees only the nodes not shared with the newer versions.
+template <typename KeyT, typename Compare = std::less<KeyT>, typename Alloc = std::allocator<KeyT>>
+class Concurrent_Tree {
+public:
+  using version_t = Persistent_Tree<KeyT, Compare, Alloc>;
+  using key_type = KeyT;
+  using value_type = KeyT;
+  using key_compare = Compare;
+  using size_type = std::size_t;
+
+private:
+  mutable Epoch_Domain epochs_;
+  std::atomic<const version_t*> published_;
+  std::mutex write_mutex_;
+  std::deque<std::pair<std::uint64_t, std::unique_ptr<const version_t>>> retired_; // by epoch, guarded by write_mutex_
+
+  // Called with write_mutex_ held. Nothing is published if an allocation throws.
+  void publish(version_t next) {
+    auto version = std::make_unique<const version_t>(std::move(next));
+    retired_.emplace_back(0, nullptr);
+    auto &retired = retired_.back();
+    retired.second.reset(published_.exchange(version.release(), std::memory_order_seq_cst));
+    retired.first = epochs_.advance();
+    reclaim();
+  }
+
+  void reclaim() noexcept {
+    std::uint64_t min_pinned = epochs_.min_pinned();
+    while (!retired_.empty() && retired_.front().first <= min_pinned)
+      retired_.pop_front();
+  }
+
+  // Writers read the published version without pinning, only they retire it
+  const version_t &latest() const noexcept { return *published_.load(std::memory_order_relaxed); }
+
+public: // ctors & dtors
+  Concurrent_Tree() : published_(new version_t{}) {}
+  explicit Concurrent_Tree(const Compare &comp, const Alloc &alloc = Alloc{}) : published_(new version_t{comp, alloc}) {}
+  // No thread may use the tree during destruction
+  ~Concurrent_Tree() {
+    retired_.clear();
+    delete published_.load();
+  }
+  Concurrent_Tree(const Concurrent_Tree &other) = delete;
+  Concurrent_Tree& operator= (const Concurrent_Tree &rhs) = delete;
+
+public: // selectors, lock-free
+  size_type size() const {
+    auto guard = epochs_.pin();
+    return published_.load(std::memory_order_seq_cst)->size();
+  }
+  bool empty() const { return size() == 0; }
+
+  bool contains(const KeyT &key) const {
+    auto guard = epochs_.pin();
+    return published_.load(std::memory_order_seq_cst)->contains(key);
+  }
+
+  // Lookups return a copy of the found key, the node may be freed after return
+  std::optional<KeyT> find(const KeyT &key) const {
+    auto guard = epochs_.pin();
+    const version_t *version = published_.load(std::memory_order_seq_cst);
+    auto it = version->find(key);
+    return (it != version->end()) ? std::optional<KeyT>{*it} : std::nullopt;
+  }
+  std::optional<KeyT> lower_bound(const KeyT &key) const {
+    auto guard = epochs_.pin();
+    const version_t *version = published_.load(std::memory_order_seq_cst);
+    auto it = version->lower_bound(key);
+    return (it != version->end()) ? std::optional<KeyT>{*it} : std::nullopt;
+  }
+  std::optional<KeyT> upper_bound(const KeyT &key) const {
+    auto guard = epochs_.pin();
+    const version_t *version = published_.load(std::memory_order_seq_cst);
+    auto it = version->upper_bound(key);
+    return (it != version->end()) ? std::optional<KeyT>{*it} : std::nullopt;
+  }
+
+  // Consistent version for iteration and several lookups, shares nodes in O(1)
+  version_t snapshot() const {
+    auto guard = epochs_.pin();
+    return version_t(*published_.load(std::memory_order_seq_cst));
+  }
+
+public: // modifiers, serialized
+  bool insert(const KeyT &key) {
+    std::lock_guard<std::mutex> lock{write_mutex_};
+    version_t next{latest()};
+    if (!next.insert(key))
+      return false;
+    publish(std::move(next));
+    return true;
+  }
+
+  bool erase(const KeyT &key) {
+    std::lock_guard<std::mutex> lock{write_mutex_};
+    version_t next{latest()};
+    if (!next.erase(key))
+      return false;
+    publish(std::move(next));
+    return true;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock{write_mutex_};
+    version_t next{latest()};
+    next.clear();
+    publish(std::move(next));
+  }
+};
+
+} // SearchTrees
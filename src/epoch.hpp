@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <thread>
+
+namespace SearchTrees {
+
+// Epoch-based reclamation for structures read without locks.
+// A reader pins the current epoch for the time it dereferences shared nodes,
+// a writer unlinks nodes and either advances the epoch and frees them once every
+// pinned epoch is not less than the epoch returned by advance(), or stamps them
+// with current() and frees them once every pinned epoch is greater than the stamp.
+// The latter leaves advance() to reclamation, which keeps unlinking off the
+// shared counter.
+class Epoch_Domain {
+public:
+  // Readers pinned at the same time, pin() spins while all slots are taken
+  static constexpr std::size_t MAX_READERS = 256;
+
+private:
+  // Pinned epoch of one reader, 0 if the slot is free
+  struct alignas(64) Slot {
+    std::atomic<std::uint64_t> epoch_{0};
+  };
+
+  std::atomic<std::uint64_t> epoch_{1};
+  Slot slots_[MAX_READERS];
+
+public:
+  // Keeps the epoch pinned until destruction
+  class Guard {
+    Slot *slot_;
+
+    friend class Epoch_Domain;
+    explicit Guard(Slot *slot) noexcept : slot_(slot) {}
+
+  public:
+    Guard(Guard &&other) noexcept : slot_(other.slot_) { other.slot_ = nullptr; }
+    Guard(const Guard &other) = delete;
+    Guard& operator= (const Guard &rhs) = delete;
+    Guard& operator= (Guard &&rhs) = delete;
+    ~Guard() {
+      if (slot_)
+        slot_->epoch_.store(0, std::memory_order_release);
+    }
+  };
+
+public: // ctors & dtors
+  Epoch_Domain() {}
+  Epoch_Domain(const Epoch_Domain &other) = delete;
+  Epoch_Domain& operator= (const Epoch_Domain &rhs) = delete;
+
+public:
+  // Shared data loaded after pin() may be used until the guard is destroyed.
+  // Threads start probing from different slots, so they rarely share a cache line.
+  Guard pin() noexcept {
+    std::size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    for (;;) {
+      for (std::size_t i = 0; i < MAX_READERS; ++i) {
+        Slot &slot = slots_[(start + i) % MAX_READERS];
+        std::uint64_t expected = 0;
+        if (slot.epoch_.load(std::memory_order_relaxed) == 0 &&
+            slot.epoch_.compare_exchange_strong(expected, epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst))
+          return Guard{&slot};
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  // Stamp for nodes unlinked before the call, they may be freed as soon as
+  // min_pinned() is greater than it
+  std::uint64_t current() const noexcept {
+    return epoch_.load(std::memory_order_seq_cst);
+  }
+
+  // Nodes unlinked before the call may be freed as soon as min_pinned() is not
+  // less than the returned epoch
+  std::uint64_t advance() noexcept {
+    return epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+  }
+
+  // Smallest epoch pinned by readers, max of std::uint64_t if there are none
+  std::uint64_t min_pinned() const noexcept {
+    std::uint64_t min = std::numeric_limits<std::uint64_t>::max();
+    for (const Slot &slot : slots_) {
+      std::uint64_t epoch = slot.epoch_.load(std::memory_order_seq_cst);
+      if (epoch != 0 && epoch < min)
+        min = epoch;
+    }
+    return min;
+  }
+};
+
+} // SearchTrees
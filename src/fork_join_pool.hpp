@@ -0,0 +1,226 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+namespace SearchTrees {
+
+// Small work-stealing pool for fork/join parallelism.
+// run() executes a function on the calling thread, which takes part in the
+// work as worker 0, the function and everything it calls may use fork_join().
+// Every worker pushes forked tasks to the back of its own deque and takes them
+// back from there, idle workers steal from the front of the other deques.
+class Fork_Join_Pool {
+  struct Task {
+    std::atomic<bool> done_{false};
+    std::exception_ptr error_;
+
+    virtual void execute() = 0;
+
+    void run() noexcept {
+      try {
+        execute();
+      } catch (...) {
+        error_ = std::current_exception();
+      }
+      done_.store(true, std::memory_order_release);
+    }
+
+  protected:
+    ~Task() = default;
+  };
+
+  template <typename Func>
+  struct Func_Task final : Task {
+    Func &func_;
+    explicit Func_Task(Func &func) noexcept : func_(func) {}
+    void execute() override { func_(); }
+  };
+
+  struct Worker_Queue {
+    std::mutex mutex_;
+    std::deque<Task*> tasks_;
+  };
+
+  struct Worker_Id {
+    const Fork_Join_Pool *pool_ = nullptr;
+    unsigned index_ = 0;
+  };
+
+  static Worker_Id &current_worker() noexcept {
+    static thread_local Worker_Id id;
+    return id;
+  }
+
+  std::vector<std::unique_ptr<Worker_Queue>> queues_;
+  std::vector<std::thread> threads_;
+  std::mutex run_mutex_; // serializes run() calls
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cv_;
+  std::atomic<bool> active_{false};
+  bool stop_ = false;
+
+  void push(unsigned index, Task *task) {
+    Worker_Queue &queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex_);
+    queue.tasks_.push_back(task);
+  }
+
+  // Takes back the task pushed last by the worker if nobody has stolen it
+  bool pop_back(unsigned index, Task *task) {
+    Worker_Queue &queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex_);
+    if (queue.tasks_.empty() || queue.tasks_.back() != task)
+      return false;
+    queue.tasks_.pop_back();
+    return true;
+  }
+
+  Task *pop_any(unsigned index) {
+    Worker_Queue &queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex_);
+    if (queue.tasks_.empty())
+      return nullptr;
+    Task *task = queue.tasks_.back();
+    queue.tasks_.pop_back();
+    return task;
+  }
+
+  Task *steal(unsigned thief) {
+    unsigned count = size();
+    for (unsigned i = 1; i < count; ++i) {
+      Worker_Queue &queue = *queues_[(thief + i) % count];
+      std::lock_guard<std::mutex> lock(queue.mutex_);
+      if (!queue.tasks_.empty()) {
+        Task *task = queue.tasks_.front();
+        queue.tasks_.pop_front();
+        return task;
+      }
+    }
+    return nullptr;
+  }
+
+  void worker_loop(unsigned index) {
+    current_worker() = Worker_Id{this, index};
+    while (true) {
+      if (!active_.load(std::memory_order_acquire)) {
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        idle_cv_.wait(lock, [this] { return stop_ || active_.load(std::memory_order_acquire); });
+        if (stop_)
+          return;
+      }
+
+      Task *task = pop_any(index);
+      if (!task)
+        task = steal(index);
+      if (task)
+        task->run();
+      else
+        std::this_thread::yield();
+    }
+  }
+
+public: // ctors & dtors
+  explicit Fork_Join_Pool(unsigned threads = std::thread::hardware_concurrency()) {
+    if (threads == 0)
+      threads = 1;
+    for (unsigned i = 0; i < threads; ++i)
+      queues_.push_back(std::make_unique<Worker_Queue>());
+    for (unsigned i = 1; i < threads; ++i)
+      threads_.emplace_back(&Fork_Join_Pool::worker_loop, this, i);
+  }
+  ~Fork_Join_Pool() {
+    {
+      std::lock_guard<std::mutex> lock(idle_mutex_);
+      stop_ = true;
+    }
+    idle_cv_.notify_all();
+    for (auto &thread : threads_)
+      thread.join();
+  }
+  Fork_Join_Pool(const Fork_Join_Pool &other) = delete;
+  Fork_Join_Pool(Fork_Join_Pool &&other) = delete;
+  Fork_Join_Pool& operator= (const Fork_Join_Pool &rhs) = delete;
+  Fork_Join_Pool& operator= (Fork_Join_Pool &&rhs) = delete;
+
+public:
+  // Number of workers including the thread that calls run()
+  unsigned size() const noexcept { return static_cast<unsigned>(queues_.size()); }
+
+  template <typename Func>
+  void run(Func func) {
+    if (current_worker().pool_ == this) { // nested run() from a task
+      func();
+      return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    Worker_Id saved = current_worker();
+    current_worker() = Worker_Id{this, 0};
+    {
+      std::lock_guard<std::mutex> lock(idle_mutex_);
+      active_.store(true, std::memory_order_release);
+    }
+    idle_cv_.notify_all();
+
+    std::exception_ptr error;
+    try {
+      func();
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    active_.store(false, std::memory_order_release);
+    current_worker() = saved;
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  // Runs both functions, possibly in parallel, and waits for them.
+  // Outside of run() the functions are called one after another.
+  template <typename Func1, typename Func2>
+  void fork_join(Func1 &&func1, Func2 &&func2) {
+    Worker_Id self = current_worker();
+    if (self.pool_ != this || size() == 1) {
+      func1();
+      func2();
+      return;
+    }
+
+    Func_Task<Func2> task2{func2};
+    push(self.index_, &task2);
+
+    std::exception_ptr error;
+    try {
+      func1();
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    if (pop_back(self.index_, &task2)) {
+      task2.run();
+    } else { // stolen, help others until it is done
+      while (!task2.done_.load(std::memory_order_acquire)) {
+        Task *task = steal(self.index_);
+        if (task)
+          task->run();
+        else
+          std::this_thread::yield();
+      }
+    }
+
+    if (error)
+      std::rethrow_exception(error);
+    if (task2.error_)
+      std::rethrow_exception(task2.error_);
+  }
+};
+
+} // SearchTrees
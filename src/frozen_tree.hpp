@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <vector>
+#include <cassert>
+
+#include "tree.hpp"
+
+namespace SearchTrees {
+
+// Immutable snapshot of a search tree for read-mostly workloads.
+// Keys are stored in one array in Eytzinger (BFS) order: the root at index 1,
+// children of k at 2k and 2k + 1, index 0 is unused. A descent then touches
+// predictable addresses, so it is branchless and the next levels are prefetched
+// several steps ahead, 4 levels of int keys share one cache line.
+template <typename KeyT, typename Compare = std::less<KeyT>, typename Alloc = std::allocator<KeyT>>
+class Frozen_Tree {
+public:
+  using key_type = KeyT;
+  using value_type = KeyT;
+  using key_compare = Compare;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = const KeyT &;
+  using const_reference = const KeyT &;
+
+private:
+  std::vector<KeyT, Alloc> keys_; // keys_.size() == size() + 1 for non-empty snapshot
+  Compare comp_;
+
+  static constexpr size_type CACHE_LINE = 64;
+  static constexpr size_type PREFETCH_STRIDE = (sizeof(KeyT) < CACHE_LINE) ? CACHE_LINE / sizeof(KeyT) : 1;
+
+  size_type last_index() const noexcept { return keys_.empty() ? 0 : keys_.size() - 1; }
+
+  void prefetch_descendants(size_type k) const noexcept {
+    // address arithmetic only, the line may lie past the end of the array
+    auto address = reinterpret_cast<std::uintptr_t>(keys_.data()) + k * PREFETCH_STRIDE * sizeof(KeyT);
+    prefetch(reinterpret_cast<const void*>(address));
+  }
+
+  // Removes trailing right turns from the path encoded in k and the last left turn,
+  // which gives the index of the lowest ancestor where the descent went left.
+  static size_type drop_right_turns(size_type k) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+    return k >> (__builtin_ctzll(~static_cast<unsigned long long>(k)) + 1);
+#else
+    while (k & 1)
+      k >>= 1;
+    return k >> 1;
+#endif
+  }
+
+  static size_type leftmost(size_type k, size_type n) noexcept {
+    if (k > n)
+      return 0;
+    while (2 * k <= n)
+      k = 2 * k;
+    return k;
+  }
+
+  static size_type rightmost(size_type k, size_type n) noexcept {
+    if (k > n)
+      return 0;
+    while (2 * k + 1 <= n)
+      k = 2 * k + 1;
+    return k;
+  }
+
+  static size_type next_index(size_type k, size_type n) noexcept {
+    if (2 * k + 1 <= n)
+      return leftmost(2 * k + 1, n);
+    return drop_right_turns(k);
+  }
+
+  static size_type prev_index(size_type k, size_type n) noexcept {
+    if (2 * k <= n)
+      return rightmost(2 * k, n);
+    // drop trailing left turns and the last right turn
+    while (k > 1 && !(k & 1))
+      k >>= 1;
+    return k >> 1;
+  }
+
+  template <typename K>
+  size_type lower_bound_index(const K &key) const noexcept {
+    size_type n = last_index();
+    size_type k = 1;
+    while (k <= n) {
+      prefetch_descendants(k);
+      k = 2 * k + static_cast<size_type>(comp_(keys_[k], key));
+    }
+    return drop_right_turns(k);
+  }
+
+  template <typename K>
+  size_type upper_bound_index(const K &key) const noexcept {
+    size_type n = last_index();
+    size_type k = 1;
+    while (k <= n) {
+      prefetch_descendants(k);
+      k = 2 * k + static_cast<size_type>(!comp_(key, keys_[k]));
+    }
+    return drop_right_turns(k);
+  }
+
+  template <typename K>
+  size_type find_index(const K &key) const noexcept {
+    size_type k = lower_bound_index(key);
+    return (k != 0 && !comp_(key, keys_[k])) ? k : 0;
+  }
+
+public:
+  // In-order iterator over the snapshot, index 0 is end().
+  // Refers to the key array, so it survives moves of the snapshot.
+  class const_iterator {
+    const KeyT *keys_ = nullptr;
+    size_type last_ = 0;
+    size_type index_ = 0;
+
+    friend class Frozen_Tree;
+    const_iterator(const Frozen_Tree *tree, size_type index) noexcept
+      : keys_(tree->keys_.data()), last_(tree->last_index()), index_(index) {}
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = KeyT;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const KeyT *;
+    using reference = const KeyT &;
+
+    const_iterator() noexcept {}
+
+    reference operator*() const noexcept { return keys_[index_]; }
+    pointer operator->() const noexcept { return keys_ + index_; }
+
+    const_iterator& operator++ () noexcept {
+      assert(index_ != 0);
+      index_ = next_index(index_, last_);
+      return *this;
+    }
+    const_iterator& operator-- () noexcept {
+      index_ = (index_ == 0) ? rightmost(1, last_) : prev_index(index_, last_);
+      assert(index_ != 0);
+      return *this;
+    }
+    const_iterator operator++ (int) noexcept {
+      const_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+    const_iterator operator-- (int) noexcept {
+      const_iterator tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    bool operator== (const const_iterator &rhs) const noexcept { return index_ == rhs.index_; }
+    bool operator!= (const const_iterator &rhs) const noexcept { return index_ != rhs.index_; }
+  };
+  using iterator = const_iterator;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using reverse_iterator = const_reverse_iterator;
+
+public: // ctors & dtors
+  Frozen_Tree() {}
+  explicit Frozen_Tree(const Compare &comp, const Alloc &alloc = Alloc{}) : keys_(alloc), comp_(comp) {}
+
+  // Lays out keys of `tree`, which must be sorted by `comp` and unique in its iteration order
+  template <typename TreeT>
+  Frozen_Tree(const TreeT &tree, const Compare &comp, const Alloc &alloc = Alloc{}) : keys_(alloc), comp_(comp) {
+    size_type n = tree.size();
+    if (n == 0)
+      return;
+
+    keys_.assign(n + 1, *tree.begin()); // slot 0 stays unused
+    auto it = tree.begin();
+    for (size_type k = leftmost(1, n); k != 0; k = next_index(k, n), ++it)
+      keys_[k] = *it;
+    assert(it == tree.end());
+  }
+
+public: // iterators
+  const_iterator begin() const noexcept { return const_iterator{this, leftmost(1, last_index())}; }
+  const_iterator end() const noexcept { return const_iterator{this, 0}; }
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+  const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator{end()}; }
+  const_reverse_iterator rend() const noexcept { return const_reverse_iterator{begin()}; }
+
+public: // selectors
+  bool empty() const noexcept { return keys_.empty(); }
+  size_type size() const noexcept { return last_index(); }
+  Compare key_comp() const { return comp_; }
+
+  const_iterator lower_bound(const KeyT &key) const noexcept { return const_iterator{this, lower_bound_index(key)}; }
+  const_iterator upper_bound(const KeyT &key) const noexcept { return const_iterator{this, upper_bound_index(key)}; }
+  const_iterator find(const KeyT &key) const noexcept { return const_iterator{this, find_index(key)}; }
+  bool contains(const KeyT &key) const noexcept { return find_index(key) != 0; }
+
+  // Heterogeneous lookup, available only if Compare::is_transparent exists
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator lower_bound(const K &key) const noexcept { return const_iterator{this, lower_bound_index(key)}; }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator upper_bound(const K &key) const noexcept { return const_iterator{this, upper_bound_index(key)}; }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator find(const K &key) const noexcept { return const_iterator{this, find_index(key)}; }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  bool contains(const K &key) const noexcept { return find_index(key) != 0; }
+
+public: // conversion
+  // Rebuilds a mutable tree in linear time
+  template <typename TreeT = AVL_Tree<KeyT, Compare>>
+  TreeT thaw() const {
+    return TreeT(begin(), end(), comp_);
+  }
+};
+
+
+template <typename KeyT, typename Compare, typename Alloc, bool OrderStatistics, typename Aggregate>
+Frozen_Tree<KeyT, Compare, Alloc> freeze(const AVL_Tree<KeyT, Compare, Alloc, OrderStatistics, Aggregate> &tree) {
+  return Frozen_Tree<KeyT, Compare, Alloc>(tree, tree.key_comp(), tree.get_allocator());
+}
+
+} // SearchTrees
@@ -64,5 +64,10 @@ int main() {
 
   std::cout << "Copy of AVL tree before erases:" << std::endl << avl_copy << std::endl;
 
+  std::cout << "Keys of AVL tree in order:";
+  for (int key : avl)
+    std::cout << " " << key;
+  std::cout << std::endl;
+
   return 0;
 }
\ No newline at end of file
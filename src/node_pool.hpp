@@ -0,0 +1,268 @@
+#pragma once
+
+#include <memory>
+#include <cstddef>
+#include <algorithm>
+#include <utility>
+#include <cassert>
+
+#include "tree_stats.hpp"
+
+namespace SearchTrees {
+
+// Slab allocator for tree nodes.
+// Nodes are carved out of geometrically growing slabs obtained from Alloc,
+// erased nodes are put on a free list and recycled by the next create().
+// release() returns all slabs to Alloc at once without touching the nodes.
+// Slabs may be shared with node handles and other pools, which keeps a node
+// valid when it's moved between trees without reallocation.
+template <typename NodeT, typename Alloc>
+class Node_Pool {
+  union Slot;
+
+  struct Slab_Header {
+    Slot *next_slab_;
+    std::size_t capacity_; // in slots, header slot included
+  };
+
+  union Slot {
+    Slot *next_free_;
+    Slab_Header header_;
+    alignas(NodeT) unsigned char storage_[sizeof(NodeT)];
+  };
+  static_assert(sizeof(Slot) >= sizeof(Slab_Header), "slot can't hold slab header");
+
+  using slot_alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<Slot>;
+  using slot_traits = std::allocator_traits<slot_alloc_t>;
+
+  static constexpr std::size_t MIN_SLAB_CAPACITY = 32;
+  static constexpr std::size_t MAX_SLAB_CAPACITY = 4096;
+
+  // Slabs given over to shared ownership. Keepers are immutable and refer to
+  // older ones through parents_, so nodes moved back and forth between pools
+  // make no cycles. The slabs are freed with the last reference.
+  struct Slab_Keeper {
+    slot_alloc_t alloc_;
+    Slot *slabs_;
+    std::shared_ptr<void> parents_[2];
+
+    Slab_Keeper(const slot_alloc_t &alloc, Slot *slabs, std::shared_ptr<void> older, std::shared_ptr<void> adopted) noexcept
+      : alloc_(alloc), slabs_(slabs), parents_{std::move(older), std::move(adopted)} {}
+    Slab_Keeper(const Slab_Keeper &other) = delete;
+    Slab_Keeper& operator= (const Slab_Keeper &rhs) = delete;
+    ~Slab_Keeper() {
+      free_slabs(alloc_, slabs_);
+    }
+  };
+
+  slot_alloc_t alloc_;
+  Slot *slabs_ = nullptr;     // list of slabs, linked through their header slots
+  Slot *slabs_tail_ = nullptr;
+  Slot *free_ = nullptr;      // list of recycled slots
+  Slot *free_tail_ = nullptr;
+  Slot *bump_ = nullptr;      // next never used slot of the newest slab
+  Slot *bump_end_ = nullptr;
+  std::size_t next_capacity_ = MIN_SLAB_CAPACITY;
+  std::shared_ptr<void> keeper_;  // slabs shared before, they are no longer in slabs_
+  const void *adopted_ = nullptr; // keeper of another pool adopted last, not adopted twice in a row
+#ifdef SEARCHTREES_STATS
+  std::uint64_t created_ = 0; // lifetime counters, not reset by release()
+  std::uint64_t destroyed_ = 0;
+#endif
+
+  static void free_slabs(slot_alloc_t &alloc, Slot *slabs) noexcept {
+    for (Slot *slab = slabs; slab != nullptr;) {
+      Slot *next = slab->header_.next_slab_;
+      slot_traits::deallocate(alloc, slab, slab->header_.capacity_);
+      slab = next;
+    }
+  }
+
+  void add_slab(std::size_t min_capacity = 0) {
+    std::size_t capacity = std::max(next_capacity_, min_capacity);
+    Slot *slab = slot_traits::allocate(alloc_, capacity);
+    slab->header_ = Slab_Header{slabs_, capacity};
+    if (!slabs_)
+      slabs_tail_ = slab;
+    slabs_ = slab;
+    bump_ = slab + 1;
+    bump_end_ = slab + capacity;
+    if (next_capacity_ < MAX_SLAB_CAPACITY)
+      next_capacity_ *= 2;
+  }
+
+public: // ctors & dtors
+  explicit Node_Pool(const Alloc &alloc = Alloc{}) noexcept : alloc_(alloc) {}
+  ~Node_Pool() {
+    release();
+  }
+  Node_Pool(const Node_Pool &other) = delete;
+  Node_Pool(Node_Pool &&other) noexcept
+    : alloc_(std::move(other.alloc_))
+    , slabs_(other.slabs_)
+    , slabs_tail_(other.slabs_tail_)
+    , free_(other.free_)
+    , free_tail_(other.free_tail_)
+    , bump_(other.bump_)
+    , bump_end_(other.bump_end_)
+    , next_capacity_(other.next_capacity_)
+    , keeper_(std::move(other.keeper_))
+    , adopted_(other.adopted_)
+  {
+#ifdef SEARCHTREES_STATS
+    std::swap(created_, other.created_);
+    std::swap(destroyed_, other.destroyed_);
+#endif
+    other.reset();
+  }
+  Node_Pool& operator= (const Node_Pool &rhs) = delete;
+  Node_Pool& operator= (Node_Pool &&rhs) = delete;
+
+  void swap(Node_Pool &other) noexcept {
+    using std::swap;
+    swap(alloc_, other.alloc_);
+    swap(slabs_, other.slabs_);
+    swap(slabs_tail_, other.slabs_tail_);
+    swap(free_, other.free_);
+    swap(free_tail_, other.free_tail_);
+    swap(bump_, other.bump_);
+    swap(bump_end_, other.bump_end_);
+    swap(next_capacity_, other.next_capacity_);
+    swap(keeper_, other.keeper_);
+    swap(adopted_, other.adopted_);
+#ifdef SEARCHTREES_STATS
+    swap(created_, other.created_);
+    swap(destroyed_, other.destroyed_);
+#endif
+  }
+
+public: // allocation
+  Alloc get_allocator() const { return Alloc(alloc_); }
+
+  void *allocate() {
+    if (free_) {
+      Slot *slot = free_;
+      free_ = slot->next_free_;
+      if (!free_)
+        free_tail_ = nullptr;
+      return slot->storage_;
+    }
+    if (bump_ == bump_end_)
+      add_slab();
+    return (bump_++)->storage_;
+  }
+
+  void deallocate(void *ptr) noexcept {
+    assert(ptr);
+    Slot *slot = reinterpret_cast<Slot*>(ptr);
+    slot->next_free_ = free_;
+    if (!free_)
+      free_tail_ = slot;
+    free_ = slot;
+  }
+
+  // Makes the next n allocations that are not served by the free list
+  // come from one contiguous block.
+  void reserve(std::size_t n) {
+    if (static_cast<std::size_t>(bump_end_ - bump_) < n)
+      add_slab(n + 1);
+  }
+
+  template <typename... Args>
+  NodeT *create(Args&&... args) {
+    void *mem = allocate();
+    try {
+      NodeT *node = ::new (mem) NodeT(std::forward<Args>(args)...);
+#ifdef SEARCHTREES_STATS
+      ++created_;
+#endif
+      return node;
+    } catch (...) {
+      deallocate(mem);
+      throw;
+    }
+  }
+
+  void destroy(NodeT *node) noexcept {
+    node->~NodeT();
+    deallocate(node);
+#ifdef SEARCHTREES_STATS
+    ++destroyed_;
+#endif
+  }
+
+#ifdef SEARCHTREES_STATS
+  std::uint64_t created() const noexcept { return created_; }
+  std::uint64_t destroyed() const noexcept { return destroyed_; }
+#endif
+
+  // Returns memory of every slab to the allocator. Destructors are not called,
+  // the owner is responsible for destroying live nodes beforehand if needed.
+  // Shared slabs stay until their last reference is dropped.
+  void release() noexcept {
+    free_slabs(alloc_, slabs_);
+#ifdef SEARCHTREES_STATS
+    destroyed_ = created_; // nodes left in the slabs are dropped with them
+#endif
+    reset();
+  }
+
+  // Gives the slabs over to shared ownership and returns the reference that keeps
+  // all memory of *this alive, so a node carved out of it may be handed out of
+  // the pool, e.g. by a node handle. The pool goes on allocating from the slabs.
+  std::shared_ptr<void> share_slabs() {
+    if (slabs_ || !keeper_) {
+      keeper_ = std::allocate_shared<Slab_Keeper>(alloc_, alloc_, slabs_, keeper_, nullptr);
+      slabs_ = slabs_tail_ = nullptr;
+    }
+    return keeper_;
+  }
+
+  // Keeps memory shared by another pool as long as *this, so that nodes handed
+  // out of it may be owned by *this. Allocators must compare equal.
+  void adopt_slabs(const std::shared_ptr<void> &slabs) {
+    if (!slabs || slabs == keeper_ || slabs.get() == adopted_)
+      return;
+    keeper_ = keeper_ ? std::allocate_shared<Slab_Keeper>(alloc_, alloc_, nullptr, keeper_, slabs) : slabs;
+    adopted_ = slabs.get();
+  }
+
+  // Takes over all slabs and free slots of `other` in O(1), so nodes allocated
+  // by `other` become owned by *this. Allocators must compare equal.
+  // The free list of `other` may contain slots of slabs owned by *this.
+  // Throws only if both pools have shared slabs, before anything is moved.
+  void splice(Node_Pool &other) {
+    assert(alloc_ == other.alloc_);
+    adopt_slabs(other.keeper_);
+    if (other.slabs_) {
+      other.slabs_tail_->header_.next_slab_ = slabs_;
+      if (!slabs_)
+        slabs_tail_ = other.slabs_tail_;
+      slabs_ = other.slabs_;
+    }
+
+    if (other.free_) {
+      other.free_tail_->next_free_ = free_;
+      if (!free_)
+        free_tail_ = other.free_tail_;
+      free_ = other.free_;
+    }
+    // the rest of the newest slab of `other` is left unused until release()
+#ifdef SEARCHTREES_STATS
+    created_ += other.created_;
+    destroyed_ += other.destroyed_;
+    other.created_ = other.destroyed_ = 0;
+#endif
+    other.reset();
+  }
+
+private:
+  void reset() noexcept {
+    slabs_ = slabs_tail_ = free_ = free_tail_ = bump_ = bump_end_ = nullptr;
+    next_capacity_ = MIN_SLAB_CAPACITY;
+    keeper_.reset();
+    adopted_ = nullptr;
+  }
+};
+
+} // SearchTrees
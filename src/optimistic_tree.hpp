@@ -0,0 +1,770 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cassert>
+
+#include "epoch.hpp"
+
+namespace SearchTrees {
+
+// Test-and-test-and-set lock small enough to live in every node
+class Spin_Lock {
+  std::atomic<bool> locked_{false};
+
+public:
+  void lock() noexcept {
+    while (locked_.exchange(true, std::memory_order_acquire)) {
+      while (locked_.load(std::memory_order_relaxed))
+        std::this_thread::yield();
+    }
+  }
+  void unlock() noexcept { locked_.store(false, std::memory_order_release); }
+};
+
+// Links of Optimistic_Tree nodes, the root holder of the tree has no key.
+// Children are changed under the lock of the node, parent_ under the lock
+// of the old or the new parent.
+struct Optimistic_Node_Base {
+  std::atomic<std::uint64_t> version_{0};
+  std::atomic<int> height_{1};
+  std::atomic<Optimistic_Node_Base*> parent_{nullptr}, left_{nullptr}, right_{nullptr};
+  std::atomic<bool> present_{true}; // false for routing nodes, which only direct searches
+  Spin_Lock lock_;
+  // retirement, under the mutex of the retired list
+  Optimistic_Node_Base *next_retired_ = nullptr;
+  std::uint64_t retired_epoch_ = 0;
+
+  std::atomic<Optimistic_Node_Base*> &child(bool left) noexcept { return left ? left_ : right_; }
+};
+
+template <typename KeyT>
+struct Optimistic_Node final : Optimistic_Node_Base {
+  const KeyT key_;
+
+  explicit Optimistic_Node(const KeyT &key) : key_(key) {}
+};
+
+
+// AVL tree for concurrent writers after Bronson et al., "A Practical Concurrent
+// Binary Search Tree". Descents take no locks: each node carries a version that
+// is changed when its subtree shrinks by a rotation, and a descent validates the
+// version of the parent after reading the child and retries if it changed.
+// Locks are taken only on the nodes changed by a link, an unlink or a rotation,
+// parents before children, so writers of disjoint keys proceed in parallel.
+// Erasing a key with two children only marks its node as a routing node, the
+// node is unlinked when it loses a child. Balance is relaxed: heights are fixed
+// bottom-up after a change and the tree is a strict AVL tree whenever no
+// operation is in progress. Unlinked nodes are freed through epochs.
+// Alloc is used by several threads at once and must allow that.
+template <typename KeyT, typename Compare = std::less<KeyT>, typename Alloc = std::allocator<KeyT>>
+class Optimistic_Tree {
+  using base_t = Optimistic_Node_Base;
+  using node_t = Optimistic_Node<KeyT>;
+  using node_alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<node_t>;
+  using node_traits = std::allocator_traits<node_alloc_t>;
+  using lock_t = std::lock_guard<Spin_Lock>;
+
+public:
+  using key_type = KeyT;
+  using value_type = KeyT;
+  using key_compare = Compare;
+  using size_type = std::size_t;
+
+private:
+  // version_ bits, the rest counts shrinks
+  static constexpr std::uint64_t UNLINKED = 1;
+  static constexpr std::uint64_t SHRINKING = 2;
+  static constexpr std::uint64_t SHRINK_COUNT_INCR = 4;
+
+  // node_condition() returns one of these or the height the node should have
+  static constexpr int UNLINK_REQUIRED = -1;
+  static constexpr int REBALANCE_REQUIRED = -2;
+  static constexpr int NOTHING_REQUIRED = -3;
+
+  enum class Outcome { FAILED, DONE, RETRY };
+
+  // retired nodes are freed in batches
+  static constexpr size_type RECLAIM_THRESHOLD = 256;
+  // threads retire to the list their id hashes to
+  static constexpr std::size_t RETIRED_LISTS = 64;
+
+  // Nodes retired by the threads of one hash, newest first.
+  // The mutex is only contended when two writers share the list.
+  struct alignas(64) Retired_List {
+    std::mutex mutex_;
+    base_t *head_ = nullptr;
+    size_type count_ = 0;
+  };
+
+  base_t holder_; // the root is holder_.right_
+  std::atomic<size_type> size_{0};
+  mutable Epoch_Domain epochs_;
+  node_alloc_t alloc_;
+  Compare comp_;
+  Retired_List retired_[RETIRED_LISTS];
+
+private: // memory
+  static const KeyT &key_of(const base_t *node) noexcept { return static_cast<const node_t*>(node)->key_; }
+
+  node_t *create_node(const KeyT &key) {
+    node_t *node = node_traits::allocate(alloc_, 1);
+    try {
+      node_traits::construct(alloc_, node, key);
+    } catch (...) {
+      node_traits::deallocate(alloc_, node, 1);
+      throw;
+    }
+    return node;
+  }
+
+  void destroy_node(base_t *node) noexcept {
+    node_t *key_node = static_cast<node_t*>(node);
+    node_traits::destroy(alloc_, key_node);
+    node_traits::deallocate(alloc_, key_node, 1);
+  }
+
+  Retired_List &own_retired() noexcept {
+    static thread_local const std::size_t index =
+      std::hash<std::thread::id>{}(std::this_thread::get_id()) % RETIRED_LISTS;
+    return retired_[index];
+  }
+
+  // Called right after the unlink. The node is stamped with the current epoch,
+  // readers pinned at it or before may still hold the node.
+  void retire(base_t *node) noexcept {
+    Retired_List &list = own_retired();
+    std::lock_guard<std::mutex> lock{list.mutex_};
+    node->retired_epoch_ = epochs_.current();
+    node->next_retired_ = list.head_;
+    list.head_ = node;
+    ++list.count_;
+  }
+
+  // Frees the nodes retired by this thread that no pinned thread can see.
+  // The epoch is advanced first, so readers pinning from now on don't hold back
+  // the nodes retired so far. Stamps only grow, the list is cut after the newest
+  // node stamped before every pinned epoch.
+  void reclaim() noexcept {
+    Retired_List &list = own_retired();
+    base_t *dead = nullptr;
+    {
+      std::lock_guard<std::mutex> lock{list.mutex_};
+      if (list.count_ < RECLAIM_THRESHOLD)
+        return;
+      epochs_.advance();
+      std::uint64_t min_pinned = epochs_.min_pinned();
+      base_t **link = &list.head_;
+      while (*link && (*link)->retired_epoch_ >= min_pinned)
+        link = &(*link)->next_retired_;
+      dead = *link;
+      *link = nullptr;
+      for (base_t *it = dead; it; it = it->next_retired_)
+        --list.count_;
+    }
+    while (dead) {
+      base_t *next = dead->next_retired_;
+      destroy_node(dead);
+      dead = next;
+    }
+  }
+
+private: // balance
+  static int height(const base_t *node) noexcept {
+    return node ? node->height_.load() : 0;
+  }
+
+  static void wait_until_not_changing(const base_t *node) noexcept {
+    while (node->version_.load() & SHRINKING)
+      std::this_thread::yield();
+  }
+
+  static int node_condition(base_t *node) noexcept {
+    base_t *left = node->left_, *right = node->right_;
+    if ((!left || !right) && !node->present_)
+      return UNLINK_REQUIRED;
+    int node_height = node->height_, left_height = height(left), right_height = height(right);
+    int new_height = 1 + std::max(left_height, right_height);
+    int balance = left_height - right_height;
+    if (balance < -1 || balance > 1)
+      return REBALANCE_REQUIRED;
+    return (node_height != new_height) ? new_height : NOTHING_REQUIRED;
+  }
+
+  // Fixes the height of the locked node, returns the node to check next:
+  // itself if it needs a rotation or an unlink, otherwise its parent
+  static base_t *fix_height_nl(base_t *node) noexcept {
+    int condition = node_condition(node);
+    switch (condition) {
+      case REBALANCE_REQUIRED:
+      case UNLINK_REQUIRED:
+        return node;
+      case NOTHING_REQUIRED:
+        return node->parent_;
+      default:
+        node->height_ = condition;
+        return node->parent_;
+    }
+  }
+
+  // Both nodes are locked. Fails if node isn't a child of parent or has two children.
+  bool attempt_unlink_nl(base_t *parent, base_t *node) noexcept {
+    base_t *parent_left = parent->left_, *parent_right = parent->right_;
+    if (parent_left != node && parent_right != node)
+      return false;
+    base_t *left = node->left_, *right = node->right_;
+    if (left && right)
+      return false;
+
+    base_t *splice = left ? left : right;
+    if (parent_left == node)
+      parent->left_ = splice;
+    else
+      parent->right_ = splice;
+    if (splice)
+      splice->parent_ = parent;
+    node->version_ = UNLINKED;
+    node->present_ = false;
+    retire(node);
+    return true;
+  }
+
+  // Repairs damage from node up to the root, taking locks only on nodes being fixed.
+  // A rotation may damage several nodes of one path, so the walk doesn't stop at
+  // the first undamaged node, an unlinked node is left to the thread that unlinked it.
+  void fix_height_and_rebalance(base_t *node) noexcept {
+    while (node && node->parent_.load()) { // the holder has no parent
+      int condition = node_condition(node);
+      if (node->version_ & UNLINKED)
+        return;
+
+      if (condition == NOTHING_REQUIRED) {
+        node = node->parent_;
+      } else if (condition != UNLINK_REQUIRED && condition != REBALANCE_REQUIRED) {
+        lock_t lock{node->lock_};
+        node = fix_height_nl(node);
+      } else {
+        base_t *parent = node->parent_;
+        lock_t parent_lock{parent->lock_};
+        if (!(parent->version_ & UNLINKED) && node->parent_ == parent) {
+          lock_t lock{node->lock_};
+          node = rebalance_nl(parent, node);
+        } // else retry with the new parent
+      }
+    }
+  }
+
+  // parent and node are locked, returns the node to check next
+  base_t *rebalance_nl(base_t *parent, base_t *node) noexcept {
+    base_t *left = node->left_, *right = node->right_;
+    if ((!left || !right) && !node->present_)
+      return attempt_unlink_nl(parent, node) ? fix_height_nl(parent) : node;
+
+    int node_height = node->height_, left_height = height(left), right_height = height(right);
+    int new_height = 1 + std::max(left_height, right_height);
+    int balance = left_height - right_height;
+    if (balance > 1)
+      return rebalance_to_right_nl(parent, node, left, right_height);
+    if (balance < -1)
+      return rebalance_to_left_nl(parent, node, right, left_height);
+    if (new_height != node_height) {
+      node->height_ = new_height;
+      return fix_height_nl(parent);
+    }
+    return parent;
+  }
+
+  // Left subtree is too high: rotate right, or left-right if left->right_ is higher
+  base_t *rebalance_to_right_nl(base_t *parent, base_t *node, base_t *left, int right_height) noexcept {
+    lock_t left_lock{left->lock_};
+    int left_height = left->height_;
+    if (left_height - right_height <= 1)
+      return node; // changed meanwhile, retry
+
+    base_t *left_right = left->right_;
+    int ll_height = height(left->left_), lr_height = height(left_right);
+    if (ll_height >= lr_height)
+      return rotate_right_nl(parent, node, left, right_height, ll_height, left_right, lr_height);
+
+    {
+      lock_t left_right_lock{left_right->lock_};
+      lr_height = left_right->height_;
+      if (ll_height >= lr_height)
+        return rotate_right_nl(parent, node, left, right_height, ll_height, left_right, lr_height);
+
+      // the double rotation must not leave the new left subtree unbalanced
+      int lrl_height = height(left_right->left_);
+      int left_balance = ll_height - lrl_height;
+      if (left_balance >= -1 && left_balance <= 1)
+        return rotate_right_over_left_nl(parent, node, left, right_height, ll_height, left_right, lrl_height);
+    }
+    // balance left first, node is repaired later
+    return rebalance_to_left_nl(node, left, left_right, ll_height);
+  }
+
+  // Mirror of rebalance_to_right_nl()
+  base_t *rebalance_to_left_nl(base_t *parent, base_t *node, base_t *right, int left_height) noexcept {
+    lock_t right_lock{right->lock_};
+    int right_height = right->height_;
+    if (left_height - right_height >= -1)
+      return node; // changed meanwhile, retry
+
+    base_t *right_left = right->left_;
+    int rl_height = height(right_left), rr_height = height(right->right_);
+    if (rr_height >= rl_height)
+      return rotate_left_nl(parent, node, left_height, right, right_left, rl_height, rr_height);
+
+    {
+      lock_t right_left_lock{right_left->lock_};
+      rl_height = right_left->height_;
+      if (rr_height >= rl_height)
+        return rotate_left_nl(parent, node, left_height, right, right_left, rl_height, rr_height);
+
+      int rlr_height = height(right_left->right_);
+      int right_balance = rr_height - rlr_height;
+      if (right_balance >= -1 && right_balance <= 1)
+        return rotate_left_over_right_nl(parent, node, left_height, right, right_left, rr_height, rlr_height);
+    }
+    return rebalance_to_right_nl(node, right, right_left, rr_height);
+  }
+
+  // Heights of the moved subtrees are the ones the decision was made with.
+  // Returns the lowest node damaged by the rotation, fixing what the held locks allow.
+  base_t *rotate_right_nl(base_t *parent, base_t *node, base_t *left, int right_height,
+                          int ll_height, base_t *left_right, int lr_height) noexcept {
+    std::uint64_t version = node->version_;
+    base_t *parent_left = parent->left_;
+    node->version_ = version | SHRINKING;
+
+    node->left_ = left_right;
+    if (left_right)
+      left_right->parent_ = node;
+    left->right_ = node;
+    node->parent_ = left;
+    if (parent_left == node)
+      parent->left_ = left;
+    else
+      parent->right_ = left;
+    left->parent_ = parent;
+
+    int node_height = 1 + std::max(lr_height, right_height);
+    node->height_ = node_height;
+    left->height_ = 1 + std::max(ll_height, node_height);
+    node->version_ = version + SHRINK_COUNT_INCR;
+
+    int node_balance = lr_height - right_height;
+    if (node_balance < -1 || node_balance > 1)
+      return node;
+    if ((!left_right || right_height == 0) && !node->present_)
+      return node;
+    int left_balance = ll_height - node_height;
+    if (left_balance < -1 || left_balance > 1)
+      return left;
+    if (ll_height == 0 && !left->present_)
+      return left;
+    return fix_height_nl(parent);
+  }
+
+  base_t *rotate_left_nl(base_t *parent, base_t *node, int left_height, base_t *right,
+                         base_t *right_left, int rl_height, int rr_height) noexcept {
+    std::uint64_t version = node->version_;
+    base_t *parent_left = parent->left_;
+    node->version_ = version | SHRINKING;
+
+    node->right_ = right_left;
+    if (right_left)
+      right_left->parent_ = node;
+    right->left_ = node;
+    node->parent_ = right;
+    if (parent_left == node)
+      parent->left_ = right;
+    else
+      parent->right_ = right;
+    right->parent_ = parent;
+
+    int node_height = 1 + std::max(left_height, rl_height);
+    node->height_ = node_height;
+    right->height_ = 1 + std::max(node_height, rr_height);
+    node->version_ = version + SHRINK_COUNT_INCR;
+
+    int node_balance = rl_height - left_height;
+    if (node_balance < -1 || node_balance > 1)
+      return node;
+    if ((!right_left || left_height == 0) && !node->present_)
+      return node;
+    int right_balance = rr_height - node_height;
+    if (right_balance < -1 || right_balance > 1)
+      return right;
+    if (rr_height == 0 && !right->present_)
+      return right;
+    return fix_height_nl(parent);
+  }
+
+  base_t *rotate_right_over_left_nl(base_t *parent, base_t *node, base_t *left, int right_height,
+                                    int ll_height, base_t *left_right, int lrl_height) noexcept {
+    std::uint64_t node_version = node->version_, left_version = left->version_;
+    base_t *parent_left = parent->left_;
+    base_t *lrl = left_right->left_, *lrr = left_right->right_;
+    int lrr_height = height(lrr);
+    node->version_ = node_version | SHRINKING;
+    left->version_ = left_version | SHRINKING;
+
+    node->left_ = lrr;
+    if (lrr)
+      lrr->parent_ = node;
+    left->right_ = lrl;
+    if (lrl)
+      lrl->parent_ = left;
+    left_right->left_ = left;
+    left->parent_ = left_right;
+    left_right->right_ = node;
+    node->parent_ = left_right;
+    if (parent_left == node)
+      parent->left_ = left_right;
+    else
+      parent->right_ = left_right;
+    left_right->parent_ = parent;
+
+    int node_height = 1 + std::max(lrr_height, right_height);
+    node->height_ = node_height;
+    int left_height = 1 + std::max(ll_height, lrl_height);
+    left->height_ = left_height;
+    left_right->height_ = 1 + std::max(left_height, node_height);
+    node->version_ = node_version + SHRINK_COUNT_INCR;
+    left->version_ = left_version + SHRINK_COUNT_INCR;
+
+    // a routing node left with one child is unlinked while its new parent is locked,
+    // so only one damaged path remains to repair
+    if (!left->present_ && (!left->left_.load() || !lrl)) {
+      attempt_unlink_nl(left_right, left);
+      left_height = height(left_right->left_);
+      left_right->height_ = 1 + std::max(left_height, node_height);
+    }
+
+    int node_balance = lrr_height - right_height;
+    if (node_balance < -1 || node_balance > 1)
+      return node;
+    if ((!lrr || right_height == 0) && !node->present_)
+      return node;
+    int top_balance = left_height - node_height;
+    if (top_balance < -1 || top_balance > 1)
+      return left_right;
+    return fix_height_nl(parent);
+  }
+
+  base_t *rotate_left_over_right_nl(base_t *parent, base_t *node, int left_height, base_t *right,
+                                    base_t *right_left, int rr_height, int rlr_height) noexcept {
+    std::uint64_t node_version = node->version_, right_version = right->version_;
+    base_t *parent_left = parent->left_;
+    base_t *rll = right_left->left_, *rlr = right_left->right_;
+    int rll_height = height(rll);
+    node->version_ = node_version | SHRINKING;
+    right->version_ = right_version | SHRINKING;
+
+    node->right_ = rll;
+    if (rll)
+      rll->parent_ = node;
+    right->left_ = rlr;
+    if (rlr)
+      rlr->parent_ = right;
+    right_left->right_ = right;
+    right->parent_ = right_left;
+    right_left->left_ = node;
+    node->parent_ = right_left;
+    if (parent_left == node)
+      parent->left_ = right_left;
+    else
+      parent->right_ = right_left;
+    right_left->parent_ = parent;
+
+    int node_height = 1 + std::max(left_height, rll_height);
+    node->height_ = node_height;
+    int right_height = 1 + std::max(rlr_height, rr_height);
+    right->height_ = right_height;
+    right_left->height_ = 1 + std::max(node_height, right_height);
+    node->version_ = node_version + SHRINK_COUNT_INCR;
+    right->version_ = right_version + SHRINK_COUNT_INCR;
+
+    if (!right->present_ && (!right->right_.load() || !rlr)) {
+      attempt_unlink_nl(right_left, right);
+      right_height = height(right_left->right_);
+      right_left->height_ = 1 + std::max(node_height, right_height);
+    }
+
+    int node_balance = rll_height - left_height;
+    if (node_balance < -1 || node_balance > 1)
+      return node;
+    if ((!rll || left_height == 0) && !node->present_)
+      return node;
+    int top_balance = right_height - node_height;
+    if (top_balance < -1 || top_balance > 1)
+      return right_left;
+    return fix_height_nl(parent);
+  }
+
+private: // updates
+  // node has key, parent was its parent when node was validated
+  Outcome attempt_node_update(bool insert, base_t *parent, base_t *node) noexcept {
+    if (insert) {
+      if (node->present_)
+        return Outcome::FAILED;
+      lock_t lock{node->lock_};
+      if (node->version_ & UNLINKED)
+        return Outcome::RETRY;
+      if (node->present_)
+        return Outcome::FAILED;
+      node->present_ = true;
+      return Outcome::DONE;
+    }
+
+    if (!node->present_)
+      return Outcome::FAILED;
+    if (node->left_ && node->right_) { // becomes a routing node
+      lock_t lock{node->lock_};
+      if (node->version_ & UNLINKED)
+        return Outcome::RETRY;
+      if (!node->present_)
+        return Outcome::FAILED;
+      if (!node->left_ || !node->right_)
+        return Outcome::RETRY; // has to be unlinked, which needs the parent lock
+      node->present_ = false;
+      return Outcome::DONE;
+    }
+
+    base_t *damaged = nullptr;
+    {
+      lock_t parent_lock{parent->lock_};
+      if ((parent->version_ & UNLINKED) || node->parent_ != parent)
+        return Outcome::RETRY;
+      {
+        lock_t lock{node->lock_};
+        if (!node->present_)
+          return Outcome::FAILED;
+        if (!attempt_unlink_nl(parent, node))
+          return Outcome::RETRY;
+      }
+      damaged = fix_height_nl(parent);
+    }
+    fix_height_and_rebalance(damaged);
+    return Outcome::DONE;
+  }
+
+  // One optimistic descent from the root. new_node is created on the first
+  // attempt to link it and is kept for retries, ownership passes to the tree on success.
+  Outcome attempt_update(const KeyT &key, bool insert, node_t *&new_node) {
+    base_t *parent = &holder_;
+    base_t *node = holder_.right_;
+    if (!node) {
+      if (!insert)
+        return Outcome::FAILED;
+      if (!new_node)
+        new_node = create_node(key);
+      lock_t lock{holder_.lock_};
+      if (holder_.right_.load())
+        return Outcome::RETRY;
+      new_node->parent_ = &holder_;
+      holder_.right_ = new_node;
+      holder_.height_ = 2;
+      new_node = nullptr;
+      return Outcome::DONE;
+    }
+
+    std::uint64_t version = node->version_;
+    if (version & (SHRINKING | UNLINKED)) {
+      wait_until_not_changing(node);
+      return Outcome::RETRY;
+    }
+    if (node != holder_.right_.load())
+      return Outcome::RETRY;
+
+    for (;;) { // node is validated with version, parent is its parent
+      bool left;
+      if (comp_(key, key_of(node)))
+        left = true;
+      else if (comp_(key_of(node), key))
+        left = false;
+      else
+        return attempt_node_update(insert, parent, node);
+
+      for (;;) {
+        base_t *child = node->child(left);
+        if (node->version_ != version)
+          return Outcome::RETRY;
+
+        if (!child) {
+          if (!insert)
+            return Outcome::FAILED;
+          if (!new_node)
+            new_node = create_node(key);
+          base_t *damaged = nullptr;
+          {
+            lock_t lock{node->lock_};
+            if (node->version_ != version)
+              return Outcome::RETRY;
+            if (node->child(left).load())
+              continue; // lost the race for the link
+            new_node->parent_ = node;
+            node->child(left) = new_node;
+            new_node = nullptr;
+            damaged = fix_height_nl(node);
+          }
+          fix_height_and_rebalance(damaged);
+          return Outcome::DONE;
+        }
+
+        std::uint64_t child_version = child->version_;
+        if (child_version & (SHRINKING | UNLINKED)) {
+          wait_until_not_changing(child);
+          continue;
+        }
+        if (child != node->child(left).load())
+          continue;
+        if (node->version_ != version)
+          return Outcome::RETRY;
+        parent = node;
+        node = child;
+        version = child_version;
+        break;
+      }
+    }
+  }
+
+  bool update(const KeyT &key, bool insert) {
+    node_t *new_node = nullptr;
+    Outcome outcome;
+    try {
+      auto guard = epochs_.pin();
+      while ((outcome = attempt_update(key, insert, new_node)) == Outcome::RETRY) {}
+    } catch (...) {
+      if (new_node)
+        destroy_node(new_node);
+      throw;
+    }
+    if (new_node) // an equivalent key appeared meanwhile
+      destroy_node(new_node);
+    reclaim();
+
+    if (outcome != Outcome::DONE)
+      return false;
+    if (insert)
+      size_.fetch_add(1, std::memory_order_relaxed);
+    else
+      size_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+public: // ctors & dtors
+  Optimistic_Tree() {}
+  explicit Optimistic_Tree(const Compare &comp, const Alloc &alloc = Alloc{}) : alloc_(alloc), comp_(comp) {}
+  Optimistic_Tree(const Optimistic_Tree &other) = delete;
+  Optimistic_Tree& operator= (const Optimistic_Tree &rhs) = delete;
+  // No thread may use the tree during destruction
+  ~Optimistic_Tree() {
+    std::vector<base_t*> stack;
+    if (base_t *root = holder_.right_)
+      stack.push_back(root);
+    while (!stack.empty()) {
+      base_t *node = stack.back();
+      stack.pop_back();
+      if (base_t *left = node->left_)
+        stack.push_back(left);
+      if (base_t *right = node->right_)
+        stack.push_back(right);
+      destroy_node(node);
+    }
+    for (Retired_List &list : retired_) {
+      while (list.head_) {
+        base_t *next = list.head_->next_retired_;
+        destroy_node(list.head_);
+        list.head_ = next;
+      }
+    }
+  }
+
+public: // selectors
+  // Approximate while writers are running
+  size_type size() const noexcept { return size_.load(std::memory_order_relaxed); }
+  bool empty() const noexcept { return size() == 0; }
+
+  bool contains(const KeyT &key) const {
+    auto guard = epochs_.pin();
+    for (;;) { // retry from the root
+      base_t *node = const_cast<base_t*>(&holder_);
+      std::uint64_t version = node->version_;
+      bool left = false;
+      for (;;) {
+        base_t *child = node->child(left);
+        if (node->version_ != version)
+          break;
+        if (!child)
+          return false;
+        if (!comp_(key, key_of(child)) && !comp_(key_of(child), key))
+          return child->present_;
+
+        std::uint64_t child_version = child->version_;
+        if (child_version & (SHRINKING | UNLINKED)) {
+          wait_until_not_changing(child);
+          continue;
+        }
+        if (child != node->child(left).load())
+          continue;
+        if (node->version_ != version)
+          break;
+        node = child;
+        version = child_version;
+        left = comp_(key, key_of(node));
+      }
+    }
+  }
+
+  // Checks links, order, heights and balance, and that routing nodes have two children.
+  // Only valid while no other thread uses the tree.
+  bool check_invariants() const {
+    struct Frame {
+      const base_t *node_;
+      const base_t *parent_;
+    };
+    std::vector<Frame> stack;
+    const base_t *prev = nullptr; // in-order predecessor
+    size_type present = 0;
+    bool ok = true;
+
+    // in-order walk, the stored height of every node is compared with its children
+    const base_t *node = holder_.right_;
+    const base_t *parent = &holder_;
+    while (node || !stack.empty()) {
+      for (; node; node = node->left_) {
+        stack.push_back({node, parent});
+        parent = node;
+      }
+      Frame frame = stack.back();
+      stack.pop_back();
+      const base_t *it = frame.node_;
+      ok = ok && it->parent_.load() == frame.parent_ && !(it->version_ & (UNLINKED | SHRINKING));
+      ok = ok && (!prev || comp_(key_of(prev), key_of(it)));
+      ok = ok && (it->present_ || (it->left_ && it->right_));
+      int left_height = height(it->left_), right_height = height(it->right_);
+      ok = ok && it->height_ == 1 + std::max(left_height, right_height);
+      ok = ok && left_height - right_height <= 1 && right_height - left_height <= 1;
+      present += it->present_;
+      prev = it;
+      parent = it;
+      node = it->right_;
+    }
+    return ok && present == size();
+  }
+
+public: // modifiers
+  // Return whether the key was inserted or erased
+  bool insert(const KeyT &key) { return update(key, true); }
+  bool erase(const KeyT &key) { return update(key, false); }
+};
+
+} // SearchTrees
@@ -0,0 +1,470 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <cassert>
+
+#include "tree.hpp"
+
+namespace SearchTrees {
+
+// Node of Persistent_Tree. Nodes are immutable once linked and may be shared
+// by several versions, so there are no parent links and the number of
+// parents and versions referring to the node is counted.
+template <typename KeyT>
+struct Persistent_Node final {
+  const Persistent_Node *left_ = nullptr, *right_ = nullptr;
+  KeyT key_;
+  avl_height_t height_ = 1;
+  mutable std::atomic<std::uint32_t> refs_{1};
+
+  template <typename K>
+  Persistent_Node(const Persistent_Node *left, K &&key, const Persistent_Node *right)
+    : left_(left)
+    , right_(right)
+    , key_(std::forward<K>(key)) {}
+  Persistent_Node(const Persistent_Node &other) = delete;
+  Persistent_Node(Persistent_Node &&other) = delete;
+  Persistent_Node& operator= (const Persistent_Node &rhs) = delete;
+  Persistent_Node& operator= (Persistent_Node &&rhs) = delete;
+  ~Persistent_Node() = default;
+};
+
+
+// AVL tree with path copying. insert() and erase() build new nodes only for the
+// path from the root to the changed node and share the rest with the previous
+// version, so copies and snapshot() take O(1) and every version stays valid
+// while modifications go on in another one.
+// Reference counts are atomic: versions may be released in any thread.
+// A single version is not synchronized, snapshot() of a tree modified by another
+// thread has to be taken under the same lock as the modifications.
+// Nodes are allocated by Alloc directly, because a node lives as long as any
+// version refers to it. Copies of the allocator must compare equal.
+template <typename KeyT, typename Compare = std::less<KeyT>, typename Alloc = std::allocator<KeyT>>
+class Persistent_Tree {
+  using node_t = Persistent_Node<KeyT>;
+  using node_alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<node_t>;
+  using node_traits = std::allocator_traits<node_alloc_t>;
+
+  // AVL tree of height h has at least Fib(h + 2) - 1 nodes, so it can't be higher than this
+  static constexpr int MAX_HEIGHT = 96;
+
+public:
+  using key_type = KeyT;
+  using value_type = KeyT;
+  using key_compare = Compare;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = const KeyT &;
+  using const_reference = const KeyT &;
+
+private:
+  const node_t *root_ = nullptr;
+  size_type size_ = 0;
+  node_alloc_t alloc_;
+  Compare comp_;
+
+private: // reference counting
+  // Owns one reference to a node, releases it unless moved out
+  class Node_Ref {
+    Persistent_Tree *tree_;
+    const node_t *node_;
+
+  public:
+    Node_Ref(Persistent_Tree *tree, const node_t *node) noexcept : tree_(tree), node_(node) {}
+    Node_Ref(Node_Ref &&other) noexcept : tree_(other.tree_), node_(other.node_) { other.node_ = nullptr; }
+    Node_Ref& operator= (Node_Ref &&rhs) noexcept {
+      std::swap(node_, rhs.node_);
+      return *this;
+    }
+    ~Node_Ref() { tree_->release(node_); }
+    Node_Ref(const Node_Ref &other) = delete;
+    Node_Ref& operator= (const Node_Ref &rhs) = delete;
+
+    const node_t *get() const noexcept { return node_; }
+    const node_t *operator->() const noexcept { return node_; }
+    const node_t *take() noexcept {
+      const node_t *node = node_;
+      node_ = nullptr;
+      return node;
+    }
+  };
+
+  static const node_t *acquire(const node_t *node) noexcept {
+    if (node)
+      node->refs_.fetch_add(1, std::memory_order_relaxed);
+    return node;
+  }
+
+  Node_Ref share(const node_t *node) noexcept { return Node_Ref{this, acquire(node)}; }
+
+  // Drops one reference, nodes nobody refers to are destroyed together
+  // with the references they hold. Dead nodes wait on a stack, which never
+  // holds more than one pending sibling per level.
+  void release(const node_t *node) noexcept {
+    const node_t *dead[2 * MAX_HEIGHT];
+    int top = 0;
+    auto drop = [&dead, &top](const node_t *it) {
+      if (it && it->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        assert(top < 2 * MAX_HEIGHT);
+        dead[top++] = it;
+      }
+    };
+
+    drop(node);
+    while (top > 0) {
+      node_t *it = const_cast<node_t*>(dead[--top]);
+      drop(it->left_);
+      drop(it->right_);
+      node_traits::destroy(alloc_, it);
+      node_traits::deallocate(alloc_, it, 1);
+    }
+  }
+
+private: // path copying
+  static int height(const node_t *node) noexcept {
+    return node ? node->height_ : 0;
+  }
+
+  // New node taking over the references of `left` and `right`
+  template <typename K>
+  Node_Ref make_node(Node_Ref left, K &&key, Node_Ref right) {
+    node_t *node = node_traits::allocate(alloc_, 1);
+    try {
+      node_traits::construct(alloc_, node, left.get(), std::forward<K>(key), right.get());
+    } catch (...) {
+      node_traits::deallocate(alloc_, node, 1);
+      throw;
+    }
+    left.take();
+    right.take();
+    node->height_ = static_cast<avl_height_t>(std::max(height(node->left_), height(node->right_)) + 1);
+    return Node_Ref{this, node};
+  }
+
+  // Node with `key` over subtrees whose heights differ by at most 2,
+  // rebalanced by a single or double rotation made of new nodes.
+  Node_Ref balance(Node_Ref left, const KeyT &key, Node_Ref right) {
+    int left_height = height(left.get()), right_height = height(right.get());
+
+    if (left_height > right_height + 1) { // left heavy
+      const node_t *ll = left->left_, *lr = left->right_;
+      if (height(ll) >= height(lr)) { // rotate right
+        Node_Ref new_right = make_node(share(lr), key, std::move(right));
+        return make_node(share(ll), left->key_, std::move(new_right));
+      }
+      // rotate left-right, lr becomes the root
+      Node_Ref new_left = make_node(share(ll), left->key_, share(lr->left_));
+      Node_Ref new_right = make_node(share(lr->right_), key, std::move(right));
+      return make_node(std::move(new_left), lr->key_, std::move(new_right));
+    }
+
+    if (right_height > left_height + 1) { // right heavy
+      const node_t *rl = right->left_, *rr = right->right_;
+      if (height(rr) >= height(rl)) { // rotate left
+        Node_Ref new_left = make_node(std::move(left), key, share(rl));
+        return make_node(std::move(new_left), right->key_, share(rr));
+      }
+      // rotate right-left, rl becomes the root
+      Node_Ref new_left = make_node(std::move(left), key, share(rl->left_));
+      Node_Ref new_right = make_node(share(rl->right_), right->key_, share(rr));
+      return make_node(std::move(new_left), rl->key_, std::move(new_right));
+    }
+
+    return make_node(std::move(left), key, std::move(right));
+  }
+
+  // Replaces the nodes of the descent path[0, depth) by new ones over `sub`,
+  // which substitutes the subtree the descent ended in.
+  Node_Ref copy_path(const node_t *const *path, const bool *went_left, int depth, Node_Ref sub) {
+    while (depth-- > 0) {
+      const node_t *node = path[depth];
+      if (went_left[depth])
+        sub = balance(std::move(sub), node->key_, share(node->right_));
+      else
+        sub = balance(share(node->left_), node->key_, std::move(sub));
+    }
+    return sub;
+  }
+
+  void set_root(Node_Ref new_root) noexcept {
+    release(root_);
+    root_ = new_root.take();
+  }
+
+public:
+  // In-order iterator. Keeps the path from the root, since nodes have no parent links.
+  // Stays valid while the version it was obtained from is not modified or destroyed.
+  class const_iterator {
+    const node_t *path_[MAX_HEIGHT];
+    int depth_ = 0; // 0 is end()
+    const node_t *root_ = nullptr;
+
+    friend class Persistent_Tree;
+    explicit const_iterator(const node_t *root) noexcept : root_(root) {}
+
+    void push_leftmost(const node_t *node) noexcept {
+      for (; node != nullptr; node = node->left_)
+        path_[depth_++] = node;
+    }
+    void push_rightmost(const node_t *node) noexcept {
+      for (; node != nullptr; node = node->right_)
+        path_[depth_++] = node;
+    }
+    const node_t *node() const noexcept { return depth_ ? path_[depth_ - 1] : nullptr; }
+
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = KeyT;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const KeyT *;
+    using reference = const KeyT &;
+
+    const_iterator() noexcept {}
+
+    reference operator*() const noexcept { return node()->key_; }
+    pointer operator->() const noexcept { return &node()->key_; }
+
+    const_iterator& operator++ () noexcept {
+      assert(depth_ > 0);
+      const node_t *node = path_[depth_ - 1];
+      if (node->right_) {
+        push_leftmost(node->right_);
+        return *this;
+      }
+      // climb while coming from the right
+      for (--depth_; depth_ > 0 && path_[depth_ - 1]->right_ == node; --depth_)
+        node = path_[depth_ - 1];
+      return *this;
+    }
+
+    const_iterator& operator-- () noexcept {
+      if (depth_ == 0) { // end()
+        push_rightmost(root_);
+        assert(depth_ > 0);
+        return *this;
+      }
+      const node_t *node = path_[depth_ - 1];
+      if (node->left_) {
+        push_rightmost(node->left_);
+        return *this;
+      }
+      // climb while coming from the left
+      for (--depth_; depth_ > 0 && path_[depth_ - 1]->left_ == node; --depth_)
+        node = path_[depth_ - 1];
+      assert(depth_ > 0); // decrement of begin()
+      return *this;
+    }
+
+    const_iterator operator++ (int) noexcept {
+      const_iterator tmp = *this;
+      ++*this;
+      return tmp;
+    }
+    const_iterator operator-- (int) noexcept {
+      const_iterator tmp = *this;
+      --*this;
+      return tmp;
+    }
+
+    bool operator== (const const_iterator &rhs) const noexcept { return node() == rhs.node(); }
+    bool operator!= (const const_iterator &rhs) const noexcept { return node() != rhs.node(); }
+  };
+  using iterator = const_iterator;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using reverse_iterator = const_reverse_iterator;
+
+public: // ctors & dtors
+  Persistent_Tree() {}
+  explicit Persistent_Tree(const Compare &comp, const Alloc &alloc = Alloc{}) : alloc_(alloc), comp_(comp) {}
+  explicit Persistent_Tree(const Alloc &alloc) : alloc_(alloc) {}
+  ~Persistent_Tree() {
+    release(root_);
+  }
+  // Shares all nodes with `other` in O(1)
+  Persistent_Tree(const Persistent_Tree &other)
+    : root_(acquire(other.root_)), size_(other.size_), alloc_(other.alloc_), comp_(other.comp_) {}
+  Persistent_Tree(Persistent_Tree &&other) noexcept
+    : root_(other.root_), size_(other.size_), alloc_(other.alloc_), comp_(other.comp_)
+  {
+    other.root_ = nullptr;
+    other.size_ = 0;
+  }
+  Persistent_Tree& operator= (const Persistent_Tree &rhs) {
+    Persistent_Tree tmp(rhs);
+    swap(tmp);
+    return *this;
+  }
+  Persistent_Tree& operator= (Persistent_Tree &&rhs) noexcept {
+    swap(rhs);
+    return *this;
+  }
+
+  void swap(Persistent_Tree &other) noexcept {
+    using std::swap;
+    swap(root_, other.root_);
+    swap(size_, other.size_);
+    swap(alloc_, other.alloc_);
+    swap(comp_, other.comp_);
+  }
+
+public: // versions
+  // Immutable point-in-time view in O(1). Changes of *this don't affect it,
+  // modifying the snapshot itself makes one more independent version.
+  Persistent_Tree snapshot() const { return Persistent_Tree(*this); }
+
+public: // iterators
+  const_iterator begin() const noexcept {
+    const_iterator it{root_};
+    it.push_leftmost(root_);
+    return it;
+  }
+  const_iterator end() const noexcept { return const_iterator{root_}; }
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+  const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator{end()}; }
+  const_reverse_iterator rend() const noexcept { return const_reverse_iterator{begin()}; }
+
+public: // selectors
+  Alloc get_allocator() const { return Alloc(alloc_); }
+  Compare key_comp() const { return comp_; }
+  bool empty() const noexcept { return !root_; }
+  size_type size() const noexcept { return size_; }
+  // Number of nodes on the path from the root to the deepest key
+  size_type height() const noexcept { return root_ ? root_->height_ : 0; }
+
+  const_iterator lower_bound(const KeyT &key) const {
+    const_iterator it{root_};
+    int found_depth = 0;
+    for (const node_t *node = root_; node != nullptr;) {
+      it.path_[it.depth_++] = node;
+      if (comp_(node->key_, key)) {
+        node = node->right_;
+      } else {
+        found_depth = it.depth_;
+        if (!comp_(key, node->key_)) // key == node->key_
+          break;
+        node = node->left_;
+      }
+    }
+    it.depth_ = found_depth;
+    return it;
+  }
+
+  const_iterator upper_bound(const KeyT &key) const {
+    const_iterator it{root_};
+    int found_depth = 0;
+    for (const node_t *node = root_; node != nullptr;) {
+      it.path_[it.depth_++] = node;
+      if (!comp_(key, node->key_)) {
+        node = node->right_;
+      } else {
+        found_depth = it.depth_;
+        node = node->left_;
+      }
+    }
+    it.depth_ = found_depth;
+    return it;
+  }
+
+  const_iterator find(const KeyT &key) const {
+    const_iterator it = lower_bound(key);
+    return (it != end() && !comp_(key, *it)) ? it : end();
+  }
+
+  bool contains(const KeyT &key) const {
+    for (const node_t *node = root_; node != nullptr;) {
+      if (comp_(key, node->key_))
+        node = node->left_;
+      else if (comp_(node->key_, key))
+        node = node->right_;
+      else
+        return true;
+    }
+    return false;
+  }
+
+public: // modifiers
+  // Invalidate iterators of *this only, other versions are untouched.
+  // On exception *this is left unchanged.
+  void clear() noexcept {
+    release(root_);
+    root_ = nullptr;
+    size_ = 0;
+  }
+
+  // Returns false if an equivalent key is already present
+  bool insert(const KeyT &key) {
+    const node_t *path[MAX_HEIGHT];
+    bool went_left[MAX_HEIGHT];
+    int depth = 0;
+    for (const node_t *node = root_; node != nullptr; ++depth) {
+      path[depth] = node;
+      if (comp_(key, node->key_)) {
+        went_left[depth] = true;
+        node = node->left_;
+      } else if (comp_(node->key_, key)) {
+        went_left[depth] = false;
+        node = node->right_;
+      } else { // key == node->key_
+        return false;
+      }
+    }
+
+    Node_Ref leaf = make_node(Node_Ref{this, nullptr}, key, Node_Ref{this, nullptr});
+    set_root(copy_path(path, went_left, depth, std::move(leaf)));
+    ++size_;
+    return true;
+  }
+
+  // Returns false if there is no equivalent key
+  bool erase(const KeyT &key) {
+    const node_t *path[MAX_HEIGHT];
+    bool went_left[MAX_HEIGHT];
+    int depth = 0;
+    const node_t *node = root_;
+    for (; node != nullptr; ++depth) {
+      path[depth] = node;
+      if (comp_(key, node->key_)) {
+        went_left[depth] = true;
+        node = node->left_;
+      } else if (comp_(node->key_, key)) {
+        went_left[depth] = false;
+        node = node->right_;
+      } else { // key == node->key_
+        break;
+      }
+    }
+    if (!node)
+      return false;
+
+    Node_Ref sub{this, nullptr};
+    if (!node->left_ || !node->right_) {
+      sub = share(node->left_ ? node->left_ : node->right_);
+    } else {
+      // the successor takes the place of the node, its own path is copied first
+      const node_t *successor_path[MAX_HEIGHT];
+      bool successor_left[MAX_HEIGHT];
+      int successor_depth = 0;
+      const node_t *successor = node->right_;
+      for (; successor->left_ != nullptr; successor = successor->left_) {
+        successor_path[successor_depth] = successor;
+        successor_left[successor_depth++] = true;
+      }
+      Node_Ref right = copy_path(successor_path, successor_left, successor_depth, share(successor->right_));
+      sub = balance(share(node->left_), successor->key_, std::move(right));
+    }
+
+    set_root(copy_path(path, went_left, depth, std::move(sub)));
+    --size_;
+    return true;
+  }
+};
+
+} // SearchTrees
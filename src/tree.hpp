@@ -1,64 +1,336 @@
 #pragma once
 
 #include <iostream>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
+#include <limits>
+#include <vector>
 #include <cassert>
 
+#include "node_pool.hpp"
+#include "fork_join_pool.hpp"
+#include "tree_stats.hpp"
+
 namespace SearchTrees {
 
+inline void prefetch(const void *ptr) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(ptr);
+#else
+  (void)ptr;
+#endif
+}
+
+// Links are kept in a non-polymorphic base parametrized by the final node type,
+// so nodes carry no vptr and the trees never cast between node types.
+template <typename NodeT>
+struct Node_Links {
+  NodeT *parent_ = nullptr, *left_ = nullptr, *right_ = nullptr;
+};
+
+
 template <typename KeyT>
-struct BST_Node {
+struct BST_Node final : public Node_Links<BST_Node<KeyT>> {
   KeyT key_;
-  BST_Node *parent_ = nullptr, *left_ = nullptr, *right_ = nullptr;
 
   explicit BST_Node(const KeyT &key) noexcept(std::is_nothrow_copy_constructible<KeyT>::value) : key_(key) {}
   explicit BST_Node(KeyT &&key) noexcept(std::is_nothrow_move_constructible<KeyT>::value) : key_(std::move(key)) {}
-  virtual ~BST_Node() = default;
+  ~BST_Node() = default;
   BST_Node(const BST_Node &other) = delete;
   BST_Node(BST_Node &&other) = delete;
   BST_Node& operator= (const BST_Node &rhs) = delete;
   BST_Node& operator= (BST_Node &&rhs) = delete;
-  virtual BST_Node *clone() const {
-    return new BST_Node<KeyT>{key_};
+  template <typename Pool>
+  BST_Node *clone(Pool &pool) const {
+    return pool.create(key_);
   }
 };
 
 
-template <typename KeyT>
-struct AVL_Node final : public BST_Node<KeyT> {
-  using BST_Node<KeyT>::key_;
+// Height of any AVL tree that fits in memory is far below 2^8,
+// a single byte fills the padding after small keys.
+using avl_height_t = std::uint8_t;
+
+// Number of nodes in the subtree, kept only by trees with order statistics.
+template <bool Enabled>
+struct Subtree_Size {
+  std::size_t size_ = 1;
+};
+
+template <>
+struct Subtree_Size<false> {};
+
+
+// Aggregate policy is a monoid over the keys, every node keeps the combined
+// value of its subtree in key order:
+//   using value_type = ...;
+//   static value_type identity() noexcept;
+//   static value_type lift(const KeyT &key) noexcept;
+//   static value_type combine(const value_type &lhs, const value_type &rhs) noexcept; // associative
+// No_Aggregate keeps nothing.
+struct No_Aggregate {
+  using value_type = void;
+};
+
+template <typename T>
+struct Sum_Aggregate {
+  using value_type = T;
+  static T identity() noexcept { return T{}; }
+  template <typename K>
+  static T lift(const K &key) noexcept { return static_cast<T>(key); }
+  static T combine(const T &lhs, const T &rhs) noexcept { return lhs + rhs; }
+};
+
+template <typename T>
+struct Max_Aggregate {
+  using value_type = T;
+  static T identity() noexcept { return std::numeric_limits<T>::lowest(); }
+  template <typename K>
+  static T lift(const K &key) noexcept { return static_cast<T>(key); }
+  static T combine(const T &lhs, const T &rhs) noexcept { return std::max(lhs, rhs); }
+};
+
+// Aggregate of the keys in the subtree, kept only by trees with an aggregate policy.
+template <typename Aggregate>
+struct Subtree_Aggregate {
+  using aggregate_policy = Aggregate;
+  typename Aggregate::value_type aggregate_;
+};
+
+template <>
+struct Subtree_Aggregate<No_Aggregate> {
+  using aggregate_policy = No_Aggregate;
+};
 
-  int height_ = 1;
 
-  explicit AVL_Node(const KeyT &key, int height = 1) noexcept(std::is_nothrow_copy_constructible<KeyT>::value)
-    : BST_Node<KeyT>{key}
-    , height_(height) {}
-  explicit AVL_Node(KeyT &&key, int height = 1) noexcept(std::is_nothrow_move_constructible<KeyT>::value)
-    : BST_Node<KeyT>{std::move(key)}
-    , height_(height) {}
+template <typename KeyT, bool OrderStatistics = false, typename Aggregate = No_Aggregate>
+struct AVL_Node final
+  : public Node_Links<AVL_Node<KeyT, OrderStatistics, Aggregate>>, public Subtree_Size<OrderStatistics>
+  , public Subtree_Aggregate<Aggregate> {
+  KeyT key_;
+  avl_height_t height_ = 1;
+
+  // A new node is a leaf, its aggregate is the key itself
+  explicit AVL_Node(const KeyT &key, avl_height_t height = 1) noexcept(std::is_nothrow_copy_constructible<KeyT>::value)
+    : key_(key)
+    , height_(height)
+  {
+    if constexpr (!std::is_same<Aggregate, No_Aggregate>::value)
+      this->aggregate_ = Aggregate::lift(key_);
+  }
+  explicit AVL_Node(KeyT &&key, avl_height_t height = 1) noexcept(std::is_nothrow_move_constructible<KeyT>::value)
+    : key_(std::move(key))
+    , height_(height)
+  {
+    if constexpr (!std::is_same<Aggregate, No_Aggregate>::value)
+      this->aggregate_ = Aggregate::lift(key_);
+  }
   AVL_Node(const AVL_Node &other) = delete;
   AVL_Node(AVL_Node &&other) = delete;
   AVL_Node& operator= (const AVL_Node &rhs) = delete;
   AVL_Node& operator= (AVL_Node &&rhs) = delete;
   ~AVL_Node() = default;
-  AVL_Node *clone() const override {
-    return new AVL_Node<KeyT>{key_, height_};
+  template <typename Pool>
+  AVL_Node *clone(Pool &pool) const {
+    AVL_Node *copy = pool.create(key_, height_);
+    if constexpr (OrderStatistics)
+      copy->size_ = this->size_;
+    if constexpr (!std::is_same<Aggregate, No_Aggregate>::value)
+      copy->aggregate_ = this->aggregate_;
+    return copy;
   }
 };
 
 
-template <typename KeyT>
-class BST_Tree {
-  using bst_iterator = BST_Node<KeyT> *;
-  using bst_const_iterator = const BST_Node<KeyT> *;
+// Key of a node for the trees and their iterators. Nodes that keep the key
+// elsewhere than in key_ specialize it, e.g. the pair of AVL_Map_Node.
+template <typename NodeT>
+struct Node_Key {
+  static const auto &get(const NodeT *node) noexcept { return node->key_; }
+};
+
+
+// In-order bidirectional iterator. Steps through successors using parent links,
+// so a full scan costs O(1) amortized per element. Besides the node the iterator
+// keeps the root link of its tree to step back from end().
+// Keys are read-only through both iterator and const_iterator.
+template <typename NodeT, bool IsConst>
+class BST_Iterator {
+  using node_t = typename std::conditional<IsConst, const NodeT, NodeT>::type;
+
+  node_t *node_ = nullptr;
+  NodeT *const *root_link_ = nullptr;
+
+  template <typename, bool> friend class BST_Iterator;
+
+public:
+  using iterator_category = std::bidirectional_iterator_tag;
+  using value_type = typename std::remove_cv<typename std::remove_reference<
+    decltype(Node_Key<NodeT>::get(nullptr))>::type>::type;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const value_type *;
+  using reference = const value_type &;
+
+  BST_Iterator() noexcept {}
+  BST_Iterator(node_t *node, NodeT *const *root_link) noexcept : node_(node), root_link_(root_link) {}
+  template <bool OtherConst, typename = typename std::enable_if<IsConst && !OtherConst>::type>
+  BST_Iterator(const BST_Iterator<NodeT, OtherConst> &other) noexcept
+    : node_(other.node_), root_link_(other.root_link_) {}
+
+  node_t *node() const noexcept { return node_; }
+
+  reference operator*() const noexcept { return Node_Key<NodeT>::get(node_); }
+  pointer operator->() const noexcept { return &Node_Key<NodeT>::get(node_); }
+
+  BST_Iterator& operator++ () noexcept {
+    assert(node_);
+    if (node_->right_) {
+      node_ = node_->right_;
+      while (node_->left_)
+        node_ = node_->left_;
+    } else {
+      node_t *child = node_;
+      node_ = node_->parent_;
+      while (node_ && node_->right_ == child) {
+        child = node_;
+        node_ = node_->parent_;
+      }
+    }
+    return *this;
+  }
+
+  BST_Iterator& operator-- () noexcept {
+    if (!node_) { // end()
+      assert(root_link_ && *root_link_);
+      node_ = *root_link_;
+      while (node_->right_)
+        node_ = node_->right_;
+    } else if (node_->left_) {
+      node_ = node_->left_;
+      while (node_->right_)
+        node_ = node_->right_;
+    } else {
+      node_t *child = node_;
+      node_ = node_->parent_;
+      while (node_ && node_->left_ == child) {
+        child = node_;
+        node_ = node_->parent_;
+      }
+      assert(node_); // decrement of begin()
+    }
+    return *this;
+  }
+
+  BST_Iterator operator++ (int) noexcept {
+    BST_Iterator tmp = *this;
+    ++*this;
+    return tmp;
+  }
+
+  BST_Iterator operator-- (int) noexcept {
+    BST_Iterator tmp = *this;
+    --*this;
+    return tmp;
+  }
+
+  template <bool OtherConst>
+  bool operator== (const BST_Iterator<NodeT, OtherConst> &rhs) const noexcept { return node_ == rhs.node_; }
+  template <bool OtherConst>
+  bool operator!= (const BST_Iterator<NodeT, OtherConst> &rhs) const noexcept { return node_ != rhs.node_; }
+};
+
+// Iterator type of trees built of NodeT, nodes with mapped values specialize it
+template <typename NodeT, bool IsConst>
+struct Node_Iterator {
+  using type = BST_Iterator<NodeT, IsConst>;
+};
+
+// Lazy view of [first, last) returned by range queries, usable in range-based for
+template <typename It>
+class Iterator_Range {
+  It first_, last_;
+
+public:
+  Iterator_Range(It first, It last) : first_(first), last_(last) {}
+
+  It begin() const noexcept { return first_; }
+  It end() const noexcept { return last_; }
+  bool empty() const noexcept { return first_ == last_; }
+};
+
+
+// Common part of binary search trees. Derived tree supplies rebalancing
+// through CRTP hooks, so lookups and modifications involve no indirect calls:
+//   void after_insert(NodeT *new_node);  // new_node is already linked into the tree
+//   void after_erase(NodeT *retrace_start); // lowest node whose subtree has changed
+//   void dump_node(std::ostream &os, const NodeT *node) const;
+//   void init_built_node(NodeT *node, size_type subtree_size); // node is a root of balanced subtree built by assign()
+// Derived may also hide erase_node() if its rebalancing needs to know where the node was unlinked.
+// Keys are ordered by Compare only, keys a and b are equivalent if neither
+// comp(a, b) nor comp(b, a). Lookups accept any key type if Compare::is_transparent exists.
+template <typename KeyT, typename NodeT, typename Compare, typename Alloc, typename Derived>
+class BST_Tree_Base {
+public:
+  using key_type = KeyT;
+  using value_type = KeyT;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = const KeyT &;
+  using const_reference = const KeyT &;
+  using iterator = typename Node_Iterator<NodeT, false>::type;
+  using const_iterator = typename Node_Iterator<NodeT, true>::type;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
 protected:
-  bst_iterator root_ = nullptr;
+  using node_iterator = NodeT *;
+  using node_const_iterator = const NodeT *;
+  using node_pool_t = Node_Pool<NodeT, Alloc>;
+
+  node_iterator root_ = nullptr;
+  node_iterator max_ = nullptr; // node with the greatest key, where appends are attached
+  size_type size_ = 0;
+  node_pool_t pool_;
+  Compare comp_;
+#ifdef SEARCHTREES_STATS
+  mutable Tree_Stats stats_; // lookups are counted by const members too
+#endif
+
+  Derived &derived() noexcept { return static_cast<Derived&>(*this); }
+  const Derived &derived() const noexcept { return static_cast<const Derived&>(*this); }
+
+  static const KeyT &key_of(node_const_iterator node) noexcept { return Node_Key<NodeT>::get(node); }
+
+protected: // statistics
+  // Null if statistics are compiled out
+  Tree_Stats *stats_sink() const noexcept {
+#ifdef SEARCHTREES_STATS
+    return &stats_;
+#else
+    return nullptr;
+#endif
+  }
+
+  void count_lookup([[maybe_unused]] size_type comparisons) const noexcept {
+#ifdef SEARCHTREES_STATS
+    Tree_Stats::record(stats_.comparisons_per_lookup_, comparisons);
+#endif
+  }
 
 protected: // traversal
   enum class visited_child_t : char { NONE, LEFT, RIGHT };
   enum class order_t : char { PRE, POST };
 
   template <typename Func>
-  void depth_traversal(bst_iterator root, order_t order, Func func) {
+  void depth_traversal(node_iterator root, order_t order, Func func) {
     visited_child_t visited = visited_child_t::NONE;
     size_t depth = 0;
 
@@ -73,7 +345,7 @@ protected: // traversal
         visited = visited_child_t::NONE;
         ++depth;
       } else {
-        bst_iterator parent = it->parent_;
+        node_iterator parent = it->parent_;
         if (parent) {
           assert(parent->left_ == it || parent->right_ == it);
           if (parent->left_ == it) {
@@ -83,7 +355,7 @@ protected: // traversal
           }
           --depth;
         }
-        bst_iterator tmp = it;
+        node_iterator tmp = it;
         it = parent;
         if (order == order_t::POST)
           func(tmp, depth);
@@ -91,14 +363,16 @@ protected: // traversal
     }
   }
 
-  static void clear(bst_iterator &root) noexcept {
+  // Destroys subtree with the root `root`, returns the number of destroyed nodes
+  size_type clear(node_iterator &root) noexcept {
+    size_type destroyed = 0;
     for (auto it = root; it != nullptr;) {
       if (it->left_) {
         it = it->left_;
       } else if (it->right_) {
         it = it->right_;
       } else {
-        bst_iterator parent = it->parent_;
+        node_iterator parent = it->parent_;
         if (parent) {
           assert(parent->left_ == it || parent->right_ == it);
           if (parent->left_ == it) {
@@ -107,30 +381,75 @@ protected: // traversal
             parent->right_ = nullptr;
           }
         }
-        delete it;
+        destroy_node(it);
+        ++destroyed;
         it = parent;
       }
     }
     root = nullptr;
+    return destroyed;
+  }
+
+  node_iterator clone_node(node_const_iterator node) {
+    return node->clone(pool_);
+  }
+
+  void destroy_node(node_iterator node) noexcept {
+    pool_.destroy(node);
+  }
+
+  // Single descent from `start`, the root by default, whose subtree range must
+  // contain `key`. Returns the link the node with `key` is hanging on or has
+  // to be attached to and stores the owner of that link in `parent`.
+  // The link is not null iff an equivalent key is present.
+  node_iterator *find_link(const KeyT &key, node_iterator &parent, node_iterator start = nullptr) noexcept {
+    parent = start ? start->parent_ : nullptr;
+    node_iterator *link = !parent ? &root_ : (parent->left_ == start ? &parent->left_ : &parent->right_);
+    size_type comparisons = 0;
+    for (node_iterator it = *link; it != nullptr; it = *link) {
+      ++comparisons;
+      if (comp_(key, key_of(it))) {
+        link = &it->left_;
+      } else if (comp_(key_of(it), key)) {
+        link = &it->right_;
+      } else { // key == it->key_
+        break;
+      }
+      parent = it;
+    }
+    count_lookup(comparisons);
+    return link;
+  }
+
+  node_iterator attach_node(node_iterator parent, node_iterator *link, node_iterator new_node) {
+    assert(!*link);
+    new_node->parent_ = parent;
+    *link = new_node;
+    if (!max_ || link == &max_->right_)
+      max_ = new_node;
+    ++size_;
+    derived().after_insert(new_node);
+    return new_node;
   }
 
-  bst_iterator copy_depth_traversal(bst_iterator root) {
+  node_iterator copy_depth_traversal(node_const_iterator root) {
     if (!root)
       return nullptr;
-    bst_iterator copy_root = root->clone();
+    node_iterator copy_root = clone_node(root);
 
     try {
-      for (auto it = root, copy_it = copy_root;;) {
+      node_const_iterator it = root;
+      for (node_iterator copy_it = copy_root;;) {
         if (it->left_ && !copy_it->left_) {
           it = it->left_;
-          bst_iterator parent = copy_it;
-          copy_it = it->clone();
+          node_iterator parent = copy_it;
+          copy_it = clone_node(it);
           copy_it->parent_ = parent;
           copy_it->parent_->left_ = copy_it;
         } else if (it->right_ && !copy_it->right_) {
           it = it->right_;
-          bst_iterator parent = copy_it;
-          copy_it = it->clone();
+          node_iterator parent = copy_it;
+          copy_it = clone_node(it);
           copy_it->parent_ = parent;
           copy_it->parent_->right_ = copy_it;
         } else if (it != root) {
@@ -140,115 +459,430 @@ protected: // traversal
           break;
         }
       }
-    } catch (...) { // catch exceptions thrown by clone()
+    } catch (...) { // catch exceptions thrown by clone_node()
       clear(copy_root);
       throw;
     }
     return copy_root;
   }
 
-public: // ctors & dtors
-  BST_Tree() noexcept {}
-  virtual ~BST_Tree() {
-    clear();
+  // Builds perfectly balanced tree from `n` strictly increasing keys in O(n).
+  // Nodes are first created as a right-leaning chain, which keeps the tree
+  // valid if a key constructor throws, then relinked without allocations.
+  template <typename InputIt>
+  void build_sorted(InputIt first, size_type n) {
+    assert(!root_);
+    if (!n)
+      return;
+    pool_.reserve(n);
+
+    node_iterator tail = nullptr;
+    for (size_type i = 0; i < n; ++i, ++first) {
+      node_iterator node = pool_.create(*first);
+      node->parent_ = tail;
+      (tail ? tail->right_ : root_) = node;
+      tail = max_ = node;
+      ++size_;
+    }
+
+    // in-order build of subtrees of sizes: size/2 on the left, the rest minus one on the right
+    struct build_frame_t {
+      size_type size_;
+      node_iterator node_;
+    } stack[std::numeric_limits<size_type>::digits + 1];
+    int top = 0;
+    stack[0] = {n, nullptr};
+    node_iterator chain = root_;
+    node_iterator built = nullptr; // root of the last completed subtree
+
+    while (top >= 0) {
+      build_frame_t &frame = stack[top];
+      size_type left_size = frame.size_ / 2;
+      size_type right_size = frame.size_ - left_size - 1;
+
+      if (!frame.node_) {
+        if (left_size && !built) { // left subtree is not built yet
+          stack[++top] = {left_size, nullptr};
+          continue;
+        }
+        node_iterator node = chain;
+        chain = chain->right_;
+        node->left_ = built;
+        if (built)
+          built->parent_ = node;
+        node->right_ = nullptr;
+        frame.node_ = node;
+        built = nullptr;
+        if (right_size) {
+          stack[++top] = {right_size, nullptr};
+          continue;
+        }
+      }
+
+      node_iterator node = frame.node_;
+      node->right_ = built;
+      if (built)
+        built->parent_ = node;
+      derived().init_built_node(node, frame.size_);
+      built = node;
+      --top;
+    }
+
+    assert(!chain);
+    root_ = built;
+    if (root_)
+      root_->parent_ = nullptr;
   }
-  BST_Tree(const BST_Tree &other) : root_(copy_depth_traversal(other.root_)) {}
-  BST_Tree(BST_Tree &&other) noexcept : root_(other.root_) { other.root_ = nullptr; }
-  BST_Tree& operator= (const BST_Tree &rhs) {
-    if (this == &rhs)
-      return *this;
 
-    BST_Tree tmp(rhs);
-    std::swap(root_, tmp.root_);
-    return *this;
+  static void link_children(node_iterator node, node_iterator left, node_iterator right) noexcept {
+    node->left_ = left;
+    if (left)
+      left->parent_ = node;
+    node->right_ = right;
+    if (right)
+      right->parent_ = node;
   }
-  BST_Tree& operator= (BST_Tree &&rhs) noexcept {
-    if (this == &rhs)
-      return *this;
 
-    std::swap(root_, rhs.root_);
-    return *this;
+protected: // parallel construction
+  static constexpr size_type PARALLEL_GRAIN = 4096;
+
+  // Number of tree levels split between workers, about 4 subtrees per worker
+  static int parallel_depth(const Fork_Join_Pool &workers) noexcept {
+    if (workers.size() == 1)
+      return 0;
+    int depth = 2;
+    for (unsigned n = workers.size(); n > 1; n >>= 1)
+      ++depth;
+    return depth;
   }
 
-public: // selectors
-  virtual bst_const_iterator root() const & { return root_; }
-  virtual bst_iterator root() & { return root_; }
-  virtual bst_const_iterator end() const & noexcept { return nullptr; }
-  virtual bst_iterator end() & noexcept { return nullptr; }
-  bool empty() const noexcept { return !root_; }
-  bool contains(const KeyT &key) const {
-    bst_iterator node = find(key);
-    return node != end();
+  // Moves nodes of `part` into *this, returns the root of its tree
+  node_iterator adopt(BST_Tree_Base &part) noexcept {
+    pool_.splice(part.pool_);
+    node_iterator root = part.root_;
+    part.root_ = part.max_ = nullptr;
+    part.size_ = 0;
+    return root;
+  }
+
+  // Subtrees of the upper `depth` levels are copied in parallel by separate
+  // trees with their own pools, whose nodes are adopted afterwards.
+  void parallel_copy(node_const_iterator root, int depth, Fork_Join_Pool &workers) {
+    assert(!root_);
+    if (depth == 0 || !root) {
+      root_ = copy_depth_traversal(root);
+      max_ = rightmost(root_);
+      return;
+    }
+
+    Derived left{comp_, get_allocator()}, right{comp_, get_allocator()};
+    workers.fork_join(
+      [&] { left.parallel_copy(root->left_, depth - 1, workers); },
+      [&] { right.parallel_copy(root->right_, depth - 1, workers); }
+    );
+    root_ = clone_node(root);
+    link_children(root_, adopt(left), adopt(right));
+    max_ = rightmost(root_);
+  }
+
+  template <typename RandomIt>
+  void parallel_build_sorted(RandomIt first, size_type n, int depth, Fork_Join_Pool &workers) {
+    assert(!root_);
+    if (depth == 0 || n < PARALLEL_GRAIN) {
+      build_sorted(first, n);
+      return;
+    }
+
+    size_type left_size = n / 2;
+    Derived left{comp_, get_allocator()}, right{comp_, get_allocator()};
+    workers.fork_join(
+      [&] { left.parallel_build_sorted(first, left_size, depth - 1, workers); },
+      [&] { right.parallel_build_sorted(first + (left_size + 1), n - left_size - 1, depth - 1, workers); }
+    );
+    root_ = pool_.create(first[left_size]);
+    link_children(root_, adopt(left), adopt(right));
+    derived().init_built_node(root_, n);
+    max_ = rightmost(root_);
+    size_ = n;
+  }
+
+protected: // ctors & dtors
+  BST_Tree_Base() {}
+  BST_Tree_Base(const Compare &comp, const Alloc &alloc) : pool_(alloc), comp_(comp) {}
+  ~BST_Tree_Base() {
+    clear();
+  }
+  BST_Tree_Base(const BST_Tree_Base &other)
+    : pool_(std::allocator_traits<Alloc>::select_on_container_copy_construction(other.get_allocator()))
+    , comp_(other.comp_)
+  {
+    root_ = copy_depth_traversal(other.root_);
+    max_ = rightmost(root_);
+    size_ = other.size_;
+  }
+  BST_Tree_Base(const BST_Tree_Base &other, Fork_Join_Pool &workers)
+    : pool_(std::allocator_traits<Alloc>::select_on_container_copy_construction(other.get_allocator()))
+    , comp_(other.comp_)
+  {
+    workers.run([&] { parallel_copy(other.root_, parallel_depth(workers), workers); });
+    size_ = other.size_;
   }
-  virtual bst_const_iterator find(const KeyT &key) const & {
-    bst_const_iterator lb = lower_bound(key);
-    return (lb && lb->key_ == key) ? lb : end();
+  BST_Tree_Base(BST_Tree_Base &&other) noexcept
+    : root_(other.root_), max_(other.max_), size_(other.size_), pool_(std::move(other.pool_)), comp_(other.comp_)
+  {
+    other.root_ = other.max_ = nullptr;
+    other.size_ = 0;
+#ifdef SEARCHTREES_STATS
+    std::swap(stats_, other.stats_);
+#endif
   }
-  virtual bst_iterator find(const KeyT &key) & {
-    return const_cast<bst_iterator>(const_cast<const BST_Tree*>(this)->find(key));
+  BST_Tree_Base& operator= (const BST_Tree_Base &rhs) = delete;
+  BST_Tree_Base& operator= (BST_Tree_Base &&rhs) = delete;
+
+public:
+  void swap(Derived &other) noexcept {
+    std::swap(root_, other.root_);
+    std::swap(max_, other.max_);
+    std::swap(size_, other.size_);
+    pool_.swap(other.pool_);
+    using std::swap;
+    swap(comp_, other.comp_);
+#ifdef SEARCHTREES_STATS
+    std::swap(stats_, other.stats_);
+#endif
   }
 
-  virtual bst_const_iterator lower_bound(const KeyT &key, bst_const_iterator root) const & {
-    if (empty())
-      return end();
+protected: // node lookup
+  // Lookups are templates to serve heterogeneous keys, KeyT is the only type
+  // accepted unless Compare is transparent.
+  template <typename K>
+  node_const_iterator find_node(const K &key) const {
+    node_const_iterator lb = lower_bound_node(key, root_);
+    return (lb && !comp_(key, key_of(lb))) ? lb : nullptr;
+  }
+  template <typename K>
+  node_iterator find_node(const K &key) {
+    return const_cast<node_iterator>(const_cast<const BST_Tree_Base*>(this)->find_node(key));
+  }
 
-    bst_const_iterator cur_min = end();
-    for (auto it = root;;) {
-      if (it->key_ < key) {
-        if (!it->right_)
-          return cur_min;
+  template <typename K>
+  node_const_iterator lower_bound_node(const K &key, node_const_iterator root) const {
+    node_const_iterator cur_min = nullptr;
+    size_type comparisons = 0;
+    for (auto it = root; it != nullptr;) {
+      ++comparisons;
+      if (comp_(key_of(it), key)) {
         it = it->right_;
-      } else if (key < it->key_) {
+      } else if (comp_(key, key_of(it))) {
         cur_min = it;
-        if (!it->left_)
-          return cur_min;
         it = it->left_;
       } else { // key == it->key_
-        return it;
+        cur_min = it;
+        break;
+      }
+    }
+    count_lookup(comparisons);
+    return cur_min;
+  }
+
+  template <typename K>
+  node_const_iterator upper_bound_node(const K &key, node_const_iterator root) const {
+    node_const_iterator cur_min = nullptr;
+    size_type comparisons = 0;
+    for (auto it = root; it != nullptr;) {
+      ++comparisons;
+      if (!comp_(key, key_of(it))) {
+        it = it->right_;
+      } else {
+        cur_min = it;
+        it = it->left_;
       }
     }
+    count_lookup(comparisons);
+    return cur_min;
   }
 
-  virtual bst_const_iterator lower_bound(const KeyT &key) const & { return lower_bound(key, root_); }
+  void lower_bound_nodes(const KeyT *keys, size_type width, node_const_iterator *cur_min) const {
+    assert(width <= BATCH_WIDTH);
+    node_const_iterator cur[BATCH_WIDTH];
+    for (size_type i = 0; i < width; ++i) {
+      cur[i] = root_;
+      cur_min[i] = nullptr;
+    }
 
-  virtual bst_iterator lower_bound(const KeyT &key, bst_iterator root) & {
-    return const_cast<bst_iterator>(const_cast<const BST_Tree*>(this)->lower_bound(key, root));
+    for (size_type active = width; active != 0;) {
+      active = 0;
+      for (size_type i = 0; i < width; ++i) {
+        node_const_iterator it = cur[i];
+        if (!it)
+          continue;
+        if (comp_(key_of(it), keys[i])) {
+          it = it->right_;
+        } else if (comp_(keys[i], key_of(it))) {
+          cur_min[i] = it;
+          it = it->left_;
+        } else { // key == it->key_
+          cur_min[i] = it;
+          it = nullptr;
+        }
+        if (it) {
+          prefetch(it);
+          ++active;
+        }
+        cur[i] = it;
+      }
+    }
   }
 
-  virtual bst_iterator lower_bound(const KeyT &key) & { return lower_bound(key, root_);}
+  static node_iterator leftmost(node_iterator node) noexcept {
+    if (node) {
+      while (node->left_)
+        node = node->left_;
+    }
+    return node;
+  }
 
-  virtual bst_const_iterator upper_bound(const KeyT &key, bst_const_iterator root) const & {
-    if (empty())
-      return end();
+  static node_iterator rightmost(node_iterator node) noexcept {
+    if (node) {
+      while (node->right_)
+        node = node->right_;
+    }
+    return node;
+  }
 
-    bst_const_iterator cur_min = end();
-    for (auto it = root;;) {
-      if (it->key_ < key || it->key_ == key) {
-        if (!it->right_)
-          return cur_min;
-        it = it->right_;
-      } else {
-        cur_min = it;
-        if (!it->left_)
-          return cur_min;
-        it = it->left_;
+  // Finger search: the lowest node around `finger` whose subtree range contains
+  // `key`, or the node with `key`. The range of a subtree is bounded by the
+  // nearest ancestors it hangs to the right and to the left of, so the climb
+  // goes only up to the first bound on the side of the key that lets it in.
+  template <typename K>
+  node_const_iterator climb(node_const_iterator finger, const K &key) const {
+    if (!finger)
+      return root_;
+    bool to_left = comp_(key, key_of(finger));
+    if (!to_left && !comp_(key_of(finger), key))
+      return finger;
+
+    for (node_const_iterator node = finger;;) {
+      node_const_iterator child = node, bound = node->parent_;
+      while (bound && (to_left ? bound->left_ : bound->right_) == child) {
+        child = bound;
+        bound = bound->parent_;
       }
+      if (!bound || (to_left ? comp_(key_of(bound), key) : comp_(key, key_of(bound))))
+        return node;
+      if (!(to_left ? comp_(key, key_of(bound)) : comp_(key_of(bound), key)))
+        return bound;
+      node = bound;
     }
   }
 
-  virtual bst_const_iterator upper_bound(const KeyT &key) const & { return upper_bound(key, root_); }
+  // Node the search for `key` starts from: the hint or the last node for end()
+  node_const_iterator hint_node(const_iterator hint) const noexcept {
+    return hint.node() ? hint.node() : max_;
+  }
+
+  // find_link() for hinted insert, a key greater than all goes right under max_ at once
+  node_iterator *hint_link(const_iterator hint, const KeyT &key, node_iterator &parent) noexcept {
+    if (max_ && comp_(key_of(max_), key)) {
+      count_lookup(1);
+      parent = max_;
+      return &max_->right_;
+    }
+    return find_link(key, parent, const_cast<node_iterator>(climb(hint_node(hint), key)));
+  }
+
+  iterator make_iterator(node_const_iterator node) noexcept { return iterator{const_cast<node_iterator>(node), &root_}; }
+  const_iterator make_iterator(node_const_iterator node) const noexcept { return const_iterator{node, &root_}; }
+
+public: // iterators
+  const_iterator root() const & noexcept { return make_iterator(root_); }
+  iterator root() & noexcept { return make_iterator(root_); }
+  const_iterator begin() const & noexcept { return make_iterator(leftmost(root_)); }
+  iterator begin() & noexcept { return make_iterator(leftmost(root_)); }
+  const_iterator cbegin() const & noexcept { return begin(); }
+  const_iterator end() const & noexcept { return make_iterator(nullptr); }
+  iterator end() & noexcept { return make_iterator(nullptr); }
+  const_iterator cend() const & noexcept { return end(); }
+  const_reverse_iterator rbegin() const & noexcept { return const_reverse_iterator{end()}; }
+  reverse_iterator rbegin() & noexcept { return reverse_iterator{end()}; }
+  const_reverse_iterator rend() const & noexcept { return const_reverse_iterator{begin()}; }
+  reverse_iterator rend() & noexcept { return reverse_iterator{begin()}; }
+
+public: // selectors
+  Alloc get_allocator() const { return pool_.get_allocator(); }
+  Compare key_comp() const { return comp_; }
+  Compare value_comp() const { return comp_; }
+  bool empty() const noexcept { return !root_; }
+  size_type size() const noexcept { return size_; }
+  bool contains(const KeyT &key) const {
+    return find_node(key) != nullptr;
+  }
+
+  // Counters to scrape, all zero unless SEARCHTREES_STATS is defined
+  Tree_Stats stats() const noexcept {
+    Tree_Stats stats;
+#ifdef SEARCHTREES_STATS
+    stats = stats_;
+    stats.nodes_allocated_ = pool_.created();
+    stats.nodes_freed_ = pool_.destroyed();
+#endif
+    return stats;
+  }
+  const_iterator find(const KeyT &key) const & { return make_iterator(find_node(key)); }
+  iterator find(const KeyT &key) & { return make_iterator(find_node(key)); }
+
+  const_iterator lower_bound(const KeyT &key, const_iterator root) const & {
+    return make_iterator(lower_bound_node(key, root.node()));
+  }
+  const_iterator lower_bound(const KeyT &key) const & { return make_iterator(lower_bound_node(key, root_)); }
+  iterator lower_bound(const KeyT &key, iterator root) & {
+    return make_iterator(lower_bound_node(key, root.node()));
+  }
+  iterator lower_bound(const KeyT &key) & { return make_iterator(lower_bound_node(key, root_)); }
+
+  const_iterator upper_bound(const KeyT &key, const_iterator root) const & {
+    return make_iterator(upper_bound_node(key, root.node()));
+  }
+  const_iterator upper_bound(const KeyT &key) const & { return make_iterator(upper_bound_node(key, root_)); }
+  iterator upper_bound(const KeyT &key, iterator root) & {
+    return make_iterator(upper_bound_node(key, root.node()));
+  }
+  iterator upper_bound(const KeyT &key) & { return make_iterator(upper_bound_node(key, root_)); }
+
+  // Same as find(key), but the search starts from `finger` (end() stands for the
+  // last key) and climbs only as far as the key requires
+  const_iterator find_from(const_iterator finger, const KeyT &key) const & {
+    node_const_iterator lb = lower_bound_node(key, climb(hint_node(finger), key));
+    return make_iterator((lb && !comp_(key, key_of(lb))) ? lb : nullptr);
+  }
+  iterator find_from(const_iterator finger, const KeyT &key) & {
+    return make_iterator(static_cast<const BST_Tree_Base*>(this)->find_from(finger, key).node());
+  }
 
-  virtual bst_iterator upper_bound(const KeyT &key, bst_iterator root) & {
-    return const_cast<bst_iterator>(const_cast<const BST_Tree*>(this)->upper_bound(key, root));
+  // Keys in [lo, hi), found by two descents in O(log n) and iterated lazily
+  Iterator_Range<const_iterator> range(const KeyT &lo, const KeyT &hi) const & {
+    if (!comp_(lo, hi))
+      return {end(), end()};
+    return {lower_bound(lo), lower_bound(hi)};
+  }
+  Iterator_Range<iterator> range(const KeyT &lo, const KeyT &hi) & {
+    if (!comp_(lo, hi))
+      return {end(), end()};
+    return {lower_bound(lo), lower_bound(hi)};
   }
 
-  virtual bst_iterator upper_bound(const KeyT &key) & { return upper_bound(key, root_); }
+  // Calls func(key) for the keys in [lo, hi) in ascending order in O(log n + k)
+  template <typename Func>
+  void for_each_in_range(const KeyT &lo, const KeyT &hi, Func func) const {
+    for (const KeyT &key : range(lo, hi))
+      func(key);
+  }
 
-  virtual void dump(std::ostream& os) {
+  void dump(std::ostream& os) {
     depth_traversal(
       root_,
       order_t::PRE,
-      [this, &os](bst_iterator it, size_t depth) {
+      [this, &os](node_iterator it, size_t depth) {
         os << std::string(depth, '\t');
         if (it->parent_) {
           if (it->parent_->left_ == it)
@@ -256,68 +890,224 @@ public: // selectors
           else
             os << "R: ";
         }
-        os << "(" << it->key_ << ")\n";
+        derived().dump_node(os, it);
+        os << "\n";
       }
     );
   }
 
-public: // modifiers
-  void clear() noexcept {
-    clear(root_);
-  }
-  
-  virtual bst_iterator create_node(KeyT &&key) const {
-    return new BST_Node<KeyT>{std::move(key)};
+public: // heterogeneous lookup, available only if Compare::is_transparent exists
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  bool contains(const K &key) const { return find_node(key) != nullptr; }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator find(const K &key) const & { return make_iterator(find_node(key)); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  iterator find(const K &key) & { return make_iterator(find_node(key)); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator lower_bound(const K &key) const & { return make_iterator(lower_bound_node(key, root_)); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  iterator lower_bound(const K &key) & { return make_iterator(lower_bound_node(key, root_)); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator upper_bound(const K &key) const & { return make_iterator(upper_bound_node(key, root_)); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  iterator upper_bound(const K &key) & { return make_iterator(upper_bound_node(key, root_)); }
+
+public: // batched lookup
+  // Results for keys[i] are written to out[i]. Up to BATCH_WIDTH descents are
+  // advanced in lockstep, nodes of the next level are prefetched while the
+  // other descents of the batch are stepped, which hides memory latency.
+  static constexpr size_type BATCH_WIDTH = 16;
+
+  void lower_bound_batch(const KeyT *keys, size_type count, const_iterator *out) const {
+    node_const_iterator nodes[BATCH_WIDTH];
+    for (size_type first = 0; first < count; first += BATCH_WIDTH) {
+      size_type width = std::min(BATCH_WIDTH, count - first);
+      lower_bound_nodes(keys + first, width, nodes);
+      for (size_type i = 0; i < width; ++i)
+        out[first + i] = make_iterator(nodes[i]);
+    }
   }
 
-  virtual bst_iterator insert(const KeyT &key) & {
-    KeyT tmp(key);
-    return insert(std::move(tmp));
+  void find_batch(const KeyT *keys, size_type count, const_iterator *out) const {
+    node_const_iterator nodes[BATCH_WIDTH];
+    for (size_type first = 0; first < count; first += BATCH_WIDTH) {
+      size_type width = std::min(BATCH_WIDTH, count - first);
+      lower_bound_nodes(keys + first, width, nodes);
+      for (size_type i = 0; i < width; ++i) {
+        bool found = nodes[i] && !comp_(keys[first + i], key_of(nodes[i]));
+        out[first + i] = make_iterator(found ? nodes[i] : nullptr);
+      }
+    }
   }
 
-  virtual bst_iterator insert(KeyT &&key) & {
-    if (!root_) {
-      root_ = create_node(std::move(key));
-      return root_;
+  void contains_batch(const KeyT *keys, size_type count, bool *out) const {
+    node_const_iterator nodes[BATCH_WIDTH];
+    for (size_type first = 0; first < count; first += BATCH_WIDTH) {
+      size_type width = std::min(BATCH_WIDTH, count - first);
+      lower_bound_nodes(keys + first, width, nodes);
+      for (size_type i = 0; i < width; ++i)
+        out[first + i] = nodes[i] && !comp_(keys[first + i], key_of(nodes[i]));
     }
+  }
 
-    bst_iterator lb = lower_bound(key);
-    if (lb && lb->key_ == key)
-      return lb;
+public: // modifiers
+  // Keys that need no destruction are dropped together with the whole arena,
+  // otherwise nodes are destroyed one by one before the arena is released.
+  void clear() noexcept {
+    if (!std::is_trivially_destructible<NodeT>::value)
+      clear(root_);
+    root_ = max_ = nullptr;
+    size_ = 0;
+    pool_.release();
+  }
 
-    bst_iterator new_node = create_node(std::move(key));
-    if (!lb) {
-      for (auto it = root_;; it = it->right_) {
-        if (!it->right_) {
-          new_node->parent_ = it;
-          it->right_ = new_node;
-          break;
-        }
+  // Replaces the contents with keys from [first, last) in linear time if they
+  // are strictly increasing, otherwise the keys are sorted and deduplicated first.
+  template <typename InputIt>
+  void assign(InputIt first, InputIt last) {
+    using category_t = typename std::iterator_traits<InputIt>::iterator_category;
+    Derived tmp{comp_, get_allocator()};
+
+    if constexpr (std::is_base_of<std::forward_iterator_tag, category_t>::value) {
+      InputIt unordered = std::adjacent_find(first, last, [this](const KeyT &lhs, const KeyT &rhs) { return !comp_(lhs, rhs); });
+      if (unordered == last) {
+        tmp.build_sorted(first, static_cast<size_type>(std::distance(first, last)));
+        swap(tmp);
+        return;
       }
-    } else if (!lb->left_) {
-      new_node->parent_ = lb;
-      lb->left_ = new_node;
+    }
+
+    std::vector<KeyT> keys(first, last);
+    std::sort(keys.begin(), keys.end(), comp_);
+    auto keys_end = std::unique(keys.begin(), keys.end(), [this](const KeyT &lhs, const KeyT &rhs) { return !comp_(lhs, rhs); });
+    tmp.build_sorted(std::make_move_iterator(keys.begin()), static_cast<size_type>(keys_end - keys.begin()));
+    swap(tmp);
+  }
+
+  // Same as assign(first, last), subtrees are built by `workers` in parallel
+  template <typename RandomIt>
+  void assign(RandomIt first, RandomIt last, Fork_Join_Pool &workers) {
+    using category_t = typename std::iterator_traits<RandomIt>::iterator_category;
+    static_assert(std::is_base_of<std::random_access_iterator_tag, category_t>::value,
+      "parallel assign() requires random access iterators");
+    Derived tmp{comp_, get_allocator()};
+    int depth = parallel_depth(workers);
+
+    RandomIt unordered = std::adjacent_find(first, last, [this](const KeyT &lhs, const KeyT &rhs) { return !comp_(lhs, rhs); });
+    if (unordered == last) {
+      size_type n = static_cast<size_type>(last - first);
+      workers.run([&] { tmp.parallel_build_sorted(first, n, depth, workers); });
     } else {
-      for (auto it = lb->left_;; it = it->right_) {
-        if (!it->right_) {
-          new_node->parent_ = it;
-          it->right_ = new_node;
-          break;
-        }
-      }
+      std::vector<KeyT> keys(first, last);
+      std::sort(keys.begin(), keys.end(), comp_);
+      auto keys_end = std::unique(keys.begin(), keys.end(), [this](const KeyT &lhs, const KeyT &rhs) { return !comp_(lhs, rhs); });
+      size_type n = static_cast<size_type>(keys_end - keys.begin());
+      workers.run([&] { tmp.parallel_build_sorted(std::make_move_iterator(keys.begin()), n, depth, workers); });
     }
+    swap(tmp);
+  }
 
-    return new_node;
+  node_iterator create_node(KeyT &&key) {
+    return pool_.create(std::move(key));
+  }
+
+  iterator insert(const KeyT &key) & {
+    node_iterator parent = nullptr;
+    node_iterator *link = find_link(key, parent);
+    if (*link)
+      return make_iterator(*link);
+    return make_iterator(attach_node(parent, link, pool_.create(key)));
   }
 
-  virtual bool erase(const KeyT &key) & {
-    bst_iterator node = find(key);
-    if (node == end())
+  iterator insert(KeyT &&key) & {
+    node_iterator parent = nullptr;
+    node_iterator *link = find_link(key, parent);
+    if (*link)
+      return make_iterator(*link);
+    return make_iterator(attach_node(parent, link, create_node(std::move(key))));
+  }
+
+  // Constructs the key in place. The node is built before the descent,
+  // so it is thrown away if an equivalent key is already present.
+  template <typename... Args>
+  iterator emplace(Args&&... args) & {
+    node_iterator new_node = pool_.create(std::forward<Args>(args)...);
+    node_iterator parent = nullptr;
+    node_iterator *link = find_link(key_of(new_node), parent);
+    if (*link) {
+      destroy_node(new_node);
+      return make_iterator(*link);
+    }
+    return make_iterator(attach_node(parent, link, new_node));
+  }
+
+  // Same as insert(key), but the search starts from `hint` (end() stands for
+  // the last key) and climbs only as far as the key requires, so keys next to
+  // the hint take O(1) comparisons. A key greater than all is attached to the
+  // cached last node without a search, whatever the hint.
+  iterator insert(const_iterator hint, const KeyT &key) & {
+    node_iterator parent = nullptr;
+    node_iterator *link = hint_link(hint, key, parent);
+    if (*link)
+      return make_iterator(*link);
+    return make_iterator(attach_node(parent, link, pool_.create(key)));
+  }
+
+  iterator insert(const_iterator hint, KeyT &&key) & {
+    node_iterator parent = nullptr;
+    node_iterator *link = hint_link(hint, key, parent);
+    if (*link)
+      return make_iterator(*link);
+    return make_iterator(attach_node(parent, link, create_node(std::move(key))));
+  }
+
+  bool erase(const KeyT &key) & {
+    node_iterator node = find_node(key);
+    if (!node)
       return false;
 
-    bst_iterator successor = node->left_ ? node->left_ : node->right_;
+    remove_node(node);
+    return true;
+  }
+
+  // Removes the element at `pos`, returns iterator following it.
+  iterator erase(const_iterator pos) & {
+    assert(pos != end());
+    node_iterator node = const_cast<node_iterator>(pos.node());
+    iterator next = std::next(make_iterator(node));
+    remove_node(node);
+    return next;
+  }
+
+protected:
+  // Unlinks and destroys the node
+  void remove_node(node_iterator node) {
+    forget_max(node);
+    derived().erase_node(node);
+  }
+
+  // Unlinks the node without destroying it, the caller owns it afterwards.
+  // Only for trees that don't hide erase_node().
+  void extract_node(node_iterator node) {
+    forget_max(node);
+    unlink_node(node);
+  }
+
+  // The last node has no right child, so its predecessor is the last of its left subtree or its parent
+  void forget_max(node_iterator node) noexcept {
+    if (node == max_)
+      max_ = node->left_ ? rightmost(node->left_) : node->parent_;
+  }
+
+  void erase_node(node_iterator node) {
+    unlink_node(node);
+    destroy_node(node);
+  }
+
+  void unlink_node(node_iterator node) {
+    node_iterator successor = node->left_ ? node->left_ : node->right_;
     if (node->left_ && node->right_) { // 2 children
-      successor = upper_bound(node->key_, node->right_);
+      successor = leftmost(node->right_);
       assert(!successor->left_);
       successor->left_ = node->left_;
       node->left_->parent_ = successor;
@@ -334,6 +1124,18 @@ public: // modifiers
       }
     }
 
+    // calc retrace start point
+    node_iterator retrace_start = nullptr;
+    if (!node->left_ || !node->right_) { // no children or 1 child
+      retrace_start = node->parent_;
+    } else { // 2 children
+      if (successor->parent_ == node) {
+        retrace_start = successor;
+      } else {
+        retrace_start = successor->parent_;
+      }
+    }
+
     // move successor on node's place
     assert(!node->parent_ || node->parent_->left_ == node || node->parent_->right_ == node);
     if (!node->parent_) {
@@ -348,64 +1150,138 @@ public: // modifiers
       successor->parent_ = node->parent_;
     }
 
-    delete node;
-
-    return true;
+    --size_;
+    derived().after_erase(retrace_start);
   }
 };
 
 
-template <typename KeyT>
-std::ostream& operator<< (std::ostream& os, BST_Tree<KeyT>& tree) {
+template <typename KeyT, typename NodeT, typename Compare, typename Alloc, typename Derived>
+std::ostream& operator<< (std::ostream& os, BST_Tree_Base<KeyT, NodeT, Compare, Alloc, Derived>& tree) {
   tree.dump(os);
   return os;
 }
 
 
-template <typename KeyT>
-class AVL_Tree final : public BST_Tree<KeyT> {
-  using BST_Tree<KeyT>::root_;
+template <typename KeyT, typename Compare = std::less<KeyT>, typename Alloc = std::allocator<KeyT>>
+class BST_Tree final
+  : public BST_Tree_Base<KeyT, BST_Node<KeyT>, Compare, Alloc, BST_Tree<KeyT, Compare, Alloc>> {
+  using base_tree_t = BST_Tree_Base<KeyT, BST_Node<KeyT>, Compare, Alloc, BST_Tree<KeyT, Compare, Alloc>>;
+  friend base_tree_t;
 
   using bst_iterator = BST_Node<KeyT> *;
   using bst_const_iterator = const BST_Node<KeyT> *;
-  using avl_iterator = AVL_Node<KeyT> *;
-  using avl_const_iterator = const AVL_Node<KeyT> *;
 
 public: // ctors & dtors
-  AVL_Tree() noexcept : BST_Tree<KeyT>{} {}
-  AVL_Tree(const AVL_Tree &other) : BST_Tree<KeyT>{other} {}
-  AVL_Tree(AVL_Tree &&other) noexcept : BST_Tree<KeyT>{std::move(other)} {}
-  AVL_Tree& operator= (const AVL_Tree &rhs) {
+  BST_Tree() : base_tree_t{} {}
+  explicit BST_Tree(const Compare &comp, const Alloc &alloc = Alloc{}) : base_tree_t{comp, alloc} {}
+  explicit BST_Tree(const Alloc &alloc) : base_tree_t{Compare{}, alloc} {}
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  BST_Tree(InputIt first, InputIt last, const Compare &comp = Compare{}, const Alloc &alloc = Alloc{})
+    : base_tree_t{comp, alloc}
+  {
+    this->assign(first, last);
+  }
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  BST_Tree(InputIt first, InputIt last, const Alloc &alloc) : BST_Tree(first, last, Compare{}, alloc) {}
+  BST_Tree(const BST_Tree &other) : base_tree_t{other} {}
+  BST_Tree(const BST_Tree &other, Fork_Join_Pool &workers) : base_tree_t{other, workers} {}
+  BST_Tree(BST_Tree &&other) noexcept : base_tree_t{std::move(other)} {}
+  BST_Tree& operator= (const BST_Tree &rhs) {
     if (this == &rhs)
       return *this;
 
-    AVL_Tree tmp(rhs);
-    std::swap(root_, tmp.root_);
+    BST_Tree tmp(rhs);
+    this->swap(tmp);
     return *this;
   }
-  AVL_Tree& operator= (AVL_Tree &&rhs) noexcept {
+  BST_Tree& operator= (BST_Tree &&rhs) noexcept {
     if (this == &rhs)
       return *this;
 
-    std::swap(root_, rhs.root_);
+    this->swap(rhs);
     return *this;
   }
 
+private: // hooks
+  void after_insert(bst_iterator) noexcept {}
+  void after_erase(bst_iterator) noexcept {}
+  void init_built_node(bst_iterator, std::size_t) noexcept {}
+  void dump_node(std::ostream &os, bst_const_iterator node) const {
+    os << "(" << node->key_ << ")";
+  }
+};
+
+
+// AVL rebalancing shared by AVL_Tree and AVL_Map. NodeT has an AVL height
+// and, with OrderStatistics, the size of its subtree, which enables rank(),
+// select() and count_range() in O(log n). Nodes with an aggregate policy
+// also keep the aggregate of their subtree for reduce() in O(log n).
+template <typename KeyT, typename NodeT, typename Compare, typename Alloc, bool OrderStatistics, typename Derived>
+class AVL_Tree_Base : public BST_Tree_Base<KeyT, NodeT, Compare, Alloc, Derived> {
+  using node_t = NodeT;
+  using base_tree_t = BST_Tree_Base<KeyT, node_t, Compare, Alloc, Derived>;
+  friend base_tree_t;
+  using base_tree_t::root_;
+  using base_tree_t::comp_;
+  using base_tree_t::key_of;
+  using base_tree_t::link_children;
+
+  using avl_iterator = node_t *;
+  using avl_const_iterator = const node_t *;
+
+  using aggregate_t = typename node_t::aggregate_policy;
+  static constexpr bool AGGREGATES = !std::is_same<aggregate_t, No_Aggregate>::value;
+
+public:
+  using typename base_tree_t::size_type;
+  using typename base_tree_t::iterator;
+  using typename base_tree_t::const_iterator;
+  using aggregate_type = typename aggregate_t::value_type;
+
+protected: // ctors & dtors
+  AVL_Tree_Base() : base_tree_t{} {}
+  AVL_Tree_Base(const Compare &comp, const Alloc &alloc) : base_tree_t{comp, alloc} {}
+  AVL_Tree_Base(const AVL_Tree_Base &other) : base_tree_t{other} {}
+  AVL_Tree_Base(const AVL_Tree_Base &other, Fork_Join_Pool &workers) : base_tree_t{other, workers} {}
+  AVL_Tree_Base(AVL_Tree_Base &&other) noexcept : base_tree_t{std::move(other)} {}
+  AVL_Tree_Base& operator= (const AVL_Tree_Base &rhs) = delete;
+  AVL_Tree_Base& operator= (AVL_Tree_Base &&rhs) = delete;
+
 private: // rotations
-  int calc_height(avl_iterator node) const {
-    return std::max(
-      (node->left_ ? static_cast<avl_iterator>(node->left_)->height_ : 0),
-      (node->right_ ? static_cast<avl_iterator>(node->right_)->height_ : 0)
-    ) + 1;
+  static int height(avl_const_iterator node) noexcept {
+    return node ? node->height_ : 0;
+  }
+  static avl_height_t calc_height(avl_const_iterator node) noexcept {
+    return static_cast<avl_height_t>(std::max(height(node->left_), height(node->right_)) + 1);
   }
-  int calc_balance_factor(avl_iterator node) const {
-    return (
-      (node->right_ ? static_cast<avl_iterator>(node->right_)->height_ : 0)
-      - (node->left_ ? static_cast<avl_iterator>(node->left_)->height_ : 0));
+  static int calc_balance_factor(avl_const_iterator node) noexcept {
+    return height(node->right_) - height(node->left_);
+  }
+  static size_type subtree_size(avl_const_iterator node) noexcept {
+    return node ? node->size_ : 0;
+  }
+  static aggregate_type subtree_aggregate(avl_const_iterator node) noexcept {
+    return node ? node->aggregate_ : aggregate_t::identity();
+  }
+  static void update_aggregate(avl_iterator node) noexcept {
+    node->aggregate_ = aggregate_t::combine(
+      aggregate_t::combine(subtree_aggregate(node->left_), aggregate_t::lift(key_of(node))),
+      subtree_aggregate(node->right_));
+  }
+  // Recalculates data that depends on the children
+  static void update_node(avl_iterator node) noexcept {
+    node->height_ = calc_height(node);
+    if constexpr (OrderStatistics)
+      node->size_ = subtree_size(node->left_) + subtree_size(node->right_) + 1;
+    if constexpr (AGGREGATES)
+      update_aggregate(node);
   }
 
-  void simple_rotate_swap_parent(bst_iterator sub_root, bst_iterator child) {
-    bst_iterator &sub_root_parent = sub_root->parent_;
+  // Rotations and retrace take the link to the root of the (sub)tree they work on,
+  // which is root_ for the tree itself or a local variable for detached subtrees.
+  static void simple_rotate_swap_parent(avl_iterator sub_root, avl_iterator child, avl_iterator &root) {
+    avl_iterator &sub_root_parent = sub_root->parent_;
     if (sub_root_parent) {
       assert(sub_root_parent->left_ == sub_root || sub_root_parent->right_ == sub_root);
       if (sub_root_parent->left_ == sub_root) {
@@ -415,16 +1291,16 @@ private: // rotations
       }
       child->parent_ = sub_root_parent;
     } else {
-      assert(root_ == sub_root);
-      root_ = child;
+      assert(root == sub_root);
+      root = child;
       child->parent_ = nullptr;
     }
   }
 
-  avl_iterator rotate_left(avl_iterator sub_root, avl_iterator right_child) & {
+  static avl_iterator rotate_left(avl_iterator sub_root, avl_iterator right_child, avl_iterator &root) {
     assert(sub_root->right_ == right_child && right_child->parent_ == sub_root);
 
-    simple_rotate_swap_parent(sub_root, right_child);
+    simple_rotate_swap_parent(sub_root, right_child, root);
 
     sub_root->right_ = right_child->left_;
     if (sub_root->right_)
@@ -432,16 +1308,16 @@ private: // rotations
     right_child->left_ = sub_root;
     sub_root->parent_ = right_child;
 
-    sub_root->height_ = calc_height(sub_root);
-    right_child->height_ = calc_height(right_child);
+    update_node(sub_root);
+    update_node(right_child);
 
     return right_child;
   }
 
-  avl_iterator rotate_right(avl_iterator sub_root, avl_iterator left_child) & {
+  static avl_iterator rotate_right(avl_iterator sub_root, avl_iterator left_child, avl_iterator &root) {
     assert(sub_root->left_ == left_child && left_child->parent_ == sub_root);
 
-    simple_rotate_swap_parent(sub_root, left_child);
+    simple_rotate_swap_parent(sub_root, left_child, root);
 
     sub_root->left_ = left_child->right_;
     if (sub_root->left_)
@@ -449,191 +1325,584 @@ private: // rotations
     left_child->right_ = sub_root;
     sub_root->parent_ = left_child;
 
-    sub_root->height_ = calc_height(sub_root);
-    left_child->height_ = calc_height(left_child);
+    update_node(sub_root);
+    update_node(left_child);
 
     return left_child;
   }
 
-  avl_iterator rotate_left_right(avl_iterator sub_root, avl_iterator left_child) & {
+  static avl_iterator rotate_left_right(avl_iterator sub_root, avl_iterator left_child, avl_iterator &root) {
     assert(left_child->right_);
-    avl_iterator new_child = rotate_left(left_child, static_cast<avl_iterator>(left_child->right_));
-    rotate_right(sub_root, new_child);
+    avl_iterator new_child = rotate_left(left_child, left_child->right_, root);
+    rotate_right(sub_root, new_child, root);
     return new_child;
   }
 
-  avl_iterator rotate_right_left(avl_iterator sub_root, avl_iterator right_child) & {
+  static avl_iterator rotate_right_left(avl_iterator sub_root, avl_iterator right_child, avl_iterator &root) {
     assert(right_child->left_);
-    avl_iterator new_child = rotate_right(right_child, static_cast<avl_iterator>(right_child->left_));
-    rotate_left(sub_root, new_child);
+    avl_iterator new_child = rotate_right(right_child, right_child->left_, root);
+    rotate_left(sub_root, new_child, root);
     return new_child;
   }
 
-  template <typename Func>
-  void retrace(bst_iterator start, Func break_cond) {
-    for (
-      auto node = static_cast<avl_iterator>(start);
-      node != nullptr;
-      node = static_cast<avl_iterator>(node->parent_)
-    ) {
-      node->height_ = calc_height(node);
+  // Rotations and the path length are counted in `stats` if it's not null.
+  // With `stop_early` the walk ends at the first subtree whose height is the
+  // same as before, which is valid only if all heights on the path are up to
+  // date and the nodes keep no subtree sizes or aggregates.
+  static void retrace(avl_iterator start, avl_iterator &root, bool stop_early, Tree_Stats *stats = nullptr) {
+    std::size_t length = 0;
+    for (auto node = start; node != nullptr; node = node->parent_) {
+      ++length;
+      avl_height_t old_height = node->height_;
+      update_node(node);
       int bf = calc_balance_factor(node);
 
       if (std::abs(bf) == 2) {
-        avl_iterator child = static_cast<avl_iterator>((bf < 0) ? node->left_ : node->right_);
+        avl_iterator child = (bf < 0) ? node->left_ : node->right_;
         assert(child);
         int ch_bf = calc_balance_factor(child);
 
-        if (break_cond(bf)) {
-          break;
-        } else if (bf == -2) { // left heavy
+        if (bf == -2) { // left heavy
           if (ch_bf <= 0) { // ch left heavy or balanced
-            rotate_right(node, child);
+            node = rotate_right(node, child, root);
+            if (STATS_ENABLED && stats)
+              ++stats->rotate_right_;
           } else { // ch right heavy
-            rotate_left_right(node, child);
+            node = rotate_left_right(node, child, root);
+            if (STATS_ENABLED && stats)
+              ++stats->rotate_left_right_;
           }
-        } else if (bf == 2) { // right heavy
+        } else { // right heavy
           if (ch_bf >= 0) { // ch right heavy or balanced
-            rotate_left(node, child);
+            node = rotate_left(node, child, root);
+            if (STATS_ENABLED && stats)
+              ++stats->rotate_left_;
           } else { // ch left heavy
-            rotate_right_left(node, child);
+            node = rotate_right_left(node, child, root);
+            if (STATS_ENABLED && stats)
+              ++stats->rotate_right_left_;
           }
         }
       }
+      if (stop_early && node->height_ == old_height)
+        break;
     }
+    if (STATS_ENABLED && stats)
+      Tree_Stats::record(stats->retrace_length_, length);
   }
 
-public: // selectors
-  avl_const_iterator root() const & override { return static_cast<avl_iterator>(root_); }
-  avl_iterator root() & override { return static_cast<avl_iterator>(root_); }
-  avl_const_iterator end() const & noexcept override { return nullptr; }
-  avl_iterator end() & noexcept override { return nullptr; }
-  avl_const_iterator find(const KeyT &key) const & override {
-    return static_cast<avl_const_iterator>(BST_Tree<KeyT>::find(key));
-  }
-  avl_iterator find(const KeyT &key) & override {
-    return const_cast<avl_iterator>(const_cast<const AVL_Tree*>(this)->find(key));
+public: // order statistics
+  // Number of keys less than `key`
+  size_type rank(const KeyT &key) const {
+    static_assert(OrderStatistics, "rank() requires AVL_Tree with OrderStatistics");
+    size_type rank = 0;
+    for (avl_const_iterator it = root_; it != nullptr;) {
+      if (comp_(key_of(it), key)) {
+        rank += subtree_size(it->left_) + 1;
+        it = it->right_;
+      } else {
+        it = it->left_;
+      }
+    }
+    return rank;
   }
 
-  avl_const_iterator lower_bound(const KeyT &key, bst_const_iterator root) const & override {
-      return static_cast<avl_const_iterator>(BST_Tree<KeyT>::lower_bound(key, root));
+  // Iterator to the k-th smallest key (counting from 0) or end() if k >= size()
+  const_iterator select(size_type k) const & {
+    static_assert(OrderStatistics, "select() requires AVL_Tree with OrderStatistics");
+    return this->make_iterator(select_node(k));
+  }
+  iterator select(size_type k) & {
+    static_assert(OrderStatistics, "select() requires AVL_Tree with OrderStatistics");
+    return this->make_iterator(select_node(k));
   }
 
-  avl_const_iterator lower_bound(const KeyT &key) const & override { return lower_bound(key, root_); }
+  // Number of keys in [lo, hi)
+  size_type count_range(const KeyT &lo, const KeyT &hi) const {
+    if (!comp_(lo, hi))
+      return 0;
+    return rank(hi) - rank(lo);
+  }
 
-  avl_iterator lower_bound(const KeyT &key, bst_iterator root) & override {
-    return const_cast<avl_iterator>(const_cast<const AVL_Tree*>(this)->lower_bound(key, root));
+public: // aggregates
+  // Aggregate of all keys
+  aggregate_type reduce() const {
+    static_assert(AGGREGATES, "reduce() requires AVL_Tree with an aggregate policy");
+    return subtree_aggregate(root_);
   }
 
-  avl_iterator lower_bound(const KeyT &key) & override { return lower_bound(key, root_);}
+  // Aggregate of the keys in [lo, hi) in key order. Goes down to the highest
+  // node in the interval, then along both bounds taking whole subtrees inside.
+  aggregate_type reduce(const KeyT &lo, const KeyT &hi) const {
+    static_assert(AGGREGATES, "reduce() requires AVL_Tree with an aggregate policy");
+    if (!comp_(lo, hi))
+      return aggregate_t::identity();
+
+    avl_const_iterator top = root_;
+    while (top && (comp_(key_of(top), lo) || !comp_(key_of(top), hi)))
+      top = comp_(key_of(top), lo) ? top->right_ : top->left_;
+    if (!top)
+      return aggregate_t::identity();
+
+    // keys not less than lo in the left subtree, each step goes to smaller keys
+    aggregate_type lower = aggregate_t::identity();
+    for (avl_const_iterator it = top->left_; it != nullptr;) {
+      if (comp_(key_of(it), lo)) {
+        it = it->right_;
+      } else {
+        lower = aggregate_t::combine(aggregate_t::combine(aggregate_t::lift(key_of(it)), subtree_aggregate(it->right_)), lower);
+        it = it->left_;
+      }
+    }
+
+    // keys less than hi in the right subtree, each step goes to greater keys
+    aggregate_type upper = aggregate_t::identity();
+    for (avl_const_iterator it = top->right_; it != nullptr;) {
+      if (comp_(key_of(it), hi)) {
+        upper = aggregate_t::combine(upper, aggregate_t::combine(subtree_aggregate(it->left_), aggregate_t::lift(key_of(it))));
+        it = it->right_;
+      } else {
+        it = it->left_;
+      }
+    }
+
+    return aggregate_t::combine(aggregate_t::combine(lower, aggregate_t::lift(key_of(top))), upper);
+  }
 
-  avl_const_iterator upper_bound(const KeyT &key, bst_const_iterator root) const & override {
-    return static_cast<avl_const_iterator>(BST_Tree<KeyT>::upper_bound(key, root));
+private:
+  avl_const_iterator select_node(size_type k) const noexcept {
+    for (avl_const_iterator it = root_; it != nullptr;) {
+      size_type left_size = subtree_size(it->left_);
+      if (k < left_size) {
+        it = it->left_;
+      } else if (k == left_size) {
+        return it;
+      } else {
+        k -= left_size + 1;
+        it = it->right_;
+      }
+    }
+    return nullptr;
   }
 
-  avl_const_iterator upper_bound(const KeyT &key) const & override { return upper_bound(key, root_); }
+private: // join & split
+  // AVL tree of height h has at least Fib(h + 2) - 1 nodes, so it can't be higher than this
+  static constexpr int MAX_HEIGHT = 96;
 
-  avl_iterator upper_bound(const KeyT &key, bst_iterator root) & override {
-    return const_cast<avl_iterator>(const_cast<const AVL_Tree*>(this)->upper_bound(key, root));
+  static avl_iterator detach(avl_iterator sub_root) noexcept {
+    if (sub_root)
+      sub_root->parent_ = nullptr;
+    return sub_root;
   }
 
-  avl_iterator upper_bound(const KeyT &key) & override { return upper_bound(key, root_); }
+  // Joins detached subtrees left < mid < right into one balanced subtree in
+  // O(|height(left) - height(right)| + 1), returns its root.
+  static avl_iterator join(avl_iterator left, avl_iterator mid, avl_iterator right) noexcept {
+    int left_height = height(left), right_height = height(right);
 
-  void dump(std::ostream& os) override {
-    this->depth_traversal(
-      root_,
-      BST_Tree<KeyT>::order_t::PRE,
-      [this, &os](bst_iterator it, size_t depth) {
-        os << std::string(depth, '\t');
-        if (it->parent_) {
-          if (it->parent_->left_ == it)
-          os << "L: ";
-          else
-          os << "R: ";
-        }
-        auto avl_it = static_cast<avl_iterator>(it);
-        os << "(" << avl_it->key_ << "; " << avl_it->height_ << "; " << calc_balance_factor(avl_it) << ")\n";
+    if (left_height > right_height + 1) { // hang on the right spine of left
+      avl_iterator parent = left, sub_root = left->right_;
+      while (height(sub_root) > right_height + 1) {
+        parent = sub_root;
+        sub_root = sub_root->right_;
       }
-    );
-  }
+      link_children(mid, sub_root, right);
+      mid->parent_ = parent;
+      parent->right_ = mid;
+      update_node(mid);
+      avl_iterator root = left;
+      retrace(parent, root, false);
+      return root;
+    }
+
+    if (right_height > left_height + 1) { // hang on the left spine of right
+      avl_iterator parent = right, sub_root = right->left_;
+      while (height(sub_root) > left_height + 1) {
+        parent = sub_root;
+        sub_root = sub_root->left_;
+      }
+      link_children(mid, left, sub_root);
+      mid->parent_ = parent;
+      parent->left_ = mid;
+      update_node(mid);
+      avl_iterator root = right;
+      retrace(parent, root, false);
+      return root;
+    }
 
-  avl_iterator create_node(KeyT &&key) const override {
-    return new AVL_Node<KeyT>{std::move(key)};
+    link_children(mid, left, right);
+    mid->parent_ = nullptr;
+    update_node(mid);
+    return mid;
   }
 
-  virtual avl_iterator insert(const KeyT &key) & {
-    KeyT tmp(key);
-    return insert(std::move(tmp));
+  // Joins detached subtrees left < right without a middle key
+  static avl_iterator join(avl_iterator left, avl_iterator right) noexcept {
+    if (!left)
+      return right;
+    if (!right)
+      return left;
+
+    // cut off the largest node of left and use it as the middle one
+    avl_iterator max = left;
+    while (max->right_)
+      max = max->right_;
+    avl_iterator max_parent = max->parent_;
+    if (max_parent) {
+      max_parent->right_ = max->left_;
+      if (max->left_)
+        max->left_->parent_ = max_parent;
+      retrace(max_parent, left, false);
+    } else {
+      left = detach(max->left_);
+    }
+    return join(left, max, right);
   }
 
-  avl_iterator insert(KeyT &&key) & override {
-    avl_iterator new_node = static_cast<avl_iterator>(BST_Tree<KeyT>::insert(std::move(key)));
-    retrace(
-      static_cast<avl_iterator>(new_node->parent_),
-      [](int bf) { return (bf == 0); }
-    );
+  struct split_result_t {
+    avl_iterator left_ = nullptr;  // keys less than the split key
+    avl_iterator equal_ = nullptr; // detached node with the split key, if any
+    avl_iterator right_ = nullptr; // keys greater than the split key
+  };
+
+  // Splits detached subtree by `key` in O(height(root)). Goes down to the key
+  // and then joins the subtrees hanging off the path on the way back.
+  split_result_t split(avl_iterator root, const KeyT &key) const noexcept {
+    split_result_t result;
+    avl_iterator it = root, last = nullptr;
+    while (it && (comp_(key_of(it), key) || comp_(key, key_of(it)))) {
+      last = it;
+      it = comp_(key, key_of(it)) ? it->left_ : it->right_;
+    }
 
-    return new_node;
+    if (it) {
+      result.left_ = detach(it->left_);
+      result.right_ = detach(it->right_);
+      last = it->parent_;
+      it->left_ = it->right_ = it->parent_ = nullptr;
+      update_node(it);
+      result.equal_ = it;
+    }
+
+    for (avl_iterator node = last; node != nullptr;) {
+      avl_iterator parent = node->parent_;
+      if (comp_(key, key_of(node))) {
+        result.right_ = join(result.right_, node, detach(node->right_));
+      } else {
+        result.left_ = join(detach(node->left_), node, result.left_);
+      }
+      node = parent;
+    }
+    return result;
   }
 
-  bool erase(const KeyT &key) & override {
-    bst_iterator node = find(key);
-    if (node == end())
-      return false;
+private: // set operations
+  // REVERSE_DIFFERENCE is rhs \ lhs, so a small subtrahend can give the pivots
+  enum class set_operation_t : char { UNION, INTERSECTION, DIFFERENCE, REVERSE_DIFFERENCE };
+
+  // Computes `op` of detached subtrees `lhs` and `rhs` owned by this tree's pool,
+  // nodes that don't get into the result are destroyed and counted in `destroyed`.
+  // Divide and conquer on the root of `lhs` with an explicit stack: split `rhs`
+  // by the root key, process both halves and join them back.
+  // Of two equal keys the node of `lhs` is kept, or the node of `rhs` if `rhs_wins`.
+  avl_iterator set_operation(avl_iterator lhs, avl_iterator rhs, set_operation_t op, bool rhs_wins,
+                             size_type &destroyed) {
+    struct frame_t {
+      avl_iterator pivot_;
+      avl_iterator equal_;        // node of rhs equal to pivot
+      avl_iterator right_lhs_, right_rhs_;
+      avl_iterator left_result_;
+      bool left_done_;
+    } stack[MAX_HEIGHT];
+    int top = -1; // every frame goes one level down in lhs
+
+    avl_iterator result = nullptr;
+    bool returning = false;
+    while (true) {
+      if (!returning) {
+        // base cases
+        if (!lhs || !rhs) {
+          switch (op) {
+          case set_operation_t::UNION:
+            result = lhs ? lhs : rhs;
+            break;
+          case set_operation_t::INTERSECTION:
+            destroyed += this->clear(lhs);
+            destroyed += this->clear(rhs);
+            result = nullptr;
+            break;
+          case set_operation_t::DIFFERENCE:
+            destroyed += this->clear(rhs);
+            result = lhs;
+            break;
+          case set_operation_t::REVERSE_DIFFERENCE:
+            destroyed += this->clear(lhs);
+            result = rhs;
+            break;
+          }
+          returning = true;
+          continue;
+        }
 
-    bst_iterator successor = node->left_ ? node->left_ : node->right_;
-    if (node->left_ && node->right_) { // 2 children
-      successor = upper_bound(node->key_, node->right_);
-      assert(!successor->left_);
-      successor->left_ = node->left_;
-      node->left_->parent_ = successor;
+        split_result_t parts = split(rhs, key_of(lhs));
+        assert(top + 1 < MAX_HEIGHT);
+        stack[++top] = frame_t{lhs, parts.equal_, detach(lhs->right_), parts.right_, nullptr, false};
+        lhs = detach(lhs->left_);
+        rhs = parts.left_;
+        continue;
+      }
 
-      // place successor in root of (node->right_) subtree
-      if (successor->parent_ != node) {
-        assert(successor->parent_->left_ == successor);
-        successor->parent_->left_ = successor->right_;
-        if (successor->right_) {
-          successor->right_->parent_ = successor->parent_;
-        }
-        successor->right_ = node->right_;
-        node->right_->parent_ = successor;
+      if (top < 0)
+        return result;
+
+      frame_t &frame = stack[top];
+      if (!frame.left_done_) {
+        frame.left_done_ = true;
+        frame.left_result_ = result;
+        lhs = frame.right_lhs_;
+        rhs = frame.right_rhs_;
+        returning = false;
+        continue;
       }
+
+      result = combine(frame.left_result_, frame.pivot_, frame.equal_, result, op, rhs_wins, destroyed);
+      --top;
     }
+  }
 
-    // calc retrace start point
-    bst_iterator retrase_start = nullptr;
-    if (!node->left_ || !node->right_) { // no children or 1 child
-      retrase_start = node->parent_;
-    } else { // 2 children
-      if (successor->parent_ == node) {
-        retrase_start = successor;
-      } else {
-        retrase_start = successor->parent_;
+  // Joins results for both halves with the pivot or drops the pivot depending on `op`.
+  // `equal` is the node of the other tree with the pivot key, it's dropped
+  // unless the key is kept and `rhs_wins`, then it replaces the pivot.
+  avl_iterator combine(avl_iterator left, avl_iterator pivot, avl_iterator equal, avl_iterator right,
+                       set_operation_t op, bool rhs_wins, size_type &destroyed) noexcept {
+    bool keep_pivot = (op == set_operation_t::UNION)
+      || (op != set_operation_t::REVERSE_DIFFERENCE && (op == set_operation_t::INTERSECTION) == (equal != nullptr));
+    if (keep_pivot && equal && rhs_wins)
+      std::swap(pivot, equal);
+    if (equal) {
+      this->destroy_node(equal);
+      ++destroyed;
+    }
+    if (keep_pivot)
+      return join(left, pivot, right);
+
+    this->destroy_node(pivot);
+    ++destroyed;
+    return join(left, right);
+  }
+
+  // Halves of the upper `depth` levels are processed in parallel. Every task
+  // collects the nodes it destroys in a separate tree, which pools are
+  // spliced back afterwards.
+  avl_iterator parallel_set_operation(avl_iterator lhs, avl_iterator rhs, set_operation_t op, bool rhs_wins,
+                                      int depth, size_type &destroyed, Fork_Join_Pool &workers) {
+    if (depth == 0 || !lhs || !rhs)
+      return set_operation(lhs, rhs, op, rhs_wins, destroyed);
+
+    split_result_t parts = split(rhs, key_of(lhs));
+    avl_iterator left_lhs = detach(lhs->left_), right_lhs = detach(lhs->right_);
+    Derived left_owner{comp_, this->get_allocator()}, right_owner{comp_, this->get_allocator()};
+    size_type left_destroyed = 0, right_destroyed = 0;
+    avl_iterator left_result = nullptr, right_result = nullptr;
+    workers.fork_join(
+      [&] {
+        left_result = left_owner.parallel_set_operation(left_lhs, parts.left_, op, rhs_wins, depth - 1, left_destroyed, workers);
+      },
+      [&] {
+        right_result = right_owner.parallel_set_operation(right_lhs, parts.right_, op, rhs_wins, depth - 1, right_destroyed, workers);
       }
+    );
+    this->pool_.splice(left_owner.pool_);
+    this->pool_.splice(right_owner.pool_);
+    destroyed += left_destroyed + right_destroyed;
+    return combine(left_result, lhs, parts.equal_, right_result, op, rhs_wins, destroyed);
+  }
+
+  void apply_set_operation(Derived &&other, set_operation_t op, Fork_Join_Pool *workers = nullptr) {
+    if (static_cast<AVL_Tree_Base*>(&other) == this)
+      return;
+    if (!(this->get_allocator() == other.get_allocator())) {
+      Derived tmp(other.begin(), other.end(), comp_, this->get_allocator());
+      other.swap(tmp);
     }
 
-    // move successor on node's place
-    assert(!node->parent_ || node->parent_->left_ == node || node->parent_->right_ == node);
-    if (!node->parent_) {
-      assert(root_ == node);
-      root_ = successor;
-    } else if (node->parent_->left_ == node) {
-      node->parent_->left_ = successor;
+    // nodes of other become owned by this tree
+    this->pool_.splice(other.pool_);
+    avl_iterator lhs = root_, rhs = other.root_;
+    size_type total_size = this->size_ + other.size_;
+    other.root_ = other.max_ = nullptr;
+    other.size_ = 0;
+
+    // smaller tree gives pivots, O(m log(n/m + 1)) for m <= n,
+    // nodes of *this are kept for equal keys whichever side they are on
+    bool rhs_wins = false;
+    if (height(lhs) > height(rhs)) {
+      std::swap(lhs, rhs);
+      rhs_wins = true;
+      if (op == set_operation_t::DIFFERENCE)
+        op = set_operation_t::REVERSE_DIFFERENCE;
+    }
+    size_type destroyed = 0;
+    if (workers) {
+      int depth = base_tree_t::parallel_depth(*workers);
+      workers->run([&] { root_ = parallel_set_operation(lhs, rhs, op, rhs_wins, depth, destroyed, *workers); });
     } else {
-      node->parent_->right_ = successor;
+      root_ = set_operation(lhs, rhs, op, rhs_wins, destroyed);
     }
-    if (successor) {
-      successor->parent_ = node->parent_;
+    this->max_ = base_tree_t::rightmost(root_);
+    this->size_ = total_size - destroyed;
+  }
+
+public: // set operations
+  // Nodes of `other` are reused, pass an rvalue to avoid copying it.
+  // Both trees must be ordered by equivalent comparators.
+  void union_with(Derived other) & {
+    apply_set_operation(std::move(other), set_operation_t::UNION);
+  }
+
+  void intersect_with(Derived other) & {
+    apply_set_operation(std::move(other), set_operation_t::INTERSECTION);
+  }
+
+  void difference_with(Derived other) & {
+    apply_set_operation(std::move(other), set_operation_t::DIFFERENCE);
+  }
+
+  void merge(Derived &&other) & {
+    apply_set_operation(std::move(other), set_operation_t::UNION);
+  }
+
+  // Same as above, halves of the trees are processed by `workers` in parallel
+  void union_with(Derived other, Fork_Join_Pool &workers) & {
+    apply_set_operation(std::move(other), set_operation_t::UNION, &workers);
+  }
+
+  void intersect_with(Derived other, Fork_Join_Pool &workers) & {
+    apply_set_operation(std::move(other), set_operation_t::INTERSECTION, &workers);
+  }
+
+  void difference_with(Derived other, Fork_Join_Pool &workers) & {
+    apply_set_operation(std::move(other), set_operation_t::DIFFERENCE, &workers);
+  }
+
+public: // batch updates
+  // The batch is sorted and deduplicated into a balanced tree in O(m log m),
+  // or O(m) if it's already strictly increasing, which is merged by split/join
+  // in O(m log(n/m + 1)). Rebalancing is done by the joins only, not per key.
+  // Return the number of inserted and erased keys.
+  template <typename InputIt>
+  size_type insert_batch(InputIt first, InputIt last) & {
+    size_type old_size = this->size_;
+    apply_set_operation(Derived(first, last, comp_, this->get_allocator()), set_operation_t::UNION);
+    return this->size_ - old_size;
+  }
+
+  template <typename InputIt>
+  size_type erase_batch(InputIt first, InputIt last) & {
+    size_type old_size = this->size_;
+    apply_set_operation(Derived(first, last, comp_, this->get_allocator()), set_operation_t::DIFFERENCE);
+    return old_size - this->size_;
+  }
+
+  // Erases the keys in [lo, hi) in O(log n + k): the interval is cut out by two
+  // splits, the rest is joined back and the cut subtree is destroyed at once.
+  // Returns the number of erased keys.
+  size_type erase_range(const KeyT &lo, const KeyT &hi) & {
+    if (!root_ || !comp_(lo, hi))
+      return 0;
+
+    split_result_t upper = split(root_, hi);
+    split_result_t lower = split(upper.left_, lo);
+    root_ = lower.left_;
+    root_ = upper.equal_ ? join(root_, upper.equal_, upper.right_) : join(root_, upper.right_);
+    this->max_ = base_tree_t::rightmost(root_);
+
+    size_type erased = this->clear(lower.right_);
+    if (lower.equal_) {
+      this->destroy_node(lower.equal_);
+      ++erased;
     }
+    this->size_ -= erased;
+    return erased;
+  }
 
-    delete node;
+private: // hooks
+  // Subtree sizes and aggregates change up to the root, heights only until a subtree keeps its height
+  void after_insert(avl_iterator new_node) {
     retrace(
-      static_cast<avl_iterator>(retrase_start),
-      [](int bf) { return (std::abs(bf) == 1); }
+      new_node->parent_,
+      root_,
+      !OrderStatistics && !AGGREGATES,
+      this->stats_sink()
     );
+  }
 
-    return true;
+  // The successor moved by erase_node() keeps its old height, which is fixed by the full walk
+  void after_erase(avl_iterator retrace_start) {
+    retrace(
+      retrace_start,
+      root_,
+      false,
+      this->stats_sink()
+    );
+  }
+
+  // Balanced subtree of `size` nodes built by assign() has height equal to the bit width of `size`
+  void init_built_node(avl_iterator node, size_type size) noexcept {
+    avl_height_t height = 0;
+    for (; size >> height; ++height) {}
+    node->height_ = height;
+    if constexpr (OrderStatistics)
+      node->size_ = size;
+    if constexpr (AGGREGATES)
+      update_aggregate(node); // children are built first
+  }
+
+  void dump_node(std::ostream &os, avl_const_iterator node) const {
+    os << "(" << key_of(node) << "; " << static_cast<int>(node->height_) << "; " << calc_balance_factor(node) << ")";
+  }
+};
+
+
+// Aggregate is a policy described at No_Aggregate, e.g. Sum_Aggregate<long long>
+template <typename KeyT, typename Compare = std::less<KeyT>, typename Alloc = std::allocator<KeyT>,
+          bool OrderStatistics = false, typename Aggregate = No_Aggregate>
+class AVL_Tree final
+  : public AVL_Tree_Base<KeyT, AVL_Node<KeyT, OrderStatistics, Aggregate>, Compare, Alloc, OrderStatistics,
+                         AVL_Tree<KeyT, Compare, Alloc, OrderStatistics, Aggregate>> {
+  using base_tree_t = AVL_Tree_Base<KeyT, AVL_Node<KeyT, OrderStatistics, Aggregate>, Compare, Alloc, OrderStatistics,
+                                    AVL_Tree<KeyT, Compare, Alloc, OrderStatistics, Aggregate>>;
+
+public: // ctors & dtors
+  AVL_Tree() : base_tree_t{} {}
+  explicit AVL_Tree(const Compare &comp, const Alloc &alloc = Alloc{}) : base_tree_t{comp, alloc} {}
+  explicit AVL_Tree(const Alloc &alloc) : base_tree_t{Compare{}, alloc} {}
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  AVL_Tree(InputIt first, InputIt last, const Compare &comp = Compare{}, const Alloc &alloc = Alloc{})
+    : base_tree_t{comp, alloc}
+  {
+    this->assign(first, last);
+  }
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  AVL_Tree(InputIt first, InputIt last, const Alloc &alloc) : AVL_Tree(first, last, Compare{}, alloc) {}
+  AVL_Tree(const AVL_Tree &other) : base_tree_t{other} {}
+  AVL_Tree(const AVL_Tree &other, Fork_Join_Pool &workers) : base_tree_t{other, workers} {}
+  AVL_Tree(AVL_Tree &&other) noexcept : base_tree_t{std::move(other)} {}
+  AVL_Tree& operator= (const AVL_Tree &rhs) {
+    if (this == &rhs)
+      return *this;
+
+    AVL_Tree tmp(rhs);
+    this->swap(tmp);
+    return *this;
+  }
+  AVL_Tree& operator= (AVL_Tree &&rhs) noexcept {
+    if (this == &rhs)
+      return *this;
+
+    this->swap(rhs);
+    return *this;
   }
 };
 
-} // SearchTrees
\ No newline at end of file
+} // SearchTrees
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SEARCHTREES_HAS_MMAP 1
+#endif
+
+#include "tree.hpp"
+
+namespace SearchTrees {
+
+// Tag of the ordering an image is written in, so that it isn't read with
+// another one. Custom comparators share CUSTOM unless Image_Order is specialized
+// for them with a value of their own.
+template <typename Compare>
+struct Image_Order {
+  static constexpr std::uint16_t CUSTOM = 0;
+  static constexpr std::uint16_t ASCENDING = 1;
+  static constexpr std::uint16_t DESCENDING = 2;
+
+  static constexpr std::uint16_t value = CUSTOM;
+};
+template <typename T>
+struct Image_Order<std::less<T>> : Image_Order<void> {
+  static constexpr std::uint16_t value = Image_Order<void>::ASCENDING;
+};
+template <typename T>
+struct Image_Order<std::greater<T>> : Image_Order<void> {
+  static constexpr std::uint16_t value = Image_Order<void>::DESCENDING;
+};
+
+// Binary image of a search tree: a header followed by the keys in the order of Compare.
+// Holds no pointers, so a mapped image is queried in place by binary search
+// wherever it is mapped. Keys are stored as raw bytes in the native byte order,
+// which requires trivially copyable keys.
+struct Image_Header {
+  static constexpr std::uint64_t MAGIC = 0x31454552'544C5641; // "AVLTREE1" in little-endian order
+  static constexpr std::uint16_t FORMAT_VERSION = 2;
+
+  std::uint64_t magic_ = MAGIC;
+  std::uint16_t format_version_ = FORMAT_VERSION;
+  std::uint16_t order_ = 0; // Image_Order of the writer's Compare
+  std::uint32_t key_size_ = 0;
+  std::uint64_t count_ = 0;
+  std::uint64_t keys_offset_ = sizeof(Image_Header); // from the start of the file
+};
+static_assert(sizeof(Image_Header) == 32, "image header layout must not depend on the platform");
+
+// Throws std::runtime_error if the header doesn't describe an image of KeyT
+// ordered by Compare fitting in file_size bytes
+template <typename KeyT, typename Compare = std::less<KeyT>>
+void check_image_header(const Image_Header &header, std::uint64_t file_size, const std::string &path) {
+  if (header.magic_ != Image_Header::MAGIC || header.format_version_ != Image_Header::FORMAT_VERSION)
+    throw std::runtime_error("tree image: " + path + " is not an image of this format or byte order");
+  if (header.key_size_ != sizeof(KeyT))
+    throw std::runtime_error("tree image: key size in " + path + " doesn't match");
+  if (header.order_ != Image_Order<Compare>::value)
+    throw std::runtime_error("tree image: keys in " + path + " are ordered by another comparator");
+  if (header.keys_offset_ % alignof(KeyT) != 0 || header.keys_offset_ > file_size ||
+      header.count_ > (file_size - header.keys_offset_) / sizeof(KeyT))
+    throw std::runtime_error("tree image: " + path + " is truncated or corrupted");
+}
+
+
+// Writes an image key by key, so it may be larger than the memory.
+// Keys must be appended in strictly increasing order, the header is completed by close().
+template <typename KeyT, typename Compare = std::less<KeyT>>
+class Image_Writer {
+  static_assert(std::is_trivially_copyable<KeyT>::value, "tree image stores keys as raw bytes");
+  static_assert(alignof(KeyT) <= sizeof(Image_Header), "keys must be aligned at the end of the header");
+
+  static constexpr std::size_t BUFFER_KEYS = (1 << 16) / sizeof(KeyT) + 1;
+
+  std::ofstream out_;
+  std::string path_;
+  Image_Header header_;
+  std::vector<KeyT> buffer_; // written in chunks, not key by key
+  Compare comp_;
+  KeyT last_{};
+  bool closed_ = false;
+
+public: // ctors & dtors
+  explicit Image_Writer(const std::string &path, const Compare &comp = Compare{})
+    : out_(path, std::ios::binary | std::ios::trunc)
+    , path_(path)
+    , comp_(comp)
+  {
+    if (!out_)
+      throw std::runtime_error("tree image: can't open " + path + " for writing");
+    header_.key_size_ = sizeof(KeyT);
+    header_.order_ = Image_Order<Compare>::value;
+    // the count is patched by close()
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    buffer_.reserve(BUFFER_KEYS);
+  }
+  Image_Writer(const Image_Writer &other) = delete;
+  Image_Writer& operator= (const Image_Writer &rhs) = delete;
+  // An image that wasn't closed is left with zero keys
+  ~Image_Writer() = default;
+
+public: // modifiers
+  // Throws std::invalid_argument if key doesn't go after the previous one
+  void append(const KeyT &key) {
+    if (header_.count_ != 0 && !comp_(last_, key))
+      throw std::invalid_argument("tree image: keys must be appended in strictly increasing order");
+    if (buffer_.size() == BUFFER_KEYS)
+      flush();
+    buffer_.push_back(key);
+    last_ = key;
+    ++header_.count_;
+  }
+
+  void flush() {
+    out_.write(reinterpret_cast<const char*>(buffer_.data()), static_cast<std::streamsize>(buffer_.size() * sizeof(KeyT)));
+    buffer_.clear();
+  }
+
+  // Writes the key count and flushes the file, throws std::runtime_error on I/O errors
+  void close() {
+    if (closed_)
+      return;
+    closed_ = true;
+    flush();
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    out_.close();
+    if (!out_)
+      throw std::runtime_error("tree image: can't write " + path_);
+  }
+
+  std::uint64_t size() const noexcept { return header_.count_; }
+};
+
+
+// Saves keys of any tree iterated in ascending order
+template <typename TreeT>
+void save(const TreeT &tree, const std::string &path) {
+  Image_Writer<typename TreeT::key_type, typename TreeT::key_compare> writer{path, tree.key_comp()};
+  for (const auto &key : tree)
+    writer.append(key);
+  writer.close();
+}
+
+// Keys of an image written with Compare in its order
+template <typename KeyT, typename Compare = std::less<KeyT>>
+std::vector<KeyT> read_image_keys(const std::string &path) {
+  static_assert(std::is_trivially_copyable<KeyT>::value, "tree image stores keys as raw bytes");
+
+  std::ifstream in{path, std::ios::binary | std::ios::ate};
+  if (!in)
+    throw std::runtime_error("tree image: can't open " + path);
+  auto file_size = static_cast<std::uint64_t>(in.tellg());
+  Image_Header header;
+  in.seekg(0);
+  if (file_size < sizeof(header) || !in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    throw std::runtime_error("tree image: " + path + " is truncated or corrupted");
+  check_image_header<KeyT, Compare>(header, file_size, path);
+
+  std::vector<KeyT> keys(static_cast<std::size_t>(header.count_));
+  in.seekg(static_cast<std::streamoff>(header.keys_offset_));
+  if (!in.read(reinterpret_cast<char*>(keys.data()), static_cast<std::streamsize>(keys.size() * sizeof(KeyT))))
+    throw std::runtime_error("tree image: can't read " + path);
+  return keys;
+}
+
+// Reads an image into a tree of type TreeT, the keys are already sorted,
+// so the tree is built in linear time
+template <typename TreeT>
+TreeT load(const std::string &path) {
+  std::vector<typename TreeT::key_type> keys =
+    read_image_keys<typename TreeT::key_type, typename TreeT::key_compare>(path);
+  return TreeT(keys.begin(), keys.end());
+}
+
+
+// Read-only view of an image queried without deserialization. The file is
+// memory-mapped where the platform allows it, so opening takes O(1) and only
+// the pages touched by lookups are read, otherwise the keys are read into memory.
+template <typename KeyT, typename Compare = std::less<KeyT>>
+class Mapped_Tree {
+  static_assert(std::is_trivially_copyable<KeyT>::value, "tree image stores keys as raw bytes");
+
+public:
+  using key_type = KeyT;
+  using value_type = KeyT;
+  using key_compare = Compare;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = const KeyT &;
+  using const_reference = const KeyT &;
+  using const_iterator = const KeyT *;
+  using iterator = const_iterator;
+
+private:
+  const KeyT *keys_ = nullptr;
+  size_type size_ = 0;
+  void *map_ = nullptr;
+  size_type map_size_ = 0;
+  std::vector<KeyT> copy_; // without mmap
+  Compare comp_;
+
+  void unmap() noexcept {
+#ifdef SEARCHTREES_HAS_MMAP
+    if (map_)
+      munmap(map_, map_size_);
+#endif
+    map_ = nullptr;
+  }
+
+public: // ctors & dtors
+  explicit Mapped_Tree(const std::string &path, const Compare &comp = Compare{}) : comp_(comp) {
+#ifdef SEARCHTREES_HAS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("tree image: can't open " + path);
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || static_cast<std::uint64_t>(st.st_size) < sizeof(Image_Header)) {
+      ::close(fd);
+      throw std::runtime_error("tree image: " + path + " is truncated or corrupted");
+    }
+    map_size_ = static_cast<size_type>(st.st_size);
+    map_ = mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map_ == MAP_FAILED) {
+      map_ = nullptr;
+      throw std::runtime_error("tree image: can't map " + path);
+    }
+
+    Image_Header header;
+    std::memcpy(&header, map_, sizeof(header));
+    try {
+      check_image_header<KeyT, Compare>(header, map_size_, path);
+    } catch (...) {
+      unmap();
+      throw;
+    }
+    keys_ = reinterpret_cast<const KeyT*>(static_cast<const char*>(map_) + header.keys_offset_);
+    size_ = static_cast<size_type>(header.count_);
+#else
+    copy_ = read_image_keys<KeyT, Compare>(path);
+    keys_ = copy_.data();
+    size_ = copy_.size();
+#endif
+  }
+
+  ~Mapped_Tree() {
+    unmap();
+  }
+
+  Mapped_Tree(Mapped_Tree &&other) noexcept
+    : keys_(other.keys_), size_(other.size_), map_(other.map_), map_size_(other.map_size_)
+    , copy_(std::move(other.copy_)), comp_(other.comp_)
+  {
+    other.map_ = nullptr;
+    other.keys_ = nullptr;
+    other.size_ = 0;
+  }
+  Mapped_Tree& operator= (Mapped_Tree &&rhs) noexcept {
+    std::swap(keys_, rhs.keys_);
+    std::swap(size_, rhs.size_);
+    std::swap(map_, rhs.map_);
+    std::swap(map_size_, rhs.map_size_);
+    std::swap(copy_, rhs.copy_);
+    std::swap(comp_, rhs.comp_);
+    return *this;
+  }
+  Mapped_Tree(const Mapped_Tree &other) = delete;
+  Mapped_Tree& operator= (const Mapped_Tree &rhs) = delete;
+
+public: // iterators
+  const_iterator begin() const noexcept { return keys_; }
+  const_iterator end() const noexcept { return keys_ + size_; }
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+
+public: // selectors
+  bool empty() const noexcept { return size_ == 0; }
+  size_type size() const noexcept { return size_; }
+  Compare key_comp() const { return comp_; }
+
+  const_iterator lower_bound(const KeyT &key) const { return std::lower_bound(begin(), end(), key, comp_); }
+  const_iterator upper_bound(const KeyT &key) const { return std::upper_bound(begin(), end(), key, comp_); }
+  const_iterator find(const KeyT &key) const {
+    const_iterator it = lower_bound(key);
+    return (it != end() && !comp_(key, *it)) ? it : end();
+  }
+  bool contains(const KeyT &key) const { return find(key) != end(); }
+
+  // Heterogeneous lookup, available only if Compare::is_transparent exists
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator lower_bound(const K &key) const { return std::lower_bound(begin(), end(), key, comp_); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator upper_bound(const K &key) const { return std::upper_bound(begin(), end(), key, comp_); }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  const_iterator find(const K &key) const {
+    const_iterator it = lower_bound(key);
+    return (it != end() && !comp_(key, *it)) ? it : end();
+  }
+  template <typename K, typename C = Compare, typename = typename C::is_transparent>
+  bool contains(const K &key) const { return find(key) != end(); }
+
+public: // conversion
+  // Builds a mutable tree with the same keys in linear time
+  template <typename TreeT = AVL_Tree<KeyT, Compare>>
+  TreeT thaw() const {
+    return TreeT(begin(), end(), comp_);
+  }
+};
+
+} // SearchTrees
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+namespace SearchTrees {
+
+// Hot-path counters are collected only if SEARCHTREES_STATS is defined before
+// including the trees. Without it the counting code is compiled out and
+// stats() returns zeros.
+#ifdef SEARCHTREES_STATS
+inline constexpr bool STATS_ENABLED = true;
+#else
+inline constexpr bool STATS_ENABLED = false;
+#endif
+
+// Counters accumulated by a tree since its construction.
+// Rotations and retrace lengths are counted for insert() and erase(),
+// rebalancing done by bulk operations and set operations is not included.
+struct Tree_Stats {
+  // Value v is counted in bucket v, the last bucket also takes larger values
+  static constexpr std::size_t HISTOGRAM_BUCKETS = 64;
+  using histogram_t = std::array<std::uint64_t, HISTOGRAM_BUCKETS>;
+
+  std::uint64_t rotate_left_ = 0;
+  std::uint64_t rotate_right_ = 0;
+  std::uint64_t rotate_left_right_ = 0;
+  std::uint64_t rotate_right_left_ = 0;
+  histogram_t comparisons_per_lookup_{}; // nodes compared with the key by one descent
+  histogram_t retrace_length_{};         // nodes visited by one retrace
+  std::uint64_t nodes_allocated_ = 0;
+  std::uint64_t nodes_freed_ = 0;
+
+  static void record(histogram_t &histogram, std::size_t value) noexcept {
+    ++histogram[value < HISTOGRAM_BUCKETS ? value : HISTOGRAM_BUCKETS - 1];
+  }
+};
+
+// One "name value" line per counter and per non-empty histogram bucket,
+// e.g. "retrace_length{17} 3"
+inline std::ostream& operator<< (std::ostream& os, const Tree_Stats &stats) {
+  os << "rotate_left " << stats.rotate_left_ << "\n"
+     << "rotate_right " << stats.rotate_right_ << "\n"
+     << "rotate_left_right " << stats.rotate_left_right_ << "\n"
+     << "rotate_right_left " << stats.rotate_right_left_ << "\n"
+     << "nodes_allocated " << stats.nodes_allocated_ << "\n"
+     << "nodes_freed " << stats.nodes_freed_ << "\n";
+  auto print_histogram = [&os](const char *name, const Tree_Stats::histogram_t &histogram) {
+    for (std::size_t i = 0; i < histogram.size(); ++i) {
+      if (histogram[i])
+        os << name << "{" << i << "} " << histogram[i] << "\n";
+    }
+  };
+  print_histogram("comparisons_per_lookup", stats.comparisons_per_lookup_);
+  print_histogram("retrace_length", stats.retrace_length_);
+  return os;
+}
+
+} // SearchTrees
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "tree.hpp"
+
+namespace SearchTrees {
+
+// Node of a weak AVL tree. Instead of a height it keeps the rank differences
+// to its children, each of them is 1 or 2, so one bit per child is enough.
+// A missing child has rank -1, a leaf has rank 0.
+template <typename KeyT>
+struct WAVL_Node final : public Node_Links<WAVL_Node<KeyT>> {
+  static constexpr std::uint8_t LEFT_RD2 = 1;  // left child is 2 ranks lower
+  static constexpr std::uint8_t RIGHT_RD2 = 2; // right child is 2 ranks lower
+
+  KeyT key_;
+  std::uint8_t rank_diffs_ = 0;
+
+  explicit WAVL_Node(const KeyT &key, std::uint8_t rank_diffs = 0) noexcept(std::is_nothrow_copy_constructible<KeyT>::value)
+    : key_(key)
+    , rank_diffs_(rank_diffs) {}
+  explicit WAVL_Node(KeyT &&key, std::uint8_t rank_diffs = 0) noexcept(std::is_nothrow_move_constructible<KeyT>::value)
+    : key_(std::move(key))
+    , rank_diffs_(rank_diffs) {}
+  WAVL_Node(const WAVL_Node &other) = delete;
+  WAVL_Node(WAVL_Node &&other) = delete;
+  WAVL_Node& operator= (const WAVL_Node &rhs) = delete;
+  WAVL_Node& operator= (WAVL_Node &&rhs) = delete;
+  ~WAVL_Node() = default;
+  template <typename Pool>
+  WAVL_Node *clone(Pool &pool) const {
+    return pool.create(key_, rank_diffs_);
+  }
+};
+
+
+// Weak AVL tree (Haeupler, Sen, Tarjan, "Rank-balanced trees"). Built only by
+// insertions it is an AVL tree, erasures relax it to height at most 2 log n.
+// In exchange an insertion or an erasure does at most 2 rotations and the rank
+// updates on the way up stop after O(1) amortized steps, while AVL_Tree may
+// rotate at every level on erase and recomputes the height of every ancestor.
+// Lookups, iterators and modifiers are the same as for BST_Tree and AVL_Tree.
+template <typename KeyT, typename Compare = std::less<KeyT>, typename Alloc = std::allocator<KeyT>>
+class WAVL_Tree final
+  : public BST_Tree_Base<KeyT, WAVL_Node<KeyT>, Compare, Alloc, WAVL_Tree<KeyT, Compare, Alloc>> {
+  using node_t = WAVL_Node<KeyT>;
+  using base_tree_t = BST_Tree_Base<KeyT, node_t, Compare, Alloc, WAVL_Tree<KeyT, Compare, Alloc>>;
+  friend base_tree_t;
+  using base_tree_t::root_;
+
+  using wavl_iterator = node_t *;
+  using wavl_const_iterator = const node_t *;
+
+public:
+  using typename base_tree_t::size_type;
+
+public: // ctors & dtors
+  WAVL_Tree() : base_tree_t{} {}
+  explicit WAVL_Tree(const Compare &comp, const Alloc &alloc = Alloc{}) : base_tree_t{comp, alloc} {}
+  explicit WAVL_Tree(const Alloc &alloc) : base_tree_t{Compare{}, alloc} {}
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  WAVL_Tree(InputIt first, InputIt last, const Compare &comp = Compare{}, const Alloc &alloc = Alloc{})
+    : base_tree_t{comp, alloc}
+  {
+    this->assign(first, last);
+  }
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  WAVL_Tree(InputIt first, InputIt last, const Alloc &alloc) : WAVL_Tree(first, last, Compare{}, alloc) {}
+  WAVL_Tree(const WAVL_Tree &other) : base_tree_t{other} {}
+  WAVL_Tree(const WAVL_Tree &other, Fork_Join_Pool &workers) : base_tree_t{other, workers} {}
+  WAVL_Tree(WAVL_Tree &&other) noexcept : base_tree_t{std::move(other)} {}
+  WAVL_Tree& operator= (const WAVL_Tree &rhs) {
+    if (this == &rhs)
+      return *this;
+
+    WAVL_Tree tmp(rhs);
+    this->swap(tmp);
+    return *this;
+  }
+  WAVL_Tree& operator= (WAVL_Tree &&rhs) noexcept {
+    if (this == &rhs)
+      return *this;
+
+    this->swap(rhs);
+    return *this;
+  }
+
+private: // rank differences
+  static std::uint8_t side_bit(bool left) noexcept { return left ? node_t::LEFT_RD2 : node_t::RIGHT_RD2; }
+  static bool is_rd2(wavl_const_iterator node, bool left) noexcept { return node->rank_diffs_ & side_bit(left); }
+  // Rank differences given for the `left` side and the other one
+  static std::uint8_t rank_diffs(bool left, bool side_rd2, bool other_rd2) noexcept {
+    return static_cast<std::uint8_t>((side_rd2 ? side_bit(left) : 0) | (other_rd2 ? side_bit(!left) : 0));
+  }
+
+private: // rotations
+  // Links `child` (maybe null) to the parent of `node` in place of it
+  void replace_child(wavl_iterator node, wavl_iterator child) noexcept {
+    wavl_iterator parent = node->parent_;
+    if (child)
+      child->parent_ = parent;
+    if (!parent)
+      root_ = child;
+    else if (parent->left_ == node)
+      parent->left_ = child;
+    else
+      parent->right_ = child;
+  }
+
+  // Lifts `node` above its parent, the parent adopts the inner subtree of `node`
+  void rotate_up(wavl_iterator node) noexcept {
+    wavl_iterator parent = node->parent_;
+    bool left = (parent->left_ == node);
+    wavl_iterator inner = left ? node->right_ : node->left_;
+    replace_child(parent, node);
+    (left ? parent->left_ : parent->right_) = inner;
+    if (inner)
+      inner->parent_ = parent;
+    (left ? node->right_ : node->left_) = parent;
+    parent->parent_ = node;
+  }
+
+  void count_rotation([[maybe_unused]] bool left, [[maybe_unused]] bool twice) noexcept {
+#ifdef SEARCHTREES_STATS
+    Tree_Stats &stats = *this->stats_sink();
+    if (twice)
+      ++(left ? stats.rotate_left_right_ : stats.rotate_right_left_);
+    else
+      ++(left ? stats.rotate_right_ : stats.rotate_left_);
+#endif
+  }
+
+private: // rebalancing
+  // `node` has got rank difference 0: it's a new leaf or it was promoted.
+  // Promotions go up while the sibling is a 1-child, then at most 2 rotations finish.
+  void rebalance_after_insert(wavl_iterator node) noexcept {
+    std::size_t length = 0;
+    for (wavl_iterator parent = node->parent_; parent != nullptr; node = parent, parent = node->parent_) {
+      ++length;
+      bool left = (parent->left_ == node);
+      if (is_rd2(parent, left)) { // 2 -> 1
+        parent->rank_diffs_ &= static_cast<std::uint8_t>(~side_bit(left));
+        break;
+      }
+      if (!is_rd2(parent, !left)) { // 0,1: promote parent
+        parent->rank_diffs_ = rank_diffs(left, false, true);
+        continue;
+      }
+
+      // 0,2: node has just been promoted, so it's 1,2 (a new leaf never gets here)
+      wavl_iterator inner = left ? node->right_ : node->left_;
+      if (is_rd2(node, !left)) { // parent goes down under node and is demoted
+        rotate_up(node);
+        node->rank_diffs_ = rank_diffs(left, is_rd2(node, left), false);
+        parent->rank_diffs_ = 0;
+        count_rotation(left, false);
+      } else { // inner goes up, node and parent are demoted under it
+        std::uint8_t inner_diffs = inner->rank_diffs_;
+        rotate_up(inner);
+        rotate_up(inner);
+        node->rank_diffs_ = rank_diffs(left, false, inner_diffs & side_bit(left));
+        parent->rank_diffs_ = rank_diffs(left, inner_diffs & side_bit(!left), false);
+        inner->rank_diffs_ = 0;
+        count_rotation(left, true);
+      }
+      break;
+    }
+    if (STATS_ENABLED)
+      Tree_Stats::record(this->stats_sink()->retrace_length_, length);
+  }
+
+  // The child of `parent` on the `left` side lost a rank relative to it.
+  // Demotions go up through 2,2-leaves and 3-children, then at most 2 rotations finish.
+  void rebalance_after_erase(wavl_iterator parent, bool left) noexcept {
+    std::size_t length = 0;
+    while (parent) {
+      ++length;
+      if (!is_rd2(parent, left)) { // 1 -> 2
+        parent->rank_diffs_ |= side_bit(left);
+        bool leaf_2_2 = !parent->left_ && !parent->right_ && is_rd2(parent, !left);
+        if (!leaf_2_2)
+          break;
+        parent->rank_diffs_ = 0; // leaves have rank 0
+      } else { // 3-child, so the sibling exists
+        wavl_iterator sibling = left ? parent->right_ : parent->left_;
+        assert(sibling);
+        if (is_rd2(parent, !left)) { // 3,2: demote parent
+          parent->rank_diffs_ = side_bit(left);
+        } else if (sibling->rank_diffs_ == (node_t::LEFT_RD2 | node_t::RIGHT_RD2)) { // 3,1 and 2,2 sibling: demote both
+          parent->rank_diffs_ = side_bit(left);
+          sibling->rank_diffs_ = 0;
+        } else {
+          rotate_after_erase(parent, sibling, left);
+          break;
+        }
+      }
+
+      // parent has been demoted
+      wavl_iterator node = parent;
+      parent = node->parent_;
+      if (parent)
+        left = (parent->left_ == node);
+    }
+    if (STATS_ENABLED)
+      Tree_Stats::record(this->stats_sink()->retrace_length_, length);
+  }
+
+  // `parent` is 3,1 with the 3-child on the `left` side, `sibling` is not 2,2
+  void rotate_after_erase(wavl_iterator parent, wavl_iterator sibling, bool left) noexcept {
+    wavl_iterator inner = left ? sibling->left_ : sibling->right_;
+    if (!is_rd2(sibling, !left)) { // sibling goes up and is promoted, parent is demoted
+      bool inner_rd2 = is_rd2(sibling, left);
+      rotate_up(sibling);
+      bool leaf = !parent->left_ && !parent->right_;
+      parent->rank_diffs_ = leaf ? 0 : rank_diffs(left, true, inner_rd2); // a leaf is demoted twice
+      sibling->rank_diffs_ = rank_diffs(left, leaf, true);
+      count_rotation(!left, false);
+    } else { // inner goes up twice, sibling is demoted and parent twice
+      std::uint8_t inner_diffs = inner->rank_diffs_;
+      rotate_up(inner);
+      rotate_up(inner);
+      parent->rank_diffs_ = rank_diffs(left, false, inner_diffs & side_bit(left));
+      sibling->rank_diffs_ = rank_diffs(left, inner_diffs & side_bit(!left), false);
+      inner->rank_diffs_ = node_t::LEFT_RD2 | node_t::RIGHT_RD2;
+      count_rotation(!left, true);
+    }
+  }
+
+  // Hides BST_Tree_Base::erase_node(). A node with 2 children is replaced by its
+  // successor, which takes over its rank, so the node really unlinked is a leaf
+  // or a unary node, and the rank of the position it leaves drops by one.
+  void erase_node(wavl_iterator node) noexcept {
+    wavl_iterator parent = nullptr;
+    bool left = false;
+    if (node->left_ && node->right_) {
+      wavl_iterator successor = base_tree_t::leftmost(node->right_);
+      if (successor->parent_ == node) {
+        parent = successor;
+      } else {
+        parent = successor->parent_;
+        left = true;
+        parent->left_ = successor->right_;
+        if (successor->right_)
+          successor->right_->parent_ = parent;
+        successor->right_ = node->right_;
+        node->right_->parent_ = successor;
+      }
+      successor->left_ = node->left_;
+      node->left_->parent_ = successor;
+      successor->rank_diffs_ = node->rank_diffs_;
+      replace_child(node, successor);
+    } else {
+      parent = node->parent_;
+      left = parent && parent->left_ == node;
+      replace_child(node, node->left_ ? node->left_ : node->right_);
+    }
+
+    this->destroy_node(node);
+    --this->size_;
+    rebalance_after_erase(parent, left);
+  }
+
+private: // hooks
+  void after_insert(wavl_iterator new_node) noexcept {
+    rebalance_after_insert(new_node);
+  }
+
+  // assign() puts size/2 keys to the left subtree and the rest minus one to the right,
+  // the rank of such a subtree is the bit width of its size minus one
+  void init_built_node(wavl_iterator node, size_type size) noexcept {
+    auto bit_width = [](size_type n) {
+      int width = 0;
+      for (; n >> width; ++width) {}
+      return width;
+    };
+    int width = bit_width(size);
+    size_type left_size = size / 2;
+    node->rank_diffs_ = rank_diffs(true, width - bit_width(left_size) == 2, width - bit_width(size - left_size - 1) == 2);
+  }
+
+  void dump_node(std::ostream &os, wavl_const_iterator node) const {
+    os << "(" << node->key_ << "; " << (is_rd2(node, true) ? 2 : 1) << "," << (is_rd2(node, false) ? 2 : 1) << ")";
+  }
+};
+
+
+// Balancing policies of Balanced_Tree
+struct AVL_Balance {};
+struct WAVL_Balance {};
+
+// Tree of unique keys whose balancing is chosen by a template parameter
+template <typename KeyT, typename Balance = AVL_Balance, typename Compare = std::less<KeyT>,
+          typename Alloc = std::allocator<KeyT>>
+using Balanced_Tree = typename std::conditional<std::is_same<Balance, WAVL_Balance>::value,
+                                                WAVL_Tree<KeyT, Compare, Alloc>,
+                                                AVL_Tree<KeyT, Compare, Alloc>>::type;
+
+} // SearchTrees
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include "avl_map.hpp"
+
+using SearchTrees::AVL_Map;
+
+// Iterators of AVL_Map refer to the std::pair stored in the node, as those of std::map do.
+// Node handles move the node itself between maps with equal allocators.
+// Returns 1 if any check fails.
+
+using Map = AVL_Map<int, std::string>;
+static_assert(std::is_same<Map::reference, Map::value_type &>::value, "iterator must refer to value_type");
+static_assert(std::is_same<Map::const_reference, const Map::value_type &>::value, "const_iterator must refer to const value_type");
+static_assert(std::is_same<std::iterator_traits<Map::iterator>::pointer, Map::value_type *>::value, "pointer must be value_type *");
+
+// Allocators with different ids compare unequal
+template <typename T>
+struct Tagged_Allocator : std::allocator<T> {
+  int id_ = 0;
+
+  template <typename U>
+  struct rebind { using other = Tagged_Allocator<U>; };
+
+  explicit Tagged_Allocator(int id = 0) noexcept : id_(id) {}
+  template <typename U>
+  Tagged_Allocator(const Tagged_Allocator<U> &other) noexcept : id_(other.id_) {}
+};
+template <typename T, typename U>
+bool operator== (const Tagged_Allocator<T> &lhs, const Tagged_Allocator<U> &rhs) noexcept { return lhs.id_ == rhs.id_; }
+template <typename T, typename U>
+bool operator!= (const Tagged_Allocator<T> &lhs, const Tagged_Allocator<U> &rhs) noexcept { return lhs.id_ != rhs.id_; }
+
+static bool check(bool condition, const char *what) {
+  if (!condition)
+    std::cerr << "FAILED: " << what << "\n";
+  return condition;
+}
+
+static bool node_handles() {
+  bool ok = true;
+
+  { // the node keeps its address, also after the source map is gone
+    Map target;
+    const Map::value_type *address = nullptr;
+    {
+      Map source;
+      for (int key = 0; key < 1000; ++key)
+        source.try_emplace(key, std::to_string(key));
+      address = &*source.find(500);
+      Map::node_type handle = source.extract(500);
+      ok &= check(handle && handle.key() == 500 && handle.mapped() == "500" && source.size() == 999, "extract");
+      auto result = target.insert(std::move(handle));
+      ok &= check(result.inserted && &*result.position == address && handle.empty(), "node moved without reallocation");
+      source.clear();
+      for (int key = 0; key < 1000; ++key)
+        source.try_emplace(key, "reused");
+    }
+    ok &= check(&*target.find(500) == address && target.at(500) == "500", "node outlives the source map");
+    target.erase(500);
+    target.try_emplace(7, "seven");
+    ok &= check(target.size() == 1 && target.at(7) == "seven", "slot of a moved node is recycled");
+  }
+
+  { // nodes moved back and forth, with a changed key and a duplicate
+    Map left, right;
+    for (int key = 0; key < 100; ++key)
+      left.try_emplace(key, std::to_string(key));
+    for (int round = 0; round < 3; ++round) {
+      for (int key = 0; key < 100; ++key) {
+        const Map::value_type *address = &*left.find(key);
+        auto result = right.insert(left.extract(key));
+        ok &= check(result.inserted && &*result.position == address, "move to the right");
+      }
+      std::swap(left, right);
+    }
+    auto handle = left.extract(10);
+    handle.key() = 1000;
+    auto moved = left.insert(std::move(handle));
+    ok &= check(moved.inserted && moved.position->first == 1000 && moved.position->second == "10", "changed key");
+    right.try_emplace(20, "other");
+    auto duplicate = right.insert(left.extract(20));
+    ok &= check(!duplicate.inserted && duplicate.node && duplicate.node.mapped() == "20" && right.at(20) == "other",
+                "duplicate key gives the handle back");
+    ok &= check(left.size() == 99 && right.size() == 1, "sizes after moves");
+  }
+
+  { // unequal allocators move the entry into a new node
+    using Tagged_Map = AVL_Map<int, std::string, std::less<int>, Tagged_Allocator<std::pair<const int, std::string>>>;
+    Tagged_Map source{Tagged_Allocator<std::pair<const int, std::string>>{1}};
+    Tagged_Map target{Tagged_Allocator<std::pair<const int, std::string>>{2}};
+    source.try_emplace(1, "one");
+    auto result = target.insert(source.extract(1));
+    ok &= check(result.inserted && target.at(1) == "one" && source.empty(), "unequal allocators");
+  }
+
+  { // a handle dropped without insertion destroys the entry
+    Map map;
+    map.try_emplace(1, std::string(100, 'x'));
+    Map::node_type handle = map.extract(1);
+    map.clear();
+    handle = Map::node_type{};
+    ok &= check(handle.empty() && map.empty(), "dropped handle");
+  }
+
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+
+  Map map;
+  for (int key = 0; key < 100; ++key)
+    map.try_emplace(key, std::to_string(key));
+
+  for (auto &[key, value] : map)
+    value += "!";
+  int visited = 0;
+  for (const auto &[key, value] : map)
+    visited += (value == std::to_string(key) + "!");
+  ok &= check(visited == 100, "structured bindings over the map");
+
+  auto it = map.find(42);
+  it->second = "answer";
+  ok &= check(it->first == 42 && map.at(42) == "answer", "operator-> refers to the stored pair");
+  ok &= check(&*it == &*map.find(42), "dereferencing gives the same object every time");
+  ok &= check(&it->second == &map.at(42), "mapped value through iterator and at() is the same object");
+
+  const Map &const_map = map;
+  ok &= check(const_map.begin()->first == 0 && std::prev(const_map.end())->second == "99!", "const_iterator");
+
+  ok &= node_handles();
+
+  std::cerr << (ok ? "avl map: ok\n" : "avl map: FAILED\n");
+  return ok ? 0 : 1;
+}
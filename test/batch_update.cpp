@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <set>
+#include <type_traits>
+#include <vector>
+#include "tree.hpp"
+
+using SearchTrees::AVL_Tree;
+
+// insert_batch() and erase_batch() must leave AVL_Tree equal to std::set after the same
+// keys are inserted or erased one by one, for empty batches, batches with duplicate keys,
+// sorted and unsorted batches, batches covering the whole tree and batches into an empty
+// tree. The links, heights and subtree sizes are checked after every batch.
+// Returns 1 if any check fails.
+
+using Tree = AVL_Tree<int>;
+using Order_Tree = AVL_Tree<int, std::less<int>, std::allocator<int>, true>;
+
+static bool check(bool condition, const char *what) {
+  if (!condition)
+    std::cerr << "FAILED: " << what << "\n";
+  return condition;
+}
+
+// Walks the tree from the root: parent links, heights, balance factors and subtree sizes
+template <typename TreeT>
+static bool valid(const TreeT &tree) {
+  using node_t = typename std::remove_const<typename std::remove_reference<decltype(*tree.root().node())>::type>::type;
+  const node_t *root = tree.root().node();
+  if (root && root->parent_)
+    return false;
+
+  std::vector<const node_t*> order; // children before parents
+  std::vector<const node_t*> stack;
+  if (root)
+    stack.push_back(root);
+  while (!stack.empty()) {
+    const node_t *node = stack.back();
+    stack.pop_back();
+    order.push_back(node);
+    for (const node_t *child : {node->left_, node->right_}) {
+      if (!child)
+        continue;
+      if (child->parent_ != node)
+        return false;
+      stack.push_back(child);
+    }
+  }
+  std::reverse(order.begin(), order.end());
+  for (const node_t *node : order) {
+    int left = node->left_ ? node->left_->height_ : 0;
+    int right = node->right_ ? node->right_->height_ : 0;
+    if (node->height_ != std::max(left, right) + 1 || left - right > 1 || right - left > 1)
+      return false;
+    if constexpr (std::is_same<TreeT, Order_Tree>::value) {
+      std::size_t size = 1 + (node->left_ ? node->left_->size_ : 0) + (node->right_ ? node->right_->size_ : 0);
+      if (node->size_ != size)
+        return false;
+    }
+  }
+  return order.size() == tree.size();
+}
+
+template <typename TreeT>
+static bool same(const TreeT &tree, const std::set<int> &expected) {
+  if (tree.size() != expected.size() || tree.empty() != expected.empty())
+    return false;
+  if (!std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()))
+    return false;
+  if (!std::equal(tree.rbegin(), tree.rend(), expected.rbegin(), expected.rend()))
+    return false;
+  if (!expected.empty() && *std::prev(tree.end()) != *expected.rbegin())
+    return false;
+  if constexpr (std::is_same<TreeT, Order_Tree>::value) {
+    std::size_t k = 0;
+    for (int key : expected) {
+      if (tree.rank(key) != k || *tree.select(k) != key)
+        return false;
+      ++k;
+    }
+  }
+  return true;
+}
+
+template <typename TreeT>
+static bool run(const char *name) {
+  bool ok = true;
+  std::mt19937 gen{18};
+  std::uniform_int_distribution<int> key_dist{0, 3000};
+
+  TreeT tree;
+  std::set<int> expected;
+  std::vector<int> batch;
+
+  auto apply = [&](bool insert) {
+    std::size_t changed = 0;
+    for (int key : batch)
+      changed += insert ? expected.insert(key).second : expected.erase(key);
+    std::size_t result = insert ? tree.insert_batch(batch.begin(), batch.end())
+                                : tree.erase_batch(batch.begin(), batch.end());
+    ok &= check(result == changed, insert ? "insert_batch result" : "erase_batch result");
+    ok &= check(same(tree, expected), insert ? "keys after insert_batch" : "keys after erase_batch");
+    ok &= check(valid(tree), insert ? "links after insert_batch" : "links after erase_batch");
+  };
+
+  // empty batches into an empty tree
+  batch.clear();
+  apply(true);
+  apply(false);
+
+  // a batch into an empty tree, duplicates included
+  batch = {5, 3, 5, 9, 3, 3, 1};
+  apply(true);
+  apply(true);
+
+  for (int round = 0; round < 300; ++round) {
+    batch.clear();
+    std::size_t count = gen() % 4 == 0 ? 0 : gen() % 200;
+    int lo = key_dist(gen), width = 1 + gen() % 3000;
+    for (std::size_t i = 0; i < count; ++i)
+      batch.push_back(lo + static_cast<int>(gen() % width));
+    if (count && gen() % 4 == 0) { // every key repeated
+      std::vector<int> copy = batch;
+      batch.insert(batch.end(), copy.begin(), copy.end());
+    }
+    if (gen() % 3 == 0) // sorted batches, with duplicates
+      std::sort(batch.begin(), batch.end());
+    apply(gen() % 5 < 3);
+  }
+
+  // a batch covering the whole tree, with keys around it
+  batch.assign(expected.begin(), expected.end());
+  batch.push_back(-5);
+  batch.push_back(4000);
+  std::shuffle(batch.begin(), batch.end(), gen);
+  apply(true);
+  apply(false);
+  ok &= check(tree.empty(), "whole tree erased");
+
+  // the whole tree again, then erased by a batch of its keys twice
+  batch.clear();
+  for (int key = 0; key < 2000; ++key)
+    batch.push_back(key);
+  apply(true);
+  for (int key = 0; key < 2000; ++key)
+    batch.push_back(key);
+  apply(false);
+  ok &= check(tree.empty(), "whole tree erased by duplicates");
+
+  std::cerr << name << (ok ? ": ok\n" : ": FAILED\n");
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  ok &= run<Tree>("batch update");
+  ok &= run<Order_Tree>("batch update with order statistics");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "bplus_tree.hpp"
+
+using SearchTrees::BPlus_Tree;
+
+// BPlus_Tree must stay equal to std::set under random inserts and erases, for integer keys
+// searched with SIMD and for std::string keys searched one by one. Small nodes make the tree
+// deep, so leaves and inner nodes are split while it grows and borrow from or merge with
+// their siblings while it shrinks back to empty. The memory taken by the nodes is checked
+// against the bound of half-full nodes, which a missed merge breaks.
+// Returns 1 if any check fails.
+
+#if defined(SEARCHTREES_SIMD_AVX2) || defined(SEARCHTREES_SIMD_SSE2)
+static_assert(SearchTrees::Node_Search<int, std::less<int>>::SIMD, "int keys are compared by SIMD registers");
+#endif
+static_assert(SearchTrees::Node_Search<std::string, std::less<std::string>>::SIMD == false, "strings are compared one by one");
+
+static bool check(bool condition, const char *what) {
+  if (!condition)
+    std::cerr << "FAILED: " << what << "\n";
+  return condition;
+}
+
+template <typename TreeT>
+struct Node_Sizes {
+  using key_t = typename TreeT::key_type;
+  static constexpr std::size_t LEAF = sizeof(SearchTrees::BPlus_Leaf<key_t, TreeT::LEAF_CAPACITY>);
+  static constexpr std::size_t INNER = sizeof(SearchTrees::BPlus_Inner<key_t, TreeT::INNER_CAPACITY>);
+};
+
+// Every node but the root is at least half full: there are at most size / MIN_LEAF_KEYS + 1
+// leaves and the inner levels above them shrink by MIN_INNER_KEYS + 1 each
+template <typename TreeT>
+static bool compact(const TreeT &tree) {
+  std::size_t leaves = tree.size() / TreeT::MIN_LEAF_KEYS + 1;
+  std::size_t inners = leaves / TreeT::MIN_INNER_KEYS + tree.height();
+  return tree.memory_used() <= leaves * Node_Sizes<TreeT>::LEAF + inners * Node_Sizes<TreeT>::INNER;
+}
+
+template <typename TreeT, typename KeyT>
+static bool same(const TreeT &tree, const std::set<KeyT> &expected, const std::vector<KeyT> &probes) {
+  if (tree.size() != expected.size() || tree.empty() != expected.empty())
+    return false;
+  if (!std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()))
+    return false;
+  if (!std::equal(tree.rbegin(), tree.rend(), expected.rbegin(), expected.rend()))
+    return false;
+  for (const KeyT &key : probes) {
+    auto lower = tree.lower_bound(key);
+    auto expected_lower = expected.lower_bound(key);
+    if ((lower == tree.end()) != (expected_lower == expected.end()) || (lower != tree.end() && *lower != *expected_lower))
+      return false;
+    auto upper = tree.upper_bound(key);
+    auto expected_upper = expected.upper_bound(key);
+    if ((upper == tree.end()) != (expected_upper == expected.end()) || (upper != tree.end() && *upper != *expected_upper))
+      return false;
+    if (tree.contains(key) != (expected.count(key) == 1) || (tree.find(key) != tree.end()) != tree.contains(key))
+      return false;
+  }
+  return true;
+}
+
+// make_key maps an integer in [0, key_count) to a key, in the same order
+template <typename TreeT, typename MakeKey>
+static bool run(const char *name, std::size_t key_count, MakeKey make_key) {
+  using key_t = typename TreeT::key_type;
+  bool ok = true;
+  std::mt19937 gen{21};
+  std::uniform_int_distribution<std::size_t> key_dist{0, key_count - 1};
+
+  TreeT tree;
+  std::set<key_t> expected;
+  std::vector<key_t> probes;
+  for (std::size_t i = 0; i < 200; ++i)
+    probes.push_back(make_key(key_dist(gen)));
+
+  auto verify = [&](const char *what) {
+    ok &= check(same(tree, expected, probes), what);
+    ok &= check(compact(tree), "memory of half-full nodes");
+  };
+  auto churn = [&](std::size_t steps, unsigned insert_percent) {
+    for (std::size_t step = 0; step < steps; ++step) {
+      key_t key = make_key(key_dist(gen));
+      if (gen() % 100 < insert_percent) {
+        bool inserted = expected.insert(key).second;
+        std::size_t size = tree.size();
+        ok &= check(*tree.insert(key) == key && tree.size() == size + inserted, "insert result");
+      } else {
+        ok &= check(tree.erase(key) == (expected.erase(key) == 1), "erase result");
+      }
+    }
+  };
+
+  ok &= check(!tree.erase(make_key(0)) && tree.height() == 0, "erase from an empty tree");
+
+  // growth splits leaves and inner nodes, erase-heavy churn borrows and merges
+  for (int round = 0; round < 3; ++round) {
+    churn(key_count, 90);
+    verify("keys after growth");
+    std::size_t grown_height = tree.height();
+    ok &= check(grown_height >= 3, "inner nodes split");
+
+    churn(key_count, 30);
+    verify("keys after erase-heavy churn");
+    churn(key_count / 2, 50);
+    verify("keys after mixed churn");
+
+    // copies are rebuilt from the keys, the original stays intact
+    TreeT copy{tree};
+    ok &= check(std::equal(copy.begin(), copy.end(), expected.begin(), expected.end()), "copy");
+    copy = tree;
+    ok &= check(std::equal(copy.begin(), copy.end(), tree.begin(), tree.end()), "copy assignment");
+
+    // erasing in random order down to a few keys merges up to the root
+    std::vector<key_t> keys(expected.begin(), expected.end());
+    std::shuffle(keys.begin(), keys.end(), gen);
+    for (std::size_t i = 0; i + 5 < keys.size(); ++i) {
+      ok &= check(tree.erase(keys[i]), "erase of a present key");
+      expected.erase(keys[i]);
+      if (i % 97 == 0)
+        ok &= check(compact(tree), "memory while shrinking");
+    }
+    verify("keys after shrinking");
+    ok &= check(tree.height() == 1, "root collapsed to a leaf");
+    ok &= check(copy.size() == keys.size(), "copy unaffected by erases");
+  }
+
+  // down to empty and up again
+  std::vector<key_t> rest(expected.begin(), expected.end());
+  for (const key_t &key : rest)
+    ok &= check(tree.erase(key), "erase of the last keys");
+  expected.clear();
+  verify("keys after erasing all");
+  ok &= check(tree.height() == 0 && tree.memory_used() == 0, "empty tree has no nodes");
+  churn(key_count / 4, 100);
+  verify("keys after refill");
+
+  std::cerr << name << (ok ? ": ok\n" : ": FAILED\n");
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  ok &= run<BPlus_Tree<int, std::less<int>, std::allocator<int>, 64>>(
+    "b+ tree of int, small nodes", 20'000, [](std::size_t i) { return static_cast<int>(i) - 10'000; });
+  ok &= run<BPlus_Tree<int>>(
+    "b+ tree of int", 100'000, [](std::size_t i) { return static_cast<int>(i * 3); });
+  // around the sign bit, where the SIMD compare of unsigned keys flips it
+  ok &= run<BPlus_Tree<std::uint32_t>>(
+    "b+ tree of uint32_t", 100'000, [](std::size_t i) { return static_cast<std::uint32_t>(0x7fff'0000u + i); });
+  ok &= run<BPlus_Tree<std::int64_t>>(
+    "b+ tree of int64_t", 50'000, [](std::size_t i) { return static_cast<std::int64_t>(i) * 1'000'000'007 - (1LL << 40); });
+  // long strings live on the heap, so moves between nodes are checked too
+  ok &= run<BPlus_Tree<std::string>>(
+    "b+ tree of std::string", 20'000, [](std::size_t i) {
+      std::string digits = std::to_string(i);
+      return std::string(5 - digits.size(), '0') + digits + (i % 2 ? " with a suffix past the small string buffer" : "");
+    });
+  return ok ? 0 : 1;
+}
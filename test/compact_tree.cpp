@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "compact_tree.hpp"
+
+using SearchTrees::Compact_AVL_Tree;
+
+// Compact_AVL_Tree must stay equal to std::set under random inserts, erases by key and by
+// iterator, copies and assignments, with erased slots reused by later inserts. After every
+// batch check_invariants() walks the tree: parent links, the heights packed into the top
+// bits of the links, balance, and the free list. int keys are copied by memcpy of the
+// storage, std::string keys are not. A tall tree needs the height bits of all three links.
+// Returns 1 if any check fails.
+
+static bool check(bool condition, const char *what) {
+  if (!condition)
+    std::cerr << "FAILED: " << what << "\n";
+  return condition;
+}
+
+// AVL tree of n keys is lower than 1.4405 log2(n + 2) - 0.3277
+template <typename TreeT>
+static bool balanced(const TreeT &tree) {
+  return tree.height() <= 1.4405 * std::log2(tree.size() + 2.0) - 0.3277;
+}
+
+template <typename TreeT, typename KeyT>
+static bool same(const TreeT &tree, const std::set<KeyT> &expected, const std::vector<KeyT> &probes) {
+  if (tree.size() != expected.size() || tree.empty() != expected.empty())
+    return false;
+  if (!std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()))
+    return false;
+  if (!std::equal(tree.rbegin(), tree.rend(), expected.rbegin(), expected.rend()))
+    return false;
+  for (const KeyT &key : probes) {
+    auto lower = tree.lower_bound(key);
+    auto expected_lower = expected.lower_bound(key);
+    if ((lower == tree.end()) != (expected_lower == expected.end()) || (lower != tree.end() && *lower != *expected_lower))
+      return false;
+    auto upper = tree.upper_bound(key);
+    auto expected_upper = expected.upper_bound(key);
+    if ((upper == tree.end()) != (expected_upper == expected.end()) || (upper != tree.end() && *upper != *expected_upper))
+      return false;
+    if (tree.contains(key) != (expected.count(key) == 1))
+      return false;
+  }
+  return true;
+}
+
+// make_key maps an integer in [0, key_count) to a key, in the same order
+template <typename KeyT, typename MakeKey>
+static bool run(const char *name, std::size_t key_count, MakeKey make_key) {
+  using Tree = Compact_AVL_Tree<KeyT>;
+  bool ok = true;
+  std::mt19937 gen{25};
+  std::uniform_int_distribution<std::size_t> key_dist{0, key_count - 1};
+
+  Tree tree;
+  std::set<KeyT> expected;
+  std::vector<KeyT> probes;
+  for (std::size_t i = 0; i < 100; ++i)
+    probes.push_back(make_key(key_dist(gen)));
+
+  auto verify = [&](const Tree &tree, const std::set<KeyT> &expected, const char *what) {
+    ok &= check(same(tree, expected, probes), what);
+    ok &= check(tree.check_invariants() && balanced(tree), "links, heights and free list");
+  };
+
+  ok &= check(tree.check_invariants() && !tree.erase(make_key(0)), "empty tree");
+
+  std::vector<Tree> copies;
+  std::vector<std::set<KeyT>> copy_keys;
+  for (int round = 0; round < 60; ++round) {
+    unsigned insert_percent = round % 10 < 5 ? 70 : 25; // growing, then erase-heavy
+    for (std::size_t step = 0; step < key_count / 10; ++step) {
+      KeyT key = make_key(key_dist(gen));
+      unsigned action = gen() % 100;
+      if (action < insert_percent) {
+        bool inserted = expected.insert(key).second;
+        std::size_t size = tree.size();
+        ok &= check(*tree.insert(key) == key && tree.size() == size + inserted, "insert result");
+      } else if (action % 2 == 0) {
+        ok &= check(tree.erase(key) == (expected.erase(key) == 1), "erase result");
+      } else {
+        auto it = tree.lower_bound(key);
+        if (it == tree.end())
+          continue;
+        auto expected_next = expected.erase(expected.lower_bound(key));
+        auto next = tree.erase(it);
+        ok &= check((next == tree.end()) == (expected_next == expected.end()) &&
+                    (next == tree.end() || *next == *expected_next), "erase(iterator) result");
+      }
+    }
+    verify(tree, expected, "keys after a batch");
+
+    // copies share nothing with the tree, assignment replaces the contents
+    if (round % 6 == 0) {
+      copies.push_back(tree);
+      copy_keys.push_back(expected);
+    }
+    if (round % 6 == 3) {
+      Tree assigned{copies.front()};
+      assigned = tree;
+      verify(assigned, expected, "keys of an assigned tree");
+      assigned.shrink_to_fit();
+      verify(assigned, expected, "keys after shrink_to_fit");
+    }
+  }
+  for (std::size_t i = 0; i < copies.size(); ++i)
+    verify(copies[i], copy_keys[i], "keys of a copy");
+
+  // erased down to empty by iterators, then refilled from the free slots
+  std::size_t memory = tree.memory_used();
+  while (!tree.empty()) {
+    auto it = tree.begin();
+    std::advance(it, gen() % tree.size());
+    expected.erase(*it);
+    tree.erase(it);
+    if (tree.size() % 257 == 0)
+      ok &= check(tree.check_invariants(), "links while erasing by iterator");
+  }
+  verify(tree, expected, "keys after erasing all");
+  for (std::size_t step = 0; step < key_count / 4; ++step) {
+    KeyT key = make_key(key_dist(gen));
+    tree.insert(key);
+    expected.insert(key);
+  }
+  verify(tree, expected, "keys after refill");
+  ok &= check(tree.memory_used() == memory, "free slots reused");
+
+  // assign() builds the tree without rotations
+  tree.assign(expected.begin(), expected.end());
+  verify(tree, expected, "keys after assign");
+  tree.clear();
+  verify(tree, std::set<KeyT>{}, "keys after clear");
+
+  std::cerr << name << (ok ? ": ok\n" : ": FAILED\n");
+  return ok;
+}
+
+// Heights of 16 and more use the top bits of the right link too
+static bool run_tall() {
+  bool ok = true;
+  Compact_AVL_Tree<int> tree;
+  for (int key = 0; key < 100'000; ++key)
+    tree.insert(key);
+  ok &= check(tree.height() >= 17 && tree.check_invariants() && balanced(tree), "links and heights of a tall tree");
+  for (auto it = tree.begin(); it != tree.end();)
+    it = std::next(tree.erase(it));
+  ok &= check(tree.size() == 50'000 && tree.height() >= 16 && tree.check_invariants() && balanced(tree),
+              "links and heights of a tall tree after erases");
+  ok &= check(std::adjacent_find(tree.begin(), tree.end(), [](int lhs, int rhs) { return rhs != lhs + 2; }) == tree.end() &&
+              *tree.begin() == 1, "keys of a tall tree");
+  std::cerr << (ok ? "tall compact tree: ok\n" : "tall compact tree: FAILED\n");
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  ok &= run_tall();
+  ok &= run<int>("compact tree of int", 20'000, [](std::size_t i) { return static_cast<int>(i) * 7 - 50'000; });
+  ok &= run<std::string>("compact tree of std::string", 5'000, [](std::size_t i) {
+    std::string digits = std::to_string(i);
+    return std::string(4 - digits.size(), '0') + digits + (i % 2 ? " with a suffix past the small string buffer" : "");
+  });
+  return ok ? 0 : 1;
+}
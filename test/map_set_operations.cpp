@@ -0,0 +1,69 @@
+#include <iostream>
+#include "avl_map.hpp"
+
+using SearchTrees::AVL_Map;
+using SearchTrees::Fork_Join_Pool;
+
+// Set operations on maps keep the mapped values of *this for equal keys,
+// whichever of the two trees is taller and gives the pivots.
+// Returns 1 if any check fails.
+
+static AVL_Map<int, int> make_map(int first, int last, int step, int value) {
+  AVL_Map<int, int> map;
+  for (int key = first; key < last; key += step)
+    map.insert_or_assign(key, value);
+  return map;
+}
+
+static bool check(bool condition, const char *what) {
+  if (!condition)
+    std::cerr << "FAILED: " << what << "\n";
+  return condition;
+}
+
+int main() {
+  bool ok = true;
+  Fork_Join_Pool workers{4};
+
+  { // *this is taller
+    AVL_Map<int, int> map = make_map(0, 1000, 1, 100);
+    map.union_with(make_map(0, 8, 2, 200));
+    ok &= check(map.size() == 1000 && map.at(0) == 100 && map.at(6) == 100, "union_with, *this taller");
+  }
+  { // *this is shorter
+    AVL_Map<int, int> map = make_map(0, 8, 2, 100);
+    map.union_with(make_map(0, 1000, 1, 200));
+    ok &= check(map.size() == 1000 && map.at(0) == 100 && map.at(1) == 200, "union_with, *this shorter");
+  }
+  {
+    AVL_Map<int, int> map = make_map(0, 1000, 1, 100);
+    map.intersect_with(make_map(0, 8, 2, 200));
+    ok &= check(map.size() == 4 && map.at(0) == 100 && map.at(6) == 100, "intersect_with, *this taller");
+  }
+  {
+    AVL_Map<int, int> map = make_map(0, 8, 2, 100);
+    map.intersect_with(make_map(0, 1000, 1, 200));
+    ok &= check(map.size() == 4 && map.at(0) == 100 && map.at(6) == 100, "intersect_with, *this shorter");
+  }
+  {
+    AVL_Map<int, int> map = make_map(0, 1000, 1, 100);
+    map.merge(make_map(500, 1500, 1, 200));
+    ok &= check(map.size() == 1500 && map.at(500) == 100 && map.at(1000) == 200, "merge");
+  }
+  {
+    AVL_Map<int, int> map = make_map(0, 1000, 1, 100);
+    map.difference_with(make_map(0, 8, 2, 200));
+    ok &= check(map.size() == 996 && !map.contains(0) && map.at(1) == 100, "difference_with, *this taller");
+  }
+  { // parallel halves
+    AVL_Map<int, int> map = make_map(0, 100'000, 1, 100);
+    map.union_with(make_map(0, 100'000, 7, 200), workers);
+    bool kept = true;
+    for (int key = 0; key < 100'000; key += 7)
+      kept = kept && map.at(key) == 100;
+    ok &= check(map.size() == 100'000 && kept, "parallel union_with, *this taller");
+  }
+
+  std::cerr << (ok ? "map set operations: ok\n" : "map set operations: FAILED\n");
+  return ok ? 0 : 1;
+}
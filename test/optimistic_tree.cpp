@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+#include "optimistic_tree.hpp"
+
+using SearchTrees::Optimistic_Tree;
+
+// Runs mixed insert/erase/contains from several threads, first on disjoint
+// keys, where every thread knows the exact expected content of its keys, then
+// on a small shared key range to force conflicts and rotations near the same
+// nodes. After each run the AVL invariants are checked. Built without NDEBUG,
+// so the assertions inside the tree are checked too.
+// Returns 1 if any check fails.
+
+static bool stress(unsigned threads, size_t ops) {
+  bool ok = true;
+
+  { // disjoint keys: thread t owns keys equal to t modulo threads
+    Optimistic_Tree<int> tree;
+    std::vector<std::set<int>> expected(threads);
+    std::vector<char> thread_ok(threads, 1);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+      workers.emplace_back([&, t] {
+        std::mt19937 gen{t};
+        for (size_t i = 0; i < ops; ++i) {
+          int key = static_cast<int>((gen() % 4096) * threads + t);
+          switch (gen() % 3) {
+            case 0: thread_ok[t] &= (tree.insert(key) == expected[t].insert(key).second); break;
+            case 1: thread_ok[t] &= (tree.erase(key) == (expected[t].erase(key) == 1)); break;
+            default: thread_ok[t] &= (tree.contains(key) == (expected[t].count(key) == 1)); break;
+          }
+        }
+      });
+    }
+    for (auto &worker : workers)
+      worker.join();
+
+    size_t total = 0;
+    for (unsigned t = 0; t < threads; ++t) {
+      ok = ok && thread_ok[t];
+      total += expected[t].size();
+      for (int key : expected[t])
+        ok = ok && tree.contains(key);
+    }
+    ok = ok && total == tree.size() && tree.check_invariants();
+  }
+
+  { // shared keys: results are checked only through the final content
+    Optimistic_Tree<int> tree;
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t) {
+      workers.emplace_back([&, t] {
+        std::mt19937 gen{1000 + t};
+        for (size_t i = 0; i < ops; ++i) {
+          int key = static_cast<int>(gen() % 256);
+          if (gen() % 2)
+            tree.insert(key);
+          else
+            tree.erase(key);
+        }
+      });
+    }
+    for (auto &worker : workers)
+      worker.join();
+
+    size_t present = 0;
+    for (int key = 0; key < 256; ++key)
+      present += tree.contains(key);
+    ok = ok && present == tree.size() && tree.check_invariants();
+  }
+
+  return ok;
+}
+
+int main() {
+  unsigned threads = std::max(4u, std::thread::hardware_concurrency());
+  bool ok = stress(threads, 50'000);
+  std::cerr << (ok ? "optimistic tree stress: ok\n" : "optimistic tree stress: FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+#include "persistent_tree.hpp"
+
+using SearchTrees::Persistent_Tree;
+
+// Snapshots of Persistent_Tree taken along random inserts and erases must stay
+// equal to std::set copies taken at the same moments and stay AVL-balanced,
+// whatever happens to the live tree and to the other snapshots afterwards.
+// Returns 1 if any check fails.
+
+using Tree = Persistent_Tree<int>;
+
+static bool check(bool condition, const char *what) {
+  if (!condition)
+    std::cerr << "FAILED: " << what << "\n";
+  return condition;
+}
+
+// AVL tree of n keys is lower than 1.4405 log2(n + 2) - 0.3277
+static bool balanced(const Tree &tree) {
+  return tree.height() <= 1.4405 * std::log2(tree.size() + 2.0) - 0.3277;
+}
+
+static bool same(const Tree &tree, const std::set<int> &expected) {
+  if (tree.size() != expected.size() || tree.empty() != expected.empty())
+    return false;
+  if (!std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()))
+    return false;
+  if (!std::equal(tree.rbegin(), tree.rend(), expected.rbegin(), expected.rend()))
+    return false;
+  for (int key = -1; key <= 2001; key += 7) {
+    auto it = tree.lower_bound(key);
+    auto expected_it = expected.lower_bound(key);
+    if ((it == tree.end()) != (expected_it == expected.end()) || (it != tree.end() && *it != *expected_it))
+      return false;
+    if (tree.contains(key) != (expected.count(key) == 1))
+      return false;
+  }
+  return true;
+}
+
+int main() {
+  bool ok = true;
+  std::mt19937 gen{15};
+  std::uniform_int_distribution<int> key_dist{0, 2000};
+
+  Tree live;
+  std::set<int> live_keys;
+  std::vector<Tree> snapshots;
+  std::vector<std::set<int>> snapshot_keys;
+
+  for (int step = 1; step <= 60'000; ++step) {
+    int key = key_dist(gen);
+    if (gen() % 3 != 0) {
+      ok &= check(live.insert(key) == live_keys.insert(key).second, "insert result");
+    } else {
+      ok &= check(live.erase(key) == (live_keys.erase(key) == 1), "erase result");
+    }
+    if (step % 2'000 == 0) {
+      snapshots.push_back(live.snapshot());
+      snapshot_keys.push_back(live_keys);
+    }
+  }
+  ok &= check(same(live, live_keys) && balanced(live), "live tree");
+
+  // erase-heavy churn of the live tree, then of every other snapshot
+  for (int step = 0; step < 30'000; ++step) {
+    int key = key_dist(gen);
+    if (gen() % 4 == 0) {
+      live.insert(key);
+      live_keys.insert(key);
+    } else {
+      live.erase(key);
+      live_keys.erase(key);
+    }
+  }
+  for (size_t i = 1; i < snapshots.size(); i += 2) {
+    for (int step = 0; step < 1'000; ++step) {
+      int key = key_dist(gen);
+      snapshots[i].erase(key);
+      snapshot_keys[i].erase(key);
+      snapshots[i].insert(key + 1);
+      snapshot_keys[i].insert(key + 1);
+    }
+  }
+  ok &= check(same(live, live_keys) && balanced(live), "live tree after churn");
+
+  for (size_t i = 0; i < snapshots.size(); ++i) {
+    ok &= check(same(snapshots[i], snapshot_keys[i]), "snapshot keeps its keys");
+    ok &= check(balanced(snapshots[i]), "snapshot stays balanced");
+  }
+
+  // releasing versions in any order leaves the others intact
+  for (size_t i = 0; i < snapshots.size(); i += 3)
+    snapshots[i].clear();
+  live.clear();
+  for (size_t i = 0; i < snapshots.size(); ++i) {
+    if (i % 3 != 0)
+      ok &= check(same(snapshots[i], snapshot_keys[i]), "snapshot after other versions are released");
+  }
+
+  std::cerr << (ok ? "persistent tree: ok\n" : "persistent tree: FAILED\n");
+  return ok ? 0 : 1;
+}
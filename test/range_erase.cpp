@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <set>
+#include <type_traits>
+#include <vector>
+#include "tree.hpp"
+
+using SearchTrees::AVL_Tree;
+
+// erase_range(lo, hi) must erase the same keys as std::set::erase(lower_bound(lo), lower_bound(hi))
+// for empty trees, empty ranges, lo >= hi, ranges beside the keys, bounds on and between keys and
+// ranges covering the whole tree, and keep the tree usable afterwards. range() and
+// for_each_in_range() are compared on the same bounds. The links, heights and subtree sizes
+// are checked after every erase.
+// Returns 1 if any check fails.
+
+using Tree = AVL_Tree<int>;
+using Order_Tree = AVL_Tree<int, std::less<int>, std::allocator<int>, true>;
+
+static bool check(bool condition, const char *what) {
+  if (!condition)
+    std::cerr << "FAILED: " << what << "\n";
+  return condition;
+}
+
+// Walks the tree from the root: parent links, heights, balance factors and subtree sizes
+template <typename TreeT>
+static bool valid(const TreeT &tree) {
+  using node_t = typename std::remove_const<typename std::remove_reference<decltype(*tree.root().node())>::type>::type;
+  const node_t *root = tree.root().node();
+  if (root && root->parent_)
+    return false;
+
+  std::vector<const node_t*> order; // children before parents
+  std::vector<const node_t*> stack;
+  if (root)
+    stack.push_back(root);
+  while (!stack.empty()) {
+    const node_t *node = stack.back();
+    stack.pop_back();
+    order.push_back(node);
+    for (const node_t *child : {node->left_, node->right_}) {
+      if (!child)
+        continue;
+      if (child->parent_ != node)
+        return false;
+      stack.push_back(child);
+    }
+  }
+  std::reverse(order.begin(), order.end());
+  for (const node_t *node : order) {
+    int left = node->left_ ? node->left_->height_ : 0;
+    int right = node->right_ ? node->right_->height_ : 0;
+    if (node->height_ != std::max(left, right) + 1 || left - right > 1 || right - left > 1)
+      return false;
+    if constexpr (std::is_same<TreeT, Order_Tree>::value) {
+      std::size_t size = 1 + (node->left_ ? node->left_->size_ : 0) + (node->right_ ? node->right_->size_ : 0);
+      if (node->size_ != size)
+        return false;
+    }
+  }
+  return order.size() == tree.size();
+}
+
+template <typename TreeT>
+static bool same(const TreeT &tree, const std::set<int> &expected) {
+  if (tree.size() != expected.size() || tree.empty() != expected.empty())
+    return false;
+  if (!std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()))
+    return false;
+  if (!std::equal(tree.rbegin(), tree.rend(), expected.rbegin(), expected.rend()))
+    return false;
+  if (!expected.empty() && *std::prev(tree.end()) != *expected.rbegin())
+    return false;
+  if constexpr (std::is_same<TreeT, Order_Tree>::value) {
+    std::size_t k = 0;
+    for (int key : expected) {
+      if (tree.rank(key) != k || *tree.select(k) != key)
+        return false;
+      ++k;
+    }
+  }
+  return true;
+}
+
+template <typename TreeT>
+static bool run(const char *name) {
+  bool ok = true;
+  std::mt19937 gen{20};
+  std::uniform_int_distribution<int> key_dist{0, 3000};
+
+  TreeT tree;
+  std::set<int> expected;
+
+  auto erase_range = [&](int lo, int hi) {
+    std::vector<int> in_range;
+    tree.for_each_in_range(lo, hi, [&](int key) { in_range.push_back(key); });
+    auto range = tree.range(lo, hi);
+    auto first = expected.lower_bound(lo), last = lo < hi ? expected.lower_bound(hi) : first;
+    ok &= check(std::equal(in_range.begin(), in_range.end(), first, last), "for_each_in_range keys");
+    ok &= check(std::equal(range.begin(), range.end(), first, last), "range keys");
+
+    std::size_t count = std::distance(first, last);
+    expected.erase(first, last);
+    ok &= check(tree.erase_range(lo, hi) == count, "erase_range result");
+    ok &= check(same(tree, expected), "keys after erase_range");
+    ok &= check(valid(tree), "links after erase_range");
+  };
+  auto fill = [&](std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+      int key = key_dist(gen);
+      auto it = gen() % 2 == 0 ? tree.insert(key) : tree.insert(tree.end(), key); // end() hints use the cached last node
+      ok &= check(*it == *expected.insert(key).first, "insert result");
+    }
+    ok &= check(same(tree, expected) && valid(tree), "keys after inserts");
+  };
+
+  // empty tree
+  erase_range(0, 10);
+  erase_range(10, 0);
+
+  fill(1'000);
+  int min = *expected.begin(), max = *expected.rbegin();
+  erase_range(500, 500);        // lo == hi
+  erase_range(700, 300);        // lo > hi
+  erase_range(-100, min);       // below every key
+  erase_range(max + 1, 5'000);  // above every key
+  erase_range(min, min + 1);    // the first key only
+  erase_range(max, max + 1);    // the last key only
+  fill(10);
+  int lo = *std::next(expected.begin(), expected.size() / 3), hi = *std::next(expected.begin(), expected.size() / 2);
+  erase_range(lo, hi);          // bounds on keys
+  erase_range(lo - 1, hi + 1);
+
+  for (int round = 0; round < 300; ++round) {
+    int from = key_dist(gen) - 50, to = from + static_cast<int>(gen() % (gen() % 4 == 0 ? 3000 : 60)) - 5;
+    erase_range(from, to);
+    if (gen() % 2 == 0)
+      fill(gen() % 40);
+    if (tree.size() < 200)
+      fill(500);
+  }
+
+  // the whole tree, then inserts above and below the old bounds
+  erase_range(-1, 3'001);
+  ok &= check(tree.empty(), "whole tree erased");
+  fill(300);
+  erase_range(*expected.begin(), *expected.rbegin() + 1);
+  ok &= check(tree.empty(), "whole tree erased by its bounds");
+  for (int key : {7, 4'000, -4'000, 5'000}) {
+    ok &= check(*tree.insert(tree.end(), key) == *expected.insert(key).first, "insert after erase_range");
+    ok &= check(same(tree, expected) && valid(tree), "keys after insert");
+  }
+
+  std::cerr << name << (ok ? ": ok\n" : ": FAILED\n");
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  ok &= run<Tree>("range erase");
+  ok &= run<Order_Tree>("range erase with order statistics");
+  return ok ? 0 : 1;
+}
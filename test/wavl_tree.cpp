@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "wavl_tree.hpp"
+
+using SearchTrees::WAVL_Tree;
+
+// WAVL_Tree must keep the rank rule through random erase-heavy churn: the rank differences
+// stored in a node agree on its rank, are 1 or 2, and a leaf has rank differences of 1 on
+// both sides. Built by insertions only it must be an AVL tree, with erasures its height
+// must stay within 2 log2(n). The keys are compared with std::set after every batch.
+// Returns 1 if any check fails.
+
+using Tree = WAVL_Tree<int>;
+using node_t = SearchTrees::WAVL_Node<int>;
+
+static bool check(bool condition, const char *what) {
+  if (!condition)
+    std::cerr << "FAILED: " << what << "\n";
+  return condition;
+}
+
+struct Shape {
+  bool links_ = true;
+  bool rank_rule_ = true;
+  bool avl_ = true; // rank is height - 1 everywhere, children heights differ by at most 1
+  int height_ = 0;
+};
+
+// A missing child has rank -1, ranks are computed from the leaves up
+static Shape shape(const Tree &tree) {
+  Shape result;
+  const node_t *root = tree.root().node();
+  if (root && root->parent_)
+    result.links_ = false;
+
+  std::vector<const node_t*> order; // children before parents
+  std::vector<const node_t*> stack;
+  if (root)
+    stack.push_back(root);
+  while (!stack.empty()) {
+    const node_t *node = stack.back();
+    stack.pop_back();
+    order.push_back(node);
+    for (const node_t *child : {node->left_, node->right_}) {
+      if (!child)
+        continue;
+      if (child->parent_ != node)
+        result.links_ = false;
+      stack.push_back(child);
+    }
+  }
+  result.links_ &= order.size() == tree.size();
+  std::reverse(order.begin(), order.end());
+
+  struct Info { int rank_, height_; };
+  std::unordered_map<const node_t*, Info> infos;
+  auto info = [&](const node_t *node) { return node ? infos.at(node) : Info{-1, 0}; };
+  for (const node_t *node : order) {
+    if (node->rank_diffs_ & ~(node_t::LEFT_RD2 | node_t::RIGHT_RD2))
+      result.rank_rule_ = false;
+    int left_diff = node->rank_diffs_ & node_t::LEFT_RD2 ? 2 : 1;
+    int right_diff = node->rank_diffs_ & node_t::RIGHT_RD2 ? 2 : 1;
+    Info left = info(node->left_), right = info(node->right_);
+    int rank = left.rank_ + left_diff;
+    if (right.rank_ + right_diff != rank)
+      result.rank_rule_ = false;
+    if (!node->left_ && !node->right_ && node->rank_diffs_ != 0)
+      result.rank_rule_ = false;
+
+    int height = std::max(left.height_, right.height_) + 1;
+    if (rank != height - 1 || std::abs(left.height_ - right.height_) > 1)
+      result.avl_ = false;
+    infos[node] = Info{rank, height};
+  }
+  result.height_ = info(root).height_;
+  return result;
+}
+
+static bool same(const Tree &tree, const std::set<int> &expected) {
+  return tree.size() == expected.size() && tree.empty() == expected.empty() &&
+         std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()) &&
+         std::equal(tree.rbegin(), tree.rend(), expected.rbegin(), expected.rend());
+}
+
+static bool low(const Shape &shape, std::size_t size) {
+  return shape.height_ <= 2 * std::log2(size + 1.0) + 1;
+}
+
+int main() {
+  bool ok = true;
+  std::mt19937 gen{22};
+  std::uniform_int_distribution<int> key_dist{0, 20'000};
+
+  Tree tree;
+  std::set<int> expected;
+
+  // insertions only: an AVL tree
+  for (int step = 0; step < 10'000; ++step) {
+    int key = key_dist(gen);
+    tree.insert(key);
+    expected.insert(key);
+  }
+  Shape grown = shape(tree);
+  ok &= check(same(tree, expected), "keys after inserts");
+  ok &= check(grown.links_ && grown.rank_rule_, "rank rule after inserts");
+  ok &= check(grown.avl_, "AVL tree after inserts");
+
+  // assign() and copies keep the ranks of the built tree
+  Tree built(expected.begin(), expected.end());
+  Shape built_shape = shape(built);
+  ok &= check(same(built, expected) && built_shape.links_ && built_shape.rank_rule_, "rank rule after assign");
+  Tree copy{tree};
+  std::set<int> copy_keys = expected;
+  Shape copy_shape = shape(copy);
+  ok &= check(same(copy, expected) && copy_shape.links_ && copy_shape.rank_rule_, "rank rule of a copy");
+
+  // erase-heavy churn by key and by iterator down to a few keys and back
+  for (int round = 0; round < 40; ++round) {
+    int erase_percent = round % 4 == 3 ? 20 : 85;
+    for (int step = 0; step < 2'000; ++step) {
+      int key = key_dist(gen);
+      if (static_cast<int>(gen() % 100) >= erase_percent) {
+        tree.insert(key);
+        expected.insert(key);
+      } else if (gen() % 2 == 0) {
+        ok &= check(tree.erase(key) == (expected.erase(key) == 1), "erase result");
+      } else {
+        auto it = tree.lower_bound(key);
+        auto expected_it = expected.lower_bound(key);
+        if (it == tree.end())
+          continue;
+        auto next = tree.erase(it);
+        auto expected_next = expected.erase(expected_it);
+        ok &= check((next == tree.end()) == (expected_next == expected.end()) &&
+                    (next == tree.end() || *next == *expected_next), "erase(iterator) result");
+      }
+    }
+    Shape churned = shape(tree);
+    ok &= check(same(tree, expected), "keys after churn");
+    ok &= check(churned.links_ && churned.rank_rule_, "rank rule after churn");
+    ok &= check(low(churned, tree.size()), "height after churn");
+  }
+
+  // the whole tree erased in random order, checking on the way
+  std::vector<int> keys(expected.begin(), expected.end());
+  std::shuffle(keys.begin(), keys.end(), gen);
+  for (std::size_t i = 0; i < keys.size(); ++i) {
+    ok &= check(tree.erase(keys[i]), "erase of a present key");
+    expected.erase(keys[i]);
+    if (i % 101 == 0) {
+      Shape shrunk = shape(tree);
+      ok &= check(shrunk.links_ && shrunk.rank_rule_ && low(shrunk, tree.size()), "rank rule while shrinking");
+    }
+  }
+  ok &= check(tree.empty() && same(tree, expected), "all keys erased");
+
+  // the copy is unaffected
+  copy_shape = shape(copy);
+  ok &= check(same(copy, copy_keys) && copy_shape.links_ && copy_shape.rank_rule_, "copy after churn");
+
+  std::cerr << (ok ? "wavl tree: ok\n" : "wavl tree: FAILED\n");
+  return ok ? 0 : 1;
+}